@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "dungeon.h"
+#include "pc.h"
+#include "npc.h"
+#include "move.h"
+#include "io.h"
+#include "object.h"
+#include "event.h"
+
+/* Plays many headless games at once, each with its own dungeon and its *
+ * own seed, and reports how fast they went.  Game n is seeded with     *
+ * seed_base + n, and plays out exactly as "rlg327 --headless --rand"   *
+ * would with that seed, no matter how many threads share the work.     */
+
+#define BATCH_DEFAULT_GAMES   100
+#define BATCH_DEFAULT_SEED    327U
+
+typedef struct batch_stats {
+  uint64_t games;
+  uint64_t turns;
+  uint64_t deaths;
+  uint64_t boss_kills;
+  uint64_t turn_limits;
+  uint64_t gen_ns;
+  uint64_t play_ns;
+  event_stats_t events;
+} batch_stats_t;
+
+typedef struct batch {
+  /* Descriptions are parsed once and copied into each game, since the *
+   * copies also count births and deaths of unique monsters.           */
+  dungeon_t descriptions;
+  uint32_t games;
+  uint32_t seed_base;
+  uint32_t max_turns;
+  uint32_t width, height;
+  std::atomic<uint32_t> next_game;
+} batch_t;
+
+static uint64_t batch_elapsed(struct timespec *start, struct timespec *end)
+{
+  return ((end->tv_sec - start->tv_sec) * 1000000000ULL +
+          end->tv_nsec - start->tv_nsec);
+}
+
+static void batch_play(batch_t *b, uint32_t seed, batch_stats_t *s)
+{
+  struct timespec start, generated, end;
+  dungeon_t *d;
+  uint32_t turns;
+
+  d = new dungeon();
+  d->headless = 1;
+  d->max_monsters = MAX_MONSTERS;
+  d->max_objects = MAX_OBJECTS;
+  d->width = b->width;
+  d->height = b->height;
+  d->monster_descriptions = b->descriptions.monster_descriptions;
+  d->object_descriptions = b->descriptions.object_descriptions;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  seed_dungeon(d, seed);
+  init_dungeon(d);
+  gen_dungeon(d);
+  config_pc(d);
+  gen_monsters(d);
+  gen_objects(d);
+  pc_observe_terrain(d->PC, d);
+  clock_gettime(CLOCK_MONOTONIC, &generated);
+
+  for (turns = 0;
+       (pc_is_alive(d) && boss_is_alive(d) && !d->quit &&
+        (!b->max_turns || turns < b->max_turns));
+       turns++) {
+    do_moves(d);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  s->games++;
+  s->turns += turns;
+  if (!pc_is_alive(d)) {
+    s->deaths++;
+  } else if (!boss_is_alive(d)) {
+    s->boss_kills++;
+  } else {
+    s->turn_limits++;
+  }
+  s->gen_ns += batch_elapsed(&start, &generated);
+  s->play_ns += batch_elapsed(&generated, &end);
+  s->events.scheduled += d->events.get_stats().scheduled;
+  s->events.dispatched += d->events.get_stats().dispatched;
+  s->events.cancelled += d->events.get_stats().cancelled;
+
+  /* As in rlg327.cpp, a dead PC is freed along with the event queue. */
+  if (pc_is_alive(d)) {
+    character_delete(d->PC);
+  }
+  level_store_delete(d);
+  delete_dungeon(d);
+  destroy_descriptions(d);
+  delete d;
+}
+
+static void batch_worker(batch_t *b, batch_stats_t *s)
+{
+  uint32_t game;
+
+  while ((game = b->next_game++) < b->games) {
+    batch_play(b, b->seed_base + game, s);
+  }
+}
+
+static void usage(char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [-g|--games <count>] [-t|--threads <count>]\n"
+          "          [-s|--seed-base <seed>] [--turns <count>]\n"
+          "          [--size <width>x<height>]\n",
+          name);
+
+  exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<std::thread> workers;
+  std::vector<batch_stats_t> stats;
+  struct timespec start, end;
+  batch_stats_t total;
+  uint32_t threads, i;
+  double wall, busy;
+  batch_t b;
+
+  b.games = BATCH_DEFAULT_GAMES;
+  b.seed_base = BATCH_DEFAULT_SEED;
+  b.max_turns = 0;
+  b.width = DUNGEON_X;
+  b.height = DUNGEON_Y;
+  b.next_game = 0;
+  threads = std::thread::hardware_concurrency();
+
+  for (i = 1; i < (uint32_t) argc; i++) {
+    if ((!strcmp(argv[i], "-g") || !strcmp(argv[i], "--games")) &&
+        i + 1 < (uint32_t) argc &&
+        sscanf(argv[++i], "%u", &b.games) == 1) {
+    } else if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--threads")) &&
+               i + 1 < (uint32_t) argc &&
+               sscanf(argv[++i], "%u", &threads) == 1) {
+    } else if ((!strcmp(argv[i], "-s") || !strcmp(argv[i], "--seed-base")) &&
+               i + 1 < (uint32_t) argc &&
+               sscanf(argv[++i], "%u", &b.seed_base) == 1) {
+    } else if (!strcmp(argv[i], "--turns") && i + 1 < (uint32_t) argc &&
+               sscanf(argv[++i], "%u", &b.max_turns) == 1) {
+    } else if (!strcmp(argv[i], "--size") && i + 1 < (uint32_t) argc &&
+               sscanf(argv[++i], "%ux%u", &b.width, &b.height) == 2 &&
+               b.width >= MIN_DUNGEON_X && b.width <= MAX_DUNGEON_X &&
+               b.height >= MIN_DUNGEON_Y && b.height <= MAX_DUNGEON_Y) {
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (!threads) {
+    threads = 1;
+  }
+  if (threads > b.games) {
+    threads = b.games ? b.games : 1;
+  }
+
+  io_init_headless();
+  b.descriptions = dungeon_t();
+  parse_descriptions(&b.descriptions);
+
+  stats.resize(threads, batch_stats_t());
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < threads; i++) {
+    workers.push_back(std::thread(batch_worker, &b, &stats[i]));
+  }
+  for (i = 0; i < threads; i++) {
+    workers[i].join();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  total = batch_stats_t();
+  for (i = 0; i < threads; i++) {
+    total.games += stats[i].games;
+    total.turns += stats[i].turns;
+    total.deaths += stats[i].deaths;
+    total.boss_kills += stats[i].boss_kills;
+    total.turn_limits += stats[i].turn_limits;
+    total.gen_ns += stats[i].gen_ns;
+    total.play_ns += stats[i].play_ns;
+    total.events.scheduled += stats[i].events.scheduled;
+    total.events.dispatched += stats[i].events.dispatched;
+    total.events.cancelled += stats[i].events.cancelled;
+  }
+
+  /* Per core rates count only the time each thread spent playing, so *
+   * they stay comparable as the thread count changes.                */
+  wall = batch_elapsed(&start, &end) / 1000000000.0;
+  busy = total.play_ns / 1000000000.0;
+  printf("Games: %lu on %u threads (seeds %u to %u)\n"
+         "Turns: %lu in %.3f seconds (%.0f turns/sec, "
+         "%.0f turns/sec per core)\n"
+         "Generation: %.3f ms per game\n"
+         "Events: %lu scheduled, %lu dispatched, "
+         "%lu cancelled at death\n"
+         "Deaths: %lu\n"
+         "Boss kills: %lu\n"
+         "Turn limits reached: %lu\n",
+         total.games, threads, b.seed_base, b.seed_base + b.games - 1,
+         total.turns, wall, wall > 0 ? total.turns / wall : 0.0,
+         busy > 0 ? total.turns / busy : 0.0,
+         total.games ? total.gen_ns / 1000000.0 / total.games : 0.0,
+         total.events.scheduled, total.events.dispatched,
+         total.events.cancelled,
+         total.deaths, total.boss_kills, total.turn_limits);
+
+  destroy_descriptions(&b.descriptions);
+
+  return 0;
+}
@@ -0,0 +1,1114 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <ncurses.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+
+/* Allocation counting.  Interposing the allocator here catches every     *
+ * allocation in the process, including those made by libstdc++ on behalf *
+ * of operator new.  This has to come before the project headers, because *
+ * macros.h redefines malloc() and friends.                               */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static uint64_t alloc_count;
+
+extern "C" void *malloc(size_t size) noexcept
+{
+  alloc_count++;
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size) noexcept
+{
+  alloc_count++;
+  return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) noexcept
+{
+  alloc_count++;
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) noexcept
+{
+  __libc_free(ptr);
+}
+
+#include "dungeon.h"
+#include "heap.h"
+#include "dary_heap.h"
+#include "path.h"
+#include "pc.h"
+#include "npc.h"
+#include "dice.h"
+#include "io.h"
+#include "wavefront.h"
+#include "event.h"
+#include "save.h"
+
+#define BENCH_DEFAULT_SAMPLES 100
+#define BENCH_SEED            327U
+#define HEAP_BENCH_SIZE       1024
+#define EVENT_BENCH_SIZE      256
+#define EVENT_BENCH_OPS       4096
+/* Far more descriptions than we ship, as in the big content packs. *
+ * Parsing them is slow enough that a few samples will do.          */
+#define DESCRIPTION_BENCH_SIZE    100000
+#define DESCRIPTION_BENCH_SAMPLES 5
+
+typedef struct bench {
+  std::string name;
+  uint32_t ops;              /* Operations per timed sample */
+  std::vector<double> ns;    /* ns/op of each sample        */
+  uint64_t allocs;
+  uint64_t start_allocs;
+  struct timespec start;
+} bench_t;
+
+static uint32_t num_samples = BENCH_DEFAULT_SAMPLES;
+static const char *corpus_dir = "test_dungeon_files";
+static std::vector<dungeon *> corpus;
+static std::vector<std::string> corpus_files;
+
+static void bench_start(bench_t *b)
+{
+  b->start_allocs = alloc_count;
+  clock_gettime(CLOCK_MONOTONIC, &b->start);
+}
+
+static void bench_stop(bench_t *b)
+{
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  b->allocs += alloc_count - b->start_allocs;
+  b->ns.push_back(((end.tv_sec - b->start.tv_sec) * 1000000000.0 +
+                   (end.tv_nsec - b->start.tv_nsec)) / b->ops);
+}
+
+/* A generated level with the PC placed, and nothing else.  Monsters are *
+ * created by the individual benchmarks that need them, so we don't      *
+ * depend on the description files being installed.                      */
+static void bench_dungeon(dungeon *d, uint32_t seed)
+{
+  *d = dungeon_t();
+  d->headless = 1;
+  d->max_monsters = MAX_MONSTERS;
+  d->max_objects = MAX_OBJECTS;
+  seed_dungeon(d, seed);
+  init_dungeon(d);
+  gen_dungeon(d);
+  config_pc(d);
+}
+
+static void bench_dungeon_delete(dungeon *d)
+{
+  character_delete(d->PC);
+  delete_dungeon(d);
+}
+
+static void bench_dijkstra(bench_t *b, dungeon *d)
+{
+  uint32_t i;
+
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    dijkstra(d);
+    bench_stop(b);
+  }
+}
+
+static void bench_dijkstra_tunnel(bench_t *b, dungeon *d)
+{
+  uint32_t i;
+
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    dijkstra_tunnel(d);
+    bench_stop(b);
+  }
+}
+
+/* The saved dungeons in corpus_dir, each with the PC standing in the *
+ * corner of its first room.                                          */
+static void load_corpus(void)
+{
+  std::vector<std::string> files;
+  std::string path;
+  struct dirent *de;
+  uint32_t i;
+  dungeon *d;
+  DIR *dir;
+
+  if (!(dir = opendir(corpus_dir))) {
+    perror(corpus_dir);
+    return;
+  }
+  while ((de = readdir(dir))) {
+    if (strstr(de->d_name, ".rlg327")) {
+      files.push_back(de->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+
+  for (i = 0; i < files.size(); i++) {
+    path = std::string(corpus_dir) + "/" + files[i];
+    corpus_files.push_back(path);
+    d = new dungeon();
+    d->headless = 1;
+    seed_dungeon(d, BENCH_SEED);
+    init_dungeon(d);
+    read_dungeon(d, (char *) path.c_str());
+    d->PC = new pc;
+    d->PC->position[dim_y] = d->rooms->position[dim_y];
+    d->PC->position[dim_x] = d->rooms->position[dim_x];
+    corpus.push_back(d);
+  }
+}
+
+static void bench_corpus(bench_t *b, void (*func)(dungeon *d))
+{
+  uint32_t i, j;
+
+  if (corpus.empty()) {
+    return;
+  }
+
+  b->ops = corpus.size();
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    for (j = 0; j < corpus.size(); j++) {
+      func(corpus[j]);
+    }
+    bench_stop(b);
+  }
+}
+
+/* Just the loading of the corpus files, into one dungeon. */
+static void bench_read_dungeon_corpus(bench_t *b, dungeon *d)
+{
+  dungeon_t g;
+  uint32_t i, j;
+
+  if (corpus_files.empty()) {
+    return;
+  }
+
+  g = dungeon_t();
+  seed_dungeon(&g, BENCH_SEED);
+  init_dungeon(&g);
+  b->ops = corpus_files.size();
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    for (j = 0; j < corpus_files.size(); j++) {
+      read_dungeon(&g, (char *) corpus_files[j].c_str());
+      free(g.rooms);
+    }
+    bench_stop(b);
+  }
+  g.rooms = NULL;
+  delete_dungeon(&g);
+}
+
+static void bench_dijkstra_corpus(bench_t *b, dungeon *d)
+{
+  bench_corpus(b, dijkstra);
+}
+
+static void bench_dijkstra_tunnel_corpus(bench_t *b, dungeon *d)
+{
+  bench_corpus(b, dijkstra_tunnel);
+}
+
+/* Checks wavefront_distance() against dijkstra() on every corpus level, *
+ * from a spread of PC positions, before timing it over the corpus.      */
+static void bench_wavefront(bench_t *b, const char *kernel)
+{
+  path_distance_t expected[DUNGEON_Y][DUNGEON_X];
+  pair_t start;
+  uint32_t i, j, x, y;
+  wavefront_t w;
+  dungeon *d;
+
+  wavefront_init(&w);
+  if (corpus.empty() || wavefront_select(&w, kernel)) {
+    return;
+  }
+
+  for (i = 0; i < corpus.size(); i++) {
+    d = corpus[i];
+    start[dim_y] = d->PC->position[dim_y];
+    start[dim_x] = d->PC->position[dim_x];
+    for (y = 1; y < DUNGEON_Y - 1; y++) {
+      for (x = 1 + (y % 7); x < DUNGEON_X - 1; x += 7) {
+        d->PC->position[dim_y] = y;
+        d->PC->position[dim_x] = x;
+        dijkstra(d);
+        memcpy(expected, d->pc_distance.data(), sizeof (expected));
+        wavefront_distance(&w, d);
+        if (memcmp(expected, d->pc_distance.data(), sizeof (expected))) {
+          fprintf(stderr, "%s wavefront differs from dijkstra() on corpus "
+                  "level %u with the PC at (%u, %u).\n", kernel, i, x, y);
+          exit(-1);
+        }
+      }
+    }
+    d->PC->position[dim_y] = start[dim_y];
+    d->PC->position[dim_x] = start[dim_x];
+  }
+
+  /* As bench_corpus(), with the wavefront passed along. */
+  b->ops = corpus.size();
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    for (j = 0; j < corpus.size(); j++) {
+      wavefront_distance(&w, corpus[j]);
+    }
+    bench_stop(b);
+  }
+  wavefront_delete(&w);
+}
+
+/* Head to head on dijkstra_tunnel()'s workload: a textbook Dijkstra    *
+ * over the corpus, once on heap.c's Fibonacci heap (pooled, so it does *
+ * no allocation either), and once on dary_heap at a few arities.  Both *
+ * queue cells as they're first reached, and both are checked against   *
+ * dijkstra_tunnel() before they're timed.                              */
+static uint32_t tunnel_cost[DUNGEON_Y * DUNGEON_X];
+
+static const int32_t tunnel_neighbor[8] = {
+  -DUNGEON_X - 1, -DUNGEON_X, -DUNGEON_X + 1,
+  -1,                                      1,
+   DUNGEON_X - 1,  DUNGEON_X,  DUNGEON_X + 1
+};
+
+#define tunnel_step(d, c) ((d)->hardness.data()[c] / HARDNESS_PER_TURN + 1)
+
+static int32_t tunnel_cost_cmp(const void *key, const void *with)
+{
+  return *(const uint32_t *) key - *(const uint32_t *) with;
+}
+
+static void tunnel_fibonacci(dungeon *d)
+{
+  static heap_node_t nodes[DUNGEON_Y * DUNGEON_X];
+  static heap_node_t *hn[DUNGEON_Y * DUNGEON_X];
+  terrain_type_t *map;
+  heap_pool_t pool;
+  uint32_t c, n, i, next, *p;
+  heap_t h;
+
+  map = d->map.data();
+  memset(tunnel_cost, 255, sizeof (tunnel_cost));
+  memset(hn, 0, sizeof (hn));
+  heap_pool_init(&pool, nodes, DUNGEON_Y * DUNGEON_X);
+  heap_init_pool(&h, tunnel_cost_cmp, NULL, &pool);
+
+  c = d->PC->position[dim_y] * DUNGEON_X + d->PC->position[dim_x];
+  tunnel_cost[c] = 0;
+  hn[c] = heap_insert(&h, tunnel_cost + c);
+
+  while ((p = (uint32_t *) heap_remove_min(&h))) {
+    c = p - tunnel_cost;
+    hn[c] = NULL;
+    next = tunnel_cost[c] + tunnel_step(d, c);
+    for (i = 0; i < 8; i++) {
+      n = c + tunnel_neighbor[i];
+      if (map[n] != ter_wall_immutable && tunnel_cost[n] > next) {
+        tunnel_cost[n] = next;
+        if (hn[n]) {
+          heap_decrease_key_no_replace(&h, hn[n]);
+        } else {
+          hn[n] = heap_insert(&h, tunnel_cost + n);
+        }
+      }
+    }
+  }
+  heap_delete(&h);
+}
+
+struct tunnel_cost_compare {
+  const uint32_t *cost;
+  inline bool operator()(uint32_t c1, uint32_t c2) const
+  {
+    return cost[c1] < cost[c2];
+  }
+};
+
+template <uint32_t Arity>
+static void tunnel_dary(dungeon *d)
+{
+  typedef dary_heap<uint32_t, tunnel_cost_compare, Arity> tunnel_heap_t;
+  static tunnel_heap_t h(tunnel_cost_compare{tunnel_cost});
+  static uint32_t handle[DUNGEON_Y * DUNGEON_X];
+  terrain_type_t *map;
+  uint32_t c, n, i, next;
+
+  map = d->map.data();
+  memset(tunnel_cost, 255, sizeof (tunnel_cost));
+  memset(handle, 255, sizeof (handle));
+  h.clear();
+
+  c = d->PC->position[dim_y] * DUNGEON_X + d->PC->position[dim_x];
+  tunnel_cost[c] = 0;
+  handle[c] = h.push(c);
+
+  while (!h.empty()) {
+    c = h.pop();
+    handle[c] = tunnel_heap_t::none;
+    next = tunnel_cost[c] + tunnel_step(d, c);
+    for (i = 0; i < 8; i++) {
+      n = c + tunnel_neighbor[i];
+      if (map[n] != ter_wall_immutable && tunnel_cost[n] > next) {
+        tunnel_cost[n] = next;
+        if (handle[n] != tunnel_heap_t::none) {
+          h.decrease_key(handle[n]);
+        } else {
+          handle[n] = h.push(n);
+        }
+      }
+    }
+  }
+}
+
+static void bench_tunnel_heap(bench_t *b, void (*func)(dungeon *d))
+{
+  uint32_t i, c;
+  dungeon *d;
+
+  for (i = 0; i < corpus.size(); i++) {
+    d = corpus[i];
+    dijkstra_tunnel(d);
+    func(d);
+    for (c = 0; c < DUNGEON_Y * DUNGEON_X; c++) {
+      if (std::min<uint32_t>(tunnel_cost[c], PATH_UNREACHED) !=
+          d->pc_tunnel.data()[c]) {
+        fprintf(stderr, "%s differs from dijkstra_tunnel() on corpus "
+                "level %u at (%u, %u).\n", b->name.c_str(), i,
+                c % DUNGEON_X, c / DUNGEON_X);
+        exit(-1);
+      }
+    }
+  }
+
+  bench_corpus(b, func);
+}
+
+static void bench_tunnel_fibonacci(bench_t *b, dungeon *d)
+{
+  bench_tunnel_heap(b, tunnel_fibonacci);
+}
+
+static void bench_tunnel_dary2(bench_t *b, dungeon *d)
+{
+  bench_tunnel_heap(b, tunnel_dary<2>);
+}
+
+static void bench_tunnel_dary4(bench_t *b, dungeon *d)
+{
+  bench_tunnel_heap(b, tunnel_dary<4>);
+}
+
+static void bench_tunnel_dary8(bench_t *b, dungeon *d)
+{
+  bench_tunnel_heap(b, tunnel_dary<8>);
+}
+
+static void bench_wavefront_scalar(bench_t *b, dungeon *d)
+{
+  bench_wavefront(b, "scalar");
+}
+
+static void bench_wavefront_avx2(bench_t *b, dungeon *d)
+{
+  bench_wavefront(b, "avx2");
+}
+
+static void bench_gen_dungeon(bench_t *b, dungeon *d)
+{
+  dungeon_t g;
+  uint32_t i;
+
+  g = dungeon_t();
+  seed_dungeon(&g, BENCH_SEED);
+  init_dungeon(&g);
+  for (i = 0; i < num_samples; i++) {
+    seed_dungeon(&g, BENCH_SEED + i);
+    bench_start(b);
+    gen_dungeon(&g);
+    bench_stop(b);
+    free(g.rooms);
+  }
+  g.rooms = NULL;
+  delete_dungeon(&g);
+}
+
+static void bench_can_see(bench_t *b, dungeon *d)
+{
+  uint32_t i, j;
+  pair_t where;
+
+  b->ops = 1024;
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    for (j = 0; j < b->ops; j++) {
+      where[dim_y] = d->PC->position[dim_y] + (j % 7) - 3;
+      where[dim_x] = d->PC->position[dim_x] + ((j / 7) % 7) - 3;
+      if (where[dim_y] < 0 || where[dim_y] >= d->height ||
+          where[dim_x] < 0 || where[dim_x] >= d->width) {
+        where[dim_y] = d->PC->position[dim_y];
+        where[dim_x] = d->PC->position[dim_x];
+      }
+      can_see(d, d->PC->position, where, 0, 0);
+    }
+    bench_stop(b);
+  }
+}
+
+static void bench_pc_observe_terrain(bench_t *b, dungeon *d)
+{
+  uint32_t i, j;
+
+  b->ops = 64;
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    for (j = 0; j < b->ops; j++) {
+      pc_observe_terrain(d->PC, d);
+    }
+    bench_stop(b);
+  }
+}
+
+/* A checkpoint of the bench dungeon, written to and read back from a *
+ * scratch file.  Loading includes sizing the maps it's read into.    */
+static std::string bench_save_file(void)
+{
+  char path[] = "/tmp/rlg327-bench.XXXXXX";
+  int fd;
+
+  if ((fd = mkstemp(path)) < 0) {
+    perror(path);
+    return "";
+  }
+  close(fd);
+
+  return path;
+}
+
+static void bench_write_game(bench_t *b, dungeon *d)
+{
+  std::string path;
+  uint32_t i;
+
+  if ((path = bench_save_file()).empty()) {
+    return;
+  }
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    write_game(d, path.c_str());
+    bench_stop(b);
+  }
+  unlink(path.c_str());
+}
+
+static void bench_read_game(bench_t *b, dungeon *d)
+{
+  std::string path;
+  dungeon_t g;
+  uint32_t i;
+
+  if ((path = bench_save_file()).empty() || write_game(d, path.c_str())) {
+    return;
+  }
+  for (i = 0; i < num_samples; i++) {
+    g = dungeon_t();
+    g.headless = 1;
+    g.width = d->width;
+    g.height = d->height;
+    seed_dungeon(&g, BENCH_SEED);
+    bench_start(b);
+    init_dungeon(&g);
+    read_dungeon(&g, (char *) path.c_str());
+    bench_stop(b);
+    bench_dungeon_delete(&g);
+  }
+  unlink(path.c_str());
+}
+
+static void bench_write_descriptions(const std::string &monsters,
+                                     const std::string &objects)
+{
+  static const char *colors[] = { "RED", "GREEN", "BLUE", "CYAN",
+                                  "YELLOW", "MAGENTA", "WHITE", "BLACK" };
+  static const char *types[] = { "WEAPON", "ARMOR", "RING", "POTION",
+                                 "SCROLL", "WAND", "FOOD", "LIGHT" };
+  FILE *m, *o;
+  uint32_t i;
+
+  if (!(m = fopen(monsters.c_str(), "w")) ||
+      !(o = fopen(objects.c_str(), "w"))) {
+    perror("description file");
+    exit(-1);
+  }
+  fprintf(m, "RLG327 MONSTER DESCRIPTION 1\n");
+  fprintf(o, "RLG327 OBJECT DESCRIPTION 1\n");
+  for (i = 0; i < DESCRIPTION_BENCH_SIZE; i++) {
+    fprintf(m,
+            "\nBEGIN MONSTER\n"
+            "NAME Generated Monster %u\n"
+            "SYMB %c\n"
+            "COLOR %s %s\n"
+            "DESC\n"
+            "Monster %u was made for the benchmark.  It has a description of\n"
+            "a few lines, about as long as the ones that ship with the game.\n"
+            ".\n"
+            "SPEED %u+1d4\n"
+            "DAM %u+1d%u\n"
+            "HP %u+2d6\n"
+            "ABIL SMART%s\n"
+            "RRTY %u\n"
+            "END\n",
+            i, 'a' + i % 26, colors[i % 8], colors[(i / 8) % 8], i,
+            5 + i % 10, i % 5, 4 + i % 8, 10 + i % 90,
+            i % 3 ? "" : " TUNNEL ERRATIC", 1 + i % 100);
+    fprintf(o,
+            "\nBEGIN OBJECT\n"
+            "NAME a generated object %u\n"
+            "TYPE %s\n"
+            "COLOR %s\n"
+            "WEIGHT %u+1d2\n"
+            "HIT 0+0d1\n"
+            "DAM %u+1d%u\n"
+            "ATTR 0+0d1\n"
+            "VAL %u+1d6\n"
+            "DODGE 0+0d1\n"
+            "DEF %u+0d1\n"
+            "SPEED 0+0d1\n"
+            "DESC\n"
+            "Object %u was made for the benchmark.  It has a description of\n"
+            "a few lines, about as long as the ones that ship with the game.\n"
+            ".\n"
+            "RRTY %u\n"
+            "ART %s\n"
+            "END\n",
+            i, types[i % 8], colors[(i / 8) % 8], 1 + i % 20, i % 5,
+            4 + i % 8, 10 * (i % 50), i % 7, i, 1 + i % 100,
+            i % 1000 ? "FALSE" : "TRUE");
+  }
+  fclose(m);
+  fclose(o);
+}
+
+static void bench_parse_descriptions(bench_t *b, dungeon *d)
+{
+  std::string monsters, objects;
+  dungeon_t g;
+  uint32_t i;
+
+  if ((monsters = bench_save_file()).empty() ||
+      (objects = bench_save_file()).empty()) {
+    return;
+  }
+  bench_write_descriptions(monsters, objects);
+  b->ops = 2 * DESCRIPTION_BENCH_SIZE;
+  for (i = 0; i < num_samples && i < DESCRIPTION_BENCH_SAMPLES; i++) {
+    g = dungeon_t();
+    bench_start(b);
+    parse_description_files(&g, monsters.c_str(), objects.c_str());
+    bench_stop(b);
+    if (g.monster_descriptions.size() != DESCRIPTION_BENCH_SIZE ||
+        g.object_descriptions.size() != DESCRIPTION_BENCH_SIZE) {
+      fprintf(stderr, "Parsed %zu monsters and %zu objects of %u each.\n",
+              g.monster_descriptions.size(), g.object_descriptions.size(),
+              DESCRIPTION_BENCH_SIZE);
+    }
+    destroy_descriptions(&g);
+  }
+  unlink(monsters.c_str());
+  unlink(objects.c_str());
+}
+
+static int32_t int_cmp(const void *key, const void *with)
+{
+  return *(const int32_t *) key - *(const int32_t *) with;
+}
+
+/* With a pool, insert and remove_min measure the heap alone; without *
+ * one, they include a malloc() or a free() per node.                 */
+static heap_pool_t *bench_heap_pool(uint32_t pooled)
+{
+  static heap_node_t nodes[HEAP_BENCH_SIZE];
+  static heap_pool_t pool;
+
+  if (!pooled) {
+    return NULL;
+  }
+  heap_pool_init(&pool, nodes, HEAP_BENCH_SIZE);
+
+  return &pool;
+}
+
+static void bench_heap_insert_with(bench_t *b, uint32_t pooled)
+{
+  static int32_t keys[HEAP_BENCH_SIZE];
+  uint32_t i, j;
+  heap_t h;
+
+  b->ops = HEAP_BENCH_SIZE;
+  srand(BENCH_SEED);
+  for (j = 0; j < HEAP_BENCH_SIZE; j++) {
+    keys[j] = rand();
+  }
+  for (i = 0; i < num_samples; i++) {
+    heap_init_pool(&h, int_cmp, NULL, bench_heap_pool(pooled));
+    bench_start(b);
+    for (j = 0; j < HEAP_BENCH_SIZE; j++) {
+      heap_insert(&h, keys + j);
+    }
+    bench_stop(b);
+    heap_delete(&h);
+  }
+}
+
+static void bench_heap_insert(bench_t *b, dungeon *d)
+{
+  bench_heap_insert_with(b, 0);
+}
+
+static void bench_heap_insert_pooled(bench_t *b, dungeon *d)
+{
+  bench_heap_insert_with(b, 1);
+}
+
+static void bench_heap_remove_min_with(bench_t *b, uint32_t pooled)
+{
+  static int32_t keys[HEAP_BENCH_SIZE];
+  uint32_t i, j;
+  heap_t h;
+
+  b->ops = HEAP_BENCH_SIZE;
+  srand(BENCH_SEED);
+  for (j = 0; j < HEAP_BENCH_SIZE; j++) {
+    keys[j] = rand();
+  }
+  for (i = 0; i < num_samples; i++) {
+    heap_init_pool(&h, int_cmp, NULL, bench_heap_pool(pooled));
+    for (j = 0; j < HEAP_BENCH_SIZE; j++) {
+      heap_insert(&h, keys + j);
+    }
+    bench_start(b);
+    for (j = 0; j < HEAP_BENCH_SIZE; j++) {
+      heap_remove_min(&h);
+    }
+    bench_stop(b);
+    heap_delete(&h);
+  }
+}
+
+static void bench_heap_remove_min(bench_t *b, dungeon *d)
+{
+  bench_heap_remove_min_with(b, 0);
+}
+
+static void bench_heap_remove_min_pooled(bench_t *b, dungeon *d)
+{
+  bench_heap_remove_min_with(b, 1);
+}
+
+static void bench_heap_decrease_key(bench_t *b, dungeon *d)
+{
+  static int32_t keys[HEAP_BENCH_SIZE + 1];
+  static heap_node_t *nodes[HEAP_BENCH_SIZE + 1];
+  uint32_t i, j;
+  int32_t *min;
+  heap_t h;
+
+  b->ops = HEAP_BENCH_SIZE;
+  for (i = 0; i < num_samples; i++) {
+    srand(BENCH_SEED);
+    heap_init(&h, int_cmp, NULL);
+    for (j = 0; j <= HEAP_BENCH_SIZE; j++) {
+      keys[j] = rand();
+      nodes[j] = heap_insert(&h, keys + j);
+    }
+    /* Consolidate into trees, otherwise there's nothing to cut. */
+    min = (int32_t *) heap_remove_min(&h);
+    bench_start(b);
+    for (j = 0; j <= HEAP_BENCH_SIZE; j++) {
+      if (keys + j != min) {
+        keys[j] -= rand() % 1024;
+        heap_decrease_key_no_replace(&h, nodes[j]);
+      }
+    }
+    bench_stop(b);
+    heap_delete(&h);
+  }
+}
+
+static void bench_dice_roll(bench_t *b, dungeon *d)
+{
+  dice dc(10, 3, 6);
+  uint32_t i, j;
+  int32_t sum;
+  rng_t rng;
+
+  b->ops = 4096;
+  rng_seed(&rng, BENCH_SEED, 0);
+  for (sum = i = 0; i < num_samples; i++) {
+    bench_start(b);
+    for (j = 0; j < b->ops; j++) {
+      sum += dc.roll(&rng);
+    }
+    bench_stop(b);
+  }
+  if (!sum) {
+    fprintf(stderr, "Dice aren't rolling.\n");
+  }
+}
+
+/* The event queue under do_moves()'s load: take the next turn, and     *
+ * schedule that character's next one 1000 / speed later.  The calendar *
+ * queue is raced against the dary_heap that it replaced, after a check *
+ * that both hand out turns in the same order.                          */
+struct bench_event_compare {
+  inline bool operator()(const event_t *e1, const event_t *e2) const
+  {
+    return (e1->time != e2->time ? e1->time < e2->time :
+                                   e1->sequence < e2->sequence);
+  }
+};
+
+typedef dary_heap<event_t *, bench_event_compare> bench_event_heap_t;
+
+static event_t bench_events[EVENT_BENCH_SIZE];
+static uint32_t bench_event_speed[EVENT_BENCH_SIZE];
+static uint32_t bench_event_sequence;
+
+template <typename Queue>
+static void bench_event_fill(Queue &q)
+{
+  uint32_t i;
+  rng_t rng;
+
+  q.clear();
+  rng_seed(&rng, BENCH_SEED, 0);
+  for (bench_event_sequence = i = 0; i < EVENT_BENCH_SIZE; i++) {
+    bench_events[i].type = event_character_turn;
+    bench_events[i].time = 0;
+    bench_events[i].sequence = ++bench_event_sequence;
+    bench_event_speed[i] = rand_range(&rng, 5, 20);
+    q.push(bench_events + i);
+  }
+}
+
+template <typename Queue>
+static uint64_t bench_event_run(Queue &q)
+{
+  uint64_t order;
+  event_t *e;
+  uint32_t i;
+
+  for (order = i = 0; i < EVENT_BENCH_OPS; i++) {
+    e = q.pop();
+    order = order * 31 + (e - bench_events);
+    e->time += 1000 / bench_event_speed[e - bench_events];
+    e->sequence = ++bench_event_sequence;
+    q.push(e);
+  }
+
+  return order;
+}
+
+template <typename Queue>
+static void bench_event(bench_t *b)
+{
+  static bench_event_heap_t heap;
+  static event_queue calendar;
+  static Queue q;
+  uint64_t expected;
+  uint32_t i;
+
+  bench_event_fill(heap);
+  expected = bench_event_run(heap);
+  bench_event_fill(calendar);
+  if (bench_event_run(calendar) != expected) {
+    fprintf(stderr, "The event queue and heap disagree on turn order.\n");
+    exit(-1);
+  }
+
+  b->ops = EVENT_BENCH_OPS;
+  for (i = 0; i < num_samples; i++) {
+    bench_event_fill(q);
+    bench_start(b);
+    bench_event_run(q);
+    bench_stop(b);
+  }
+}
+
+static void bench_event_calendar(bench_t *b, dungeon *d)
+{
+  bench_event<event_queue>(b);
+}
+
+static void bench_event_dary_heap(bench_t *b, dungeon *d)
+{
+  bench_event<bench_event_heap_t>(b);
+}
+
+static void bench_io_display(bench_t *b, dungeon *d)
+{
+  uint32_t i;
+
+  for (i = 0; i < num_samples; i++) {
+    bench_start(b);
+    io_display(d);
+    bench_stop(b);
+  }
+}
+
+/* Runs npc_move_func[func] on a single monster that is returned to its *
+ * starting point before every move.  Tunnelers change the map, so that *
+ * and the distance maps are restored before each sample.               */
+static void bench_npc_move(bench_t *b, dungeon *d, uint32_t func)
+{
+  grid<terrain_type_t> map;
+  grid<uint8_t> hardness;
+  monster_description md;
+  std::vector<uint32_t> color(1, 0);
+  pair_t start, next;
+  uint32_t i, j;
+  npc *n;
+
+  md.set("bench monster", "", 'b', color, dice(10, 0, 1), func,
+         dice(100, 0, 1), dice(0, 1, 4), 100);
+
+  map.copy(d->map);
+  hardness.copy(d->hardness);
+
+  seed_dungeon(d, BENCH_SEED + func);
+  n = new npc(d, md);
+  start[dim_y] = n->position[dim_y];
+  start[dim_x] = n->position[dim_x];
+
+  b->ops = 16;
+  for (i = 0; i < num_samples; i++) {
+    d->map.copy(map);
+    d->hardness.copy(hardness);
+    dijkstra(d);
+    dijkstra_tunnel(d);
+    bench_start(b);
+    for (j = 0; j < b->ops; j++) {
+      next[dim_y] = start[dim_y];
+      next[dim_x] = start[dim_x];
+      npc_move_func[func](d, n, next);
+    }
+    bench_stop(b);
+  }
+
+  d->map.copy(map);
+  d->hardness.copy(hardness);
+  dijkstra(d);
+  dijkstra_tunnel(d);
+  charpair(n->position) = NULL;
+  d->census[func]--;
+  delete n;
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+  return sorted[(size_t) (p * (sorted.size() - 1))];
+}
+
+/* One benchmark per line, so that a saved baseline can be read back with *
+ * nothing fancier than sscanf().                                         */
+static void bench_report(bench_t *b, std::map<std::string, double> &baseline,
+                         uint32_t first)
+{
+  std::vector<double> sorted(b->ns);
+  std::map<std::string, double>::iterator base;
+  double mean;
+  uint32_t i;
+
+  std::sort(sorted.begin(), sorted.end());
+  for (mean = i = 0; i < sorted.size(); i++) {
+    mean += sorted[i];
+  }
+  mean /= sorted.size();
+
+  printf("%s    {\"name\": \"%s\", \"samples\": %zu, \"ops_per_sample\": %u, "
+         "\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, "
+         "\"min_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, "
+         "\"p99_ns\": %.1f, \"max_ns\": %.1f",
+         first ? "" : ",\n", b->name.c_str(), sorted.size(), b->ops, mean,
+         ((double) b->allocs) / (sorted.size() * b->ops), sorted.front(),
+         percentile(sorted, 0.5), percentile(sorted, 0.9),
+         percentile(sorted, 0.99), sorted.back());
+
+  if ((base = baseline.find(b->name)) != baseline.end()) {
+    printf(", \"baseline_ns_per_op\": %.1f, \"speedup\": %.3f",
+           base->second, base->second / mean);
+    fprintf(stderr, "%-40s %12.1f -> %12.1f ns/op  %7.3fx\n",
+            b->name.c_str(), base->second, mean, base->second / mean);
+  }
+  printf("}");
+  fflush(stdout);
+}
+
+static int read_baseline(const char *file, std::map<std::string, double> &m)
+{
+  char line[1024], name[256];
+  const char *ns;
+  double v;
+  FILE *f;
+
+  if (!(f = fopen(file, "r"))) {
+    return 1;
+  }
+  while (fgets(line, sizeof (line), f)) {
+    if (sscanf(line, " {\"name\": \"%255[^\"]\"", name) == 1 &&
+        (ns = strstr(line, "\"ns_per_op\": ")) &&
+        sscanf(ns, "\"ns_per_op\": %lf", &v) == 1) {
+      m[name] = v;
+    }
+  }
+  fclose(f);
+
+  return 0;
+}
+
+typedef void (*bench_func_t)(bench_t *b, dungeon *d);
+
+static const struct {
+  const char *name;
+  bench_func_t func;
+} benchmarks[] = {
+  { "dijkstra",                     bench_dijkstra               },
+  { "dijkstra_tunnel",              bench_dijkstra_tunnel        },
+  { "read_dungeon_corpus",          bench_read_dungeon_corpus    },
+  { "dijkstra_corpus",              bench_dijkstra_corpus        },
+  { "dijkstra_tunnel_corpus",       bench_dijkstra_tunnel_corpus },
+  { "tunnel_corpus_fibonacci",      bench_tunnel_fibonacci       },
+  { "tunnel_corpus_dary2",          bench_tunnel_dary2           },
+  { "tunnel_corpus_dary4",          bench_tunnel_dary4           },
+  { "tunnel_corpus_dary8",          bench_tunnel_dary8           },
+  { "wavefront_corpus_scalar",      bench_wavefront_scalar       },
+  { "wavefront_corpus_avx2",        bench_wavefront_avx2         },
+  { "gen_dungeon",                  bench_gen_dungeon            },
+  { "can_see",                      bench_can_see                },
+  { "pc_observe_terrain",           bench_pc_observe_terrain     },
+  { "heap_insert",                  bench_heap_insert            },
+  { "heap_insert_pooled",           bench_heap_insert_pooled     },
+  { "heap_remove_min",              bench_heap_remove_min        },
+  { "heap_remove_min_pooled",       bench_heap_remove_min_pooled },
+  { "heap_decrease_key_no_replace", bench_heap_decrease_key      },
+  { "dice_roll",                    bench_dice_roll              },
+  { "event_queue_calendar",         bench_event_calendar         },
+  { "event_queue_dary_heap",        bench_event_dary_heap        },
+  { "io_display",                   bench_io_display             },
+  { "write_game",                   bench_write_game             },
+  { "read_game",                    bench_read_game              },
+  { "parse_descriptions",           bench_parse_descriptions     },
+  { 0,                              0                            }
+};
+
+static void usage(char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [-f|--filter <substring>] [-n|--samples <count>]\n"
+          "          [-c|--compare <baseline json>] [--corpus <directory>]\n",
+          name);
+
+  exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+  std::map<std::string, double> baseline;
+  const char *filter;
+  char name[32];
+  uint32_t first, i;
+  bench_t b;
+  dungeon_t d;
+
+  filter = "";
+  for (i = 1; i < (uint32_t) argc; i++) {
+    if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "--filter")) &&
+        i + 1 < (uint32_t) argc) {
+      filter = argv[++i];
+    } else if ((!strcmp(argv[i], "-n") || !strcmp(argv[i], "--samples")) &&
+               i + 1 < (uint32_t) argc &&
+               sscanf(argv[++i], "%u", &num_samples) == 1 && num_samples) {
+    } else if ((!strcmp(argv[i], "-c") || !strcmp(argv[i], "--compare")) &&
+               i + 1 < (uint32_t) argc) {
+      if (read_baseline(argv[++i], baseline)) {
+        perror(argv[i]);
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "--corpus") && i + 1 < (uint32_t) argc) {
+      corpus_dir = argv[++i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  io_init_headless();
+  if (io_init_offscreen()) {
+    fprintf(stderr, "Unable to create an offscreen terminal.\n");
+    return 1;
+  }
+
+  bench_dungeon(&d, BENCH_SEED);
+  load_corpus();
+
+  printf("{\n  \"seed\": %u,\n  \"benchmarks\": [\n", BENCH_SEED);
+  for (first = 1, i = 0; benchmarks[i].name; i++) {
+    if (!strstr(benchmarks[i].name, filter)) {
+      continue;
+    }
+    b = bench_t();
+    b.name = benchmarks[i].name;
+    b.ops = 1;
+    benchmarks[i].func(&b, &d);
+    if (b.ns.empty()) {
+      continue;
+    }
+    bench_report(&b, baseline, first);
+    first = 0;
+  }
+  for (i = 0; i < 32; i++) {
+    snprintf(name, sizeof (name), "npc_move_func_%02x", i);
+    if (!strstr(name, filter)) {
+      continue;
+    }
+    b = bench_t();
+    b.name = name;
+    b.ops = 1;
+    bench_npc_move(&b, &d, i);
+    bench_report(&b, baseline, first);
+    first = 0;
+  }
+  printf("\n  ]\n}\n");
+
+  endwin();
+  bench_dungeon_delete(&d);
+  for (i = 0; i < corpus.size(); i++) {
+    bench_dungeon_delete(corpus[i]);
+    delete corpus[i];
+  }
+
+  return 0;
+}
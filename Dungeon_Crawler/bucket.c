@@ -0,0 +1,117 @@
+#include "bucket.h"
+#include "macros.h"
+
+#define bucket_of(q, k) ((k) & (q)->mask)
+
+static void bucket_unlink(bucket_queue_t *q, uint32_t e)
+{
+  if (q->prev[e] == BUCKET_QUEUE_NONE) {
+    q->head[bucket_of(q, q->key[e])] = q->next[e];
+  } else {
+    q->next[q->prev[e]] = q->next[e];
+  }
+  if (q->next[e] != BUCKET_QUEUE_NONE) {
+    q->prev[q->next[e]] = q->prev[e];
+  }
+}
+
+static void bucket_link(bucket_queue_t *q, uint32_t e)
+{
+  uint32_t b;
+
+  b = bucket_of(q, q->key[e]);
+  q->prev[e] = BUCKET_QUEUE_NONE;
+  q->next[e] = q->head[b];
+  if (q->head[b] != BUCKET_QUEUE_NONE) {
+    q->prev[q->head[b]] = e;
+  }
+  q->head[b] = e;
+}
+
+void bucket_queue_init(bucket_queue_t *q, uint32_t capacity,
+                       uint32_t max_step)
+{
+  uint32_t num_buckets;
+
+  /* A power of two lets us find buckets with a mask instead of a divide. */
+  for (num_buckets = 1; num_buckets <= max_step; num_buckets <<= 1)
+    ;
+
+  q->head = malloc(num_buckets * sizeof (*q->head));
+  q->next = malloc(capacity * sizeof (*q->next));
+  q->prev = malloc(capacity * sizeof (*q->prev));
+  q->key = malloc(capacity * sizeof (*q->key));
+  q->mask = num_buckets - 1;
+  q->capacity = capacity;
+
+  memset(q->head, 0xff, num_buckets * sizeof (*q->head));
+  memset(q->key, 0xff, capacity * sizeof (*q->key));
+  q->size = 0;
+  q->cursor = 0;
+}
+
+void bucket_queue_delete(bucket_queue_t *q)
+{
+  free(q->head);
+  free(q->next);
+  free(q->prev);
+  free(q->key);
+  q->head = q->next = q->prev = q->key = NULL;
+  q->size = q->capacity = 0;
+}
+
+/* Empties the queue in time proportional to its size, not its capacity. */
+void bucket_queue_reset(bucket_queue_t *q)
+{
+  uint32_t b, e;
+
+  for (b = 0; q->size && b <= q->mask; b++) {
+    for (e = q->head[b]; e != BUCKET_QUEUE_NONE; e = q->next[e]) {
+      q->key[e] = BUCKET_QUEUE_NONE;
+      q->size--;
+    }
+    q->head[b] = BUCKET_QUEUE_NONE;
+  }
+  q->cursor = 0;
+}
+
+/* The first key into an empty queue may be anything; it becomes the new *
+ * floor for everything that follows.                                    */
+void bucket_queue_insert(bucket_queue_t *q, uint32_t e, uint32_t key)
+{
+  if (!q->size) {
+    q->cursor = key;
+  }
+  q->key[e] = key;
+  bucket_link(q, e);
+  q->size++;
+}
+
+void bucket_queue_decrease_key(bucket_queue_t *q, uint32_t e, uint32_t key)
+{
+  bucket_unlink(q, e);
+  q->key[e] = key;
+  bucket_link(q, e);
+}
+
+/* Returns BUCKET_QUEUE_NONE when the queue is empty.  The removed key is *
+ * left in q->cursor.                                                     */
+uint32_t bucket_queue_remove_min(bucket_queue_t *q)
+{
+  uint32_t e;
+
+  if (!q->size) {
+    return BUCKET_QUEUE_NONE;
+  }
+
+  while (q->head[bucket_of(q, q->cursor)] == BUCKET_QUEUE_NONE) {
+    q->cursor++;
+  }
+
+  e = q->head[bucket_of(q, q->cursor)];
+  bucket_unlink(q, e);
+  q->key[e] = BUCKET_QUEUE_NONE;
+  q->size--;
+
+  return e;
+}
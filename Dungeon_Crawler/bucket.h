@@ -0,0 +1,44 @@
+#ifndef BUCKET_H
+# define BUCKET_H
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+# include <stdint.h>
+
+/* A circular bucket queue (Dial's algorithm) for small, bounded keys.     *
+ * Elements are integers in [0, capacity), linked through arrays owned by  *
+ * the queue, so nothing is allocated after bucket_queue_init().  Keys may *
+ * never decrease below the most recently removed key, nor exceed it by    *
+ * more than max_step; Dijkstra with edge weights of at most max_step      *
+ * satisfies both.                                                         */
+
+# define BUCKET_QUEUE_NONE UINT32_MAX
+
+typedef struct bucket_queue {
+  uint32_t *head;
+  uint32_t *next;
+  uint32_t *prev;
+  uint32_t *key;
+  uint32_t mask;
+  uint32_t capacity;
+  uint32_t size;
+  uint32_t cursor;
+} bucket_queue_t;
+
+void bucket_queue_init(bucket_queue_t *q, uint32_t capacity,
+                       uint32_t max_step);
+void bucket_queue_delete(bucket_queue_t *q);
+void bucket_queue_reset(bucket_queue_t *q);
+void bucket_queue_insert(bucket_queue_t *q, uint32_t e, uint32_t key);
+void bucket_queue_decrease_key(bucket_queue_t *q, uint32_t e, uint32_t key);
+uint32_t bucket_queue_remove_min(bucket_queue_t *q);
+
+# define bucket_queue_contains(q, e) ((q)->key[e] != BUCKET_QUEUE_NONE)
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif
@@ -36,7 +36,10 @@ class character {
    * characters have been created by the game.                              */
   uint32_t sequence_number;
   uint32_t kills[num_kill_types];
-  inline uint32_t get_color() { return color[rand_range(0, color.size() - 1)]; }
+  /* The event for this character's next turn, which is cancelled as *
+   * soon as the character dies.  See event_cancel().                */
+  struct event *turn;
+  inline uint32_t get_color(rng_t *r) { return color[rng_under(r, color.size())]; }
   inline char get_symbol() { return symbol; }
 };
 
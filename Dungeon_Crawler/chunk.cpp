@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "chunk.h"
+#include "dungeon.h"
+#include "utils.h"
+#include "pc.h"
+
+static std::string chunk_make_directory(void)
+{
+  std::vector<char> dir;
+  std::string s;
+  char *home;
+
+  if (!(home = getenv("HOME"))) {
+    home = (char *) ".";
+  }
+  s = std::string(home) + "/" + SAVE_DIR + "/";
+  dir.assign(s.begin(), s.end());
+  dir.push_back('\0');
+  if (makedirectory(dir.data())) {
+    return "";
+  }
+
+  return std::string(home) + "/" + SAVE_DIR;
+}
+
+const char *chunk_directory(dungeon_t *d)
+{
+  if ((uint64_t) d->width * d->height < CHUNK_BACKED_CELLS) {
+    return NULL;
+  }
+
+  /* Made once, by whichever thread gets here first. */
+  static const std::string dir = chunk_make_directory();
+
+  return dir.empty() ? NULL : dir.c_str();
+}
+
+static void chunk_evict(dungeon_t *d, uint32_t chunk)
+{
+  d->map.evict(chunk * CHUNK_ROWS, CHUNK_ROWS);
+  d->hardness.evict(chunk * CHUNK_ROWS, CHUNK_ROWS);
+  d->character_map.evict(chunk * CHUNK_ROWS, CHUNK_ROWS);
+  d->objmap.evict(chunk * CHUNK_ROWS, CHUNK_ROWS);
+}
+
+/* Called at the start of each of the PC's turns.  Evicting a chunk    *
+ * that's already out costs only a walk over its page tables, so there *
+ * is no need to remember which chunks are in.                         */
+void chunk_sweep(dungeon_t *d)
+{
+  chunk_context_t *c;
+  uint32_t i, pc;
+
+  if (!d->map.backed()) {
+    return;
+  }
+
+  if (!(c = d->chunks)) {
+    c = d->chunks = new chunk_context_t();
+    c->touched.resize((d->height + CHUNK_ROWS - 1) / CHUNK_ROWS, 0);
+    c->sweeps = c->turns = 0;
+  }
+  if (++c->turns % CHUNK_SWEEP_TURNS) {
+    return;
+  }
+  c->sweeps++;
+
+  pc = d->PC->position[dim_y] / CHUNK_ROWS;
+  for (i = 0; i < c->touched.size(); i++) {
+    if ((i + CHUNK_MARGIN >= pc && i <= pc + CHUNK_MARGIN) ||
+        c->touched[i] + CHUNK_IDLE_SWEEPS > c->sweeps) {
+      continue;
+    }
+    chunk_evict(d, i);
+  }
+}
+
+void chunk_context_delete(dungeon_t *d)
+{
+  delete d->chunks;
+  d->chunks = NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef CHUNK_H
+# define CHUNK_H
+
+# include <stdint.h>
+# include <vector>
+
+typedef struct dungeon dungeon_t;
+
+/* Maps of at least CHUNK_BACKED_CELLS cells keep their terrain,        *
+ * hardness, character and object maps in files mapped into memory      *
+ * (see grid::back()), rather than on the heap.  For paging, such maps  *
+ * are cut into chunks of CHUNK_ROWS whole rows, each one contiguous    *
+ * range of every map.  Every CHUNK_SWEEP_TURNS turns of the PC, chunks *
+ * more than CHUNK_MARGIN chunks from the PC, in which no monster has   *
+ * taken a turn for CHUNK_IDLE_SWEEPS sweeps, are handed back to the    *
+ * kernel.  Whatever reads them next pages them back in.                */
+# define CHUNK_ROWS            64
+# define CHUNK_BACKED_CELLS    (1024 * 1024)
+# define CHUNK_SWEEP_TURNS     32
+# define CHUNK_IDLE_SWEEPS     4
+# define CHUNK_MARGIN          1
+
+typedef struct chunk_context {
+  /* The sweep in which each chunk was last touched. */
+  std::vector<uint32_t> touched;
+  uint32_t sweeps;
+  uint32_t turns;
+} chunk_context_t;
+
+/* Marks the chunk holding row y as in use.  The context is made by  *
+ * the first chunk_sweep() of a backed map; heap maps never get one. */
+# define chunk_touch(d, y)                                           \
+  do {                                                               \
+    if ((d)->chunks) {                                               \
+      (d)->chunks->touched[(y) / CHUNK_ROWS] = (d)->chunks->sweeps;  \
+    }                                                                \
+  } while (0)
+
+/* Where the backing files of a map of d's size go, or NULL if it *
+ * belongs on the heap.                                           */
+const char *chunk_directory(dungeon_t *d);
+void chunk_sweep(dungeon_t *d);
+void chunk_context_delete(dungeon_t *d);
+
+#endif
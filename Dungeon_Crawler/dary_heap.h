@@ -0,0 +1,169 @@
+#ifndef DARY_HEAP_H
+# define DARY_HEAP_H
+
+# include <stdint.h>
+# include <vector>
+
+/* An implicit d-ary min-heap in one contiguous array.  Unlike heap.c,   *
+ * values are stored by value and compared by a functor the compiler can *
+ * inline, and since the functor is an object, it can carry whatever     *
+ * context the comparison needs (a cost map, a dungeon) instead of       *
+ * reaching for a global.  compare(a, b) is true if a belongs above b.   *
+ * Wider nodes make a shallower heap: more compares per level on the way *
+ * down, but fewer levels and fewer cache misses.                        *
+ *                                                                       *
+ * push() returns a handle that stays valid until its value is popped or *
+ * erased, however the heap moves it.  Handles are small integers, and   *
+ * are reused.  decrease_key() either replaces the value or, if the      *
+ * caller changed what the functor compares, as with heap.c's            *
+ * heap_decrease_key_no_replace(), just restores the heap.  Nothing      *
+ * checks that the key actually decreased.  clear() keeps the memory, so *
+ * a heap that's refilled for every search stops allocating.             */
+template <typename T, typename Compare, uint32_t Arity = 4>
+class dary_heap {
+ public:
+  typedef uint32_t handle_t;
+  static constexpr handle_t none = UINT32_MAX;
+ private:
+  struct entry {
+    T value;
+    handle_t handle;
+  };
+  std::vector<entry> items;
+  std::vector<uint32_t> position;
+  std::vector<handle_t> free_handles;
+  Compare compare;
+
+  inline void place(uint32_t i, const entry &e)
+  {
+    items[i] = e;
+    position[e.handle] = i;
+  }
+  void sift_up(uint32_t i)
+  {
+    entry e;
+    uint32_t parent;
+
+    e = items[i];
+    while (i && compare(e.value, items[parent = (i - 1) / Arity].value)) {
+      place(i, items[parent]);
+      i = parent;
+    }
+    place(i, e);
+  }
+  void sift_down(uint32_t i)
+  {
+    entry e;
+    uint32_t child, best, last, n;
+
+    e = items[i];
+    n = items.size();
+    while ((child = i * Arity + 1) < n) {
+      last = child + Arity < n ? child + Arity : n;
+      for (best = child++; child < last; child++) {
+        if (compare(items[child].value, items[best].value)) {
+          best = child;
+        }
+      }
+      if (!compare(items[best].value, e.value)) {
+        break;
+      }
+      place(i, items[best]);
+      i = best;
+    }
+    place(i, e);
+  }
+  void erase_at(uint32_t i)
+  {
+    entry e;
+
+    position[items[i].handle] = none;
+    free_handles.push_back(items[i].handle);
+    e = items.back();
+    items.pop_back();
+    if (i < items.size()) {
+      place(i, e);
+      if (i && compare(e.value, items[(i - 1) / Arity].value)) {
+        sift_up(i);
+      } else {
+        sift_down(i);
+      }
+    }
+  }
+ public:
+  dary_heap(const Compare &compare = Compare()) : compare(compare)
+  {
+  }
+  inline uint32_t size() const
+  {
+    return items.size();
+  }
+  inline bool empty() const
+  {
+    return items.empty();
+  }
+  inline void reserve(uint32_t n)
+  {
+    items.reserve(n);
+    position.reserve(n);
+  }
+  void clear()
+  {
+    items.clear();
+    position.clear();
+    free_handles.clear();
+  }
+  inline bool contains(handle_t h) const
+  {
+    return h < position.size() && position[h] != none;
+  }
+  inline const T &get(handle_t h) const
+  {
+    return items[position[h]].value;
+  }
+  inline const T &top() const
+  {
+    return items[0].value;
+  }
+  handle_t push(const T &v)
+  {
+    entry e;
+
+    if (free_handles.empty()) {
+      e.handle = position.size();
+      position.push_back(none);
+    } else {
+      e.handle = free_handles.back();
+      free_handles.pop_back();
+    }
+    e.value = v;
+    items.push_back(e);
+    sift_up(items.size() - 1);
+
+    return e.handle;
+  }
+  T pop()
+  {
+    T v;
+
+    v = items[0].value;
+    erase_at(0);
+
+    return v;
+  }
+  void erase(handle_t h)
+  {
+    erase_at(position[h]);
+  }
+  inline void decrease_key(handle_t h, const T &v)
+  {
+    items[position[h]].value = v;
+    sift_up(position[h]);
+  }
+  inline void decrease_key(handle_t h)
+  {
+    sift_up(position[h]);
+  }
+};
+
+#endif
@@ -1,9 +1,13 @@
 #include <string>
+#include <string_view>
 #include <cstring>
 #include <iostream>
 #include <cstdio>
-#include <fstream>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <ncurses.h>
 #include <vector>
 #include <sstream>
@@ -119,22 +123,187 @@ const char object_symbol[] = {
   '%', /* objtype_CONTAINER */
 };
 
-static inline void eat_whitespace(std::ifstream &f)
+/* The description files are mapped and read in place, a token at a     *
+ * time, and a token is just a view into the mapping; nothing is copied *
+ * until a description is built from it.  The reads behave exactly as   *
+ * those of the std::ifstream this replaced, down to how reading past   *
+ * the end fails, along with every read after it, so a broken file is   *
+ * discarded just as it was before.                                     */
+
+/* isspace() in the C locale, which the stream used, without a call. */
+#define is_space(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+/* Keywords are compared by length first, and most differ in length. */
+#define token_is(token, keyword)                                  \
+  ((token).size() == sizeof (keyword) - 1 &&                      \
+   !memcmp((token).data(), keyword, sizeof (keyword) - 1))
+
+static inline bool token_equals(std::string_view token, const char *name)
+{
+  return (token.size() == strlen(name) &&
+          !memcmp(token.data(), name, token.size()));
+}
+
+class description_reader {
+ private:
+  const char *p, *end;
+  void *map;
+  size_t size;
+  /* Cleared by the first read to reach the end, like a stream's state. */
+  bool good;
+ public:
+  description_reader(const char *file) : p(0), end(0), map(0), size(0),
+                                         good(false)
+  {
+    struct stat buf;
+    int fd;
+
+    if ((fd = open(file, O_RDONLY)) < 0) {
+      return;
+    }
+    good = true;
+    if (!fstat(fd, &buf) && buf.st_size) {
+      if ((map = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE,
+                      fd, 0)) == MAP_FAILED) {
+        map = 0;
+        good = false;
+      } else {
+        size = buf.st_size;
+        madvise(map, size, MADV_SEQUENTIAL);
+        p = (const char *) map;
+        end = p + size;
+      }
+    }
+    close(fd);
+  }
+  ~description_reader()
+  {
+    if (map) {
+      munmap(map, size);
+    }
+  }
+  inline int peek()
+  {
+    if (good && p == end) {
+      good = false;
+    }
+    return good ? (unsigned char) *p : EOF;
+  }
+  inline int get()
+  {
+    return peek() == EOF ? EOF : (unsigned char) *p++;
+  }
+  /* A word, after any whitespace, as operator>>() would read it into a *
+   * std::string.  At the end of the file, the token is left alone.     */
+  description_reader &operator>>(std::string_view &token)
+  {
+    const char *start, *q;
+
+    for (q = p; good && q != end && is_space(*q); q++)
+      ;
+    p = q;
+    if (peek() == EOF) {
+      return *this;
+    }
+    for (start = q; q != end && !is_space(*q); q++)
+      ;
+    p = q;
+    token = std::string_view(start, q - start);
+
+    return *this;
+  }
+  /* The rest of the line, without its newline, as std::getline(). */
+  bool getline(std::string_view &line)
+  {
+    const char *start, *nl;
+
+    if (peek() == EOF) {
+      return false;
+    }
+    start = p;
+    if ((nl = (const char *) memchr(p, '\n', end - p))) {
+      p = nl + 1;
+    } else {
+      p = nl = end;
+      good = false;
+    }
+    line = std::string_view(start, nl - start);
+
+    return true;
+  }
+};
+
+static inline void getline(description_reader &f, std::string_view &line)
+{
+  f.getline(line);
+}
+
+static inline void getline(description_reader &f, std::string &line)
+{
+  std::string_view v;
+
+  if (f.getline(v)) {
+    line.assign(v.data(), v.size());
+  }
+}
+
+static inline void eat_whitespace(description_reader &f)
 {
   while (isspace(f.peek())) {
     f.get();
   }  
 }
 
-static inline void eat_blankspace(std::ifstream &f)
+static inline void eat_blankspace(description_reader &f)
 {
   while (isblank(f.peek())) {
     f.get();
   }  
 }
 
-static uint32_t parse_name(std::ifstream &f,
-                           std::string *lookahead,
+/* The "%d" or "%u" of sscanf(), which the parsers used on each token: *
+ * a sign, then digits, saturated as strtol() or strtoul() would, and  *
+ * then cut down to 32 bits.  Consumes what it reads.                  */
+static bool scan_decimal(std::string_view *s, bool is_signed, uint32_t *v)
+{
+  const char *c, *end;
+  bool negative, overflow;
+  uint64_t n, limit;
+
+  c = s->data();
+  end = c + s->size();
+  negative = false;
+  if (c != end && (*c == '+' || *c == '-')) {
+    negative = *c++ == '-';
+  }
+  if (c == end || *c < '0' || *c > '9') {
+    return false;
+  }
+  for (n = 0, overflow = false; c != end && *c >= '0' && *c <= '9'; c++) {
+    if (n > (UINT64_MAX - (*c - '0')) / 10) {
+      overflow = true;
+    } else {
+      n = n * 10 + (*c - '0');
+    }
+  }
+
+  if (is_signed) {
+    limit = negative ? (uint64_t) LONG_MAX + 1 : LONG_MAX;
+    if (overflow || n > limit) {
+      n = limit;
+    }
+  } else if (overflow) {
+    negative = false;
+    n = ULONG_MAX;
+  }
+  *v = (uint32_t) (negative ? -n : n);
+  s->remove_prefix(c - s->data());
+
+  return true;
+}
+
+static uint32_t parse_name(description_reader &f,
+                           std::string_view *lookahead,
                            std::string *name)
 {
   /* Always start by eating the blanks.  If we then find a newline, we *
@@ -157,15 +326,15 @@ static uint32_t parse_name(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_monster_name(std::ifstream &f,
-                                   std::string *lookahead,
+static uint32_t parse_monster_name(description_reader &f,
+                                   std::string_view *lookahead,
                                    std::string *name)
 {
   return parse_name(f, lookahead, name);
 }
 
-static uint32_t parse_monster_symb(std::ifstream &f,
-                                   std::string *lookahead,
+static uint32_t parse_monster_symb(description_reader &f,
+                                   std::string_view *lookahead,
                                    char *symb)
 {
   eat_blankspace(f);
@@ -186,10 +355,12 @@ static uint32_t parse_monster_symb(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_integer(std::ifstream &f,
-                              std::string *lookahead,
+static uint32_t parse_integer(description_reader &f,
+                              std::string_view *lookahead,
                               uint32_t *integer)
 {
+  std::string_view token;
+
   eat_blankspace(f);
 
   if (f.peek() == '\n') {
@@ -198,7 +369,8 @@ static uint32_t parse_integer(std::ifstream &f,
 
   f >> *lookahead;
 
-  if (sscanf(lookahead->c_str(), "%d", integer) != 1) {
+  token = *lookahead;
+  if (!scan_decimal(&token, true, integer)) {
     return 1;
   }
 
@@ -207,15 +379,15 @@ static uint32_t parse_integer(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_monster_rrty(std::ifstream &f,
-                                   std::string *lookahead,
+static uint32_t parse_monster_rrty(description_reader &f,
+                                   std::string_view *lookahead,
                                    uint32_t *rarity)
 {
   return parse_integer(f, lookahead, rarity);
 }
 
-static uint32_t parse_color(std::ifstream &f,
-                            std::string *lookahead,
+static uint32_t parse_color(description_reader &f,
+                            std::string_view *lookahead,
                             uint32_t *color)
 {
   uint32_t i;
@@ -231,7 +403,7 @@ static uint32_t parse_color(std::ifstream &f,
   f >> *lookahead;
 
   for (i = 0; colors_lookup[i].name; i++) {
-    if (*lookahead == colors_lookup[i].name) {
+    if (token_equals(*lookahead, colors_lookup[i].name)) {
       *color = colors_lookup[i].value;
       break;
     }
@@ -251,8 +423,8 @@ static uint32_t parse_color(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_monster_color(std::ifstream &f,
-                                    std::string *lookahead,
+static uint32_t parse_monster_color(description_reader &f,
+                                    std::string_view *lookahead,
                                     std::vector<uint32_t> *color)
 {
   uint32_t i;
@@ -270,7 +442,7 @@ static uint32_t parse_monster_color(std::ifstream &f,
     f >> *lookahead;
 
     for (i = 0; colors_lookup[i].name; i++) {
-      if (*lookahead == colors_lookup[i].name) {
+      if (token_equals(*lookahead, colors_lookup[i].name)) {
         c = colors_lookup[i].value;
         break;
       }
@@ -290,10 +462,13 @@ static uint32_t parse_monster_color(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_desc(std::ifstream &f,
-                           std::string *lookahead,
+static uint32_t parse_desc(description_reader &f,
+                           std::string_view *lookahead,
                            std::string *desc)
 {
+  const char *start, *end;
+  bool ended;
+
   /* DESC is special.  Data doesn't follow on the same line *
    * as the keyword, so we want to eat the newline, too.    */
   eat_blankspace(f);
@@ -304,50 +479,58 @@ static uint32_t parse_desc(std::ifstream &f,
 
   f.get();
 
+  /* The lines are contiguous in the file, newlines and all, so the *
+   * description is copied out in one piece once its end is found.  */
+  start = end = NULL;
+  ended = false;
   while (f.peek() != EOF) {
     getline(f, *lookahead);
     if (lookahead->length() > 77) {
       return 1;
     }
 
-    lookahead->push_back('\n');
-
-    if (*lookahead == ".\n") {
+    if (token_is(*lookahead, ".")) {
+      ended = true;
       break;
     }
 
-    *desc += *lookahead;
+    if (!start) {
+      start = lookahead->data();
+    }
+    end = lookahead->data() + lookahead->size();
   }
 
-  /* Strip off the trailing newline */
-  desc->erase(desc->length() - 1);
-
-  if (*lookahead != ".\n") {
+  if (!ended) {
     return 1;
   }
 
+  /* Without the trailing newline */
+  if (start) {
+    desc->assign(start, end - start);
+  }
+
   f >> *lookahead;
 
   return 0;
 }
 
-static uint32_t parse_monster_desc(std::ifstream &f,
-                                   std::string *lookahead,
+static uint32_t parse_monster_desc(description_reader &f,
+                                   std::string_view *lookahead,
                                    std::string *desc)
 {
   return parse_desc(f, lookahead, desc);
 }
 
-typedef uint32_t (*dice_parser_func_t)(std::ifstream &f,
-                                       std::string *lookahead,
+typedef uint32_t (*dice_parser_func_t)(description_reader &f,
+                                       std::string_view *lookahead,
                                        dice *hit);
 
-static uint32_t parse_dice(std::ifstream &f,
-                           std::string *lookahead,
+static uint32_t parse_dice(description_reader &f,
+                           std::string_view *lookahead,
                            dice *d)
 {
-  int32_t base;
-  uint32_t number, sides;
+  std::string_view token;
+  uint32_t base, number, sides;
 
   eat_blankspace(f);
 
@@ -357,11 +540,23 @@ static uint32_t parse_dice(std::ifstream &f,
 
   f >> *lookahead;
 
-  if (sscanf(lookahead->c_str(), "%d+%ud%u", &base, &number, &sides) != 3) {
+  /* <base>+<number>d<sides>, and anything after is ignored. */
+  token = *lookahead;
+  if (!scan_decimal(&token, true, &base) || token.empty() ||
+      token[0] != '+') {
+    return 1;
+  }
+  token.remove_prefix(1);
+  if (!scan_decimal(&token, false, &number) || token.empty() ||
+      token[0] != 'd') {
+    return 1;
+  }
+  token.remove_prefix(1);
+  if (!scan_decimal(&token, false, &sides)) {
     return 1;
   }
 
-  d->set(base, number, sides);
+  d->set((int32_t) base, number, sides);
 
   f >> *lookahead;
 
@@ -372,8 +567,8 @@ static dice_parser_func_t parse_monster_speed = parse_dice;
 static dice_parser_func_t parse_monster_dam = parse_dice;
 static dice_parser_func_t parse_monster_hp = parse_dice;
 
-static uint32_t parse_monster_abil(std::ifstream &f,
-                                   std::string *lookahead,
+static uint32_t parse_monster_abil(description_reader &f,
+                                   std::string_view *lookahead,
                                    uint32_t *abil)
 {
   uint32_t i;
@@ -391,7 +586,7 @@ static uint32_t parse_monster_abil(std::ifstream &f,
     f >> *lookahead;
 
     for (i = 0; abilities_lookup[i].name; i++) {
-      if (*lookahead == abilities_lookup[i].name) {
+      if (token_equals(*lookahead, abilities_lookup[i].name)) {
         *abil |= abilities_lookup[i].value;
         break;
       }
@@ -409,8 +604,8 @@ static uint32_t parse_monster_abil(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_monster_description(std::ifstream &f,
-                                          std::string *lookahead,
+static uint32_t parse_monster_description(description_reader &f,
+                                          std::string_view *lookahead,
                                           std::vector<monster_description> *v)
 {
   std::string s;
@@ -428,19 +623,19 @@ static uint32_t parse_monster_description(std::ifstream &f,
   read_name = read_symb = read_color = read_desc = read_speed
             = read_dam = read_hp = read_abil = read_rrty = false;
 
-  if (*lookahead != "BEGIN") {
+  if (!token_is(*lookahead, "BEGIN")) {
     std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
               << "Parse error in monster description.\n"
               << "Discarding monster." << std::endl;
     do {
       f >> *lookahead;
-    } while (*lookahead != "BEGIN" && f.peek() != EOF);
+    } while (!token_is(*lookahead, "BEGIN") && f.peek() != EOF);
   }
   if (f.peek() == EOF) {
     return 1;
   }
   f >> *lookahead;
-  if (*lookahead != "MONSTER") {
+  if (!token_is(*lookahead, "MONSTER")) {
     return 1;
   }
 
@@ -448,7 +643,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
        count < NUM_MONSTER_DESCRIPTION_FIELDS;
        count++) {
     /* This could definately be more concise. */
-    if        (*lookahead == "NAME")  {
+    if        (token_is(*lookahead, "NAME"))  {
       if (read_name || parse_monster_name(f, lookahead, &name)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster name.\n"
@@ -456,7 +651,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_name = true;
-    } else if (*lookahead == "DESC")  {
+    } else if (token_is(*lookahead, "DESC"))  {
       if (read_desc || parse_monster_desc(f, lookahead, &desc)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster description.\n"
@@ -464,7 +659,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_desc = true;
-    } else if (*lookahead == "SYMB")  {
+    } else if (token_is(*lookahead, "SYMB"))  {
       if (read_symb || parse_monster_symb(f, lookahead, &symb)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster symbol.\n"
@@ -472,7 +667,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_symb = true;
-    } else if (*lookahead == "COLOR") {
+    } else if (token_is(*lookahead, "COLOR")) {
       if (read_color || parse_monster_color(f, lookahead, &color)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster color.\n"
@@ -480,7 +675,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_color = true;
-    } else if (*lookahead == "SPEED") {
+    } else if (token_is(*lookahead, "SPEED")) {
       if (read_speed || parse_monster_speed(f, lookahead, &speed)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster speed.\n"
@@ -488,7 +683,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_speed = true;
-    } else if (*lookahead == "ABIL")  {
+    } else if (token_is(*lookahead, "ABIL"))  {
       if (read_abil || parse_monster_abil(f, lookahead, &abil)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster abilities.\n"
@@ -496,7 +691,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_abil = true;
-    } else if (*lookahead == "HP")    {
+    } else if (token_is(*lookahead, "HP"))    {
       if (read_hp || parse_monster_hp(f, lookahead, &hp)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster hitpoints.\n"
@@ -504,7 +699,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_hp = true;
-    } else if (*lookahead == "DAM")   {
+    } else if (token_is(*lookahead, "DAM"))   {
       if (read_dam || parse_monster_dam(f, lookahead, &dam)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster damage.\n"
@@ -512,7 +707,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
         return 1;
       }
       read_dam = true;
-    } else if (*lookahead == "RRTY")   {
+    } else if (token_is(*lookahead, "RRTY"))   {
       if (read_rrty || parse_monster_rrty(f, lookahead, &rrty)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in monster damage.\n"
@@ -528,7 +723,7 @@ static uint32_t parse_monster_description(std::ifstream &f,
     }
   }
 
-  if (*lookahead != "END") {
+  if (!token_is(*lookahead, "END")) {
     return 1;
   }
 
@@ -538,22 +733,23 @@ static uint32_t parse_monster_description(std::ifstream &f,
   }
   f >> *lookahead;
 
-  m.set(name, desc, symb, color, speed, abil, hp, dam, rrty);
-  v->push_back(m);
+  m.set(std::move(name), std::move(desc), symb, std::move(color),
+        speed, abil, hp, dam, rrty);
+  v->push_back(std::move(m));
 
   return 0;
 }
 
-static uint32_t parse_object_name(std::ifstream &f,
-                                  std::string *lookahead,
+static uint32_t parse_object_name(description_reader &f,
+                                  std::string_view *lookahead,
                                   std::string *name)
 {
 
   return parse_name(f, lookahead, name);
 }
 
-static uint32_t parse_object_art(std::ifstream &f,
-                                  std::string *lookahead,
+static uint32_t parse_object_art(description_reader &f,
+                                  std::string_view *lookahead,
                                   bool *art)
 {
   std::string s;
@@ -571,22 +767,22 @@ static uint32_t parse_object_art(std::ifstream &f,
   return 1;
 }
 
-static uint32_t parse_object_rrty(std::ifstream &f,
-                                  std::string *lookahead,
+static uint32_t parse_object_rrty(description_reader &f,
+                                  std::string_view *lookahead,
                                   uint32_t *rarity)
 {
   return parse_integer(f, lookahead, rarity);
 }
 
-static uint32_t parse_object_desc(std::ifstream &f,
-                                  std::string *lookahead,
+static uint32_t parse_object_desc(description_reader &f,
+                                  std::string_view *lookahead,
                                   std::string *desc)
 {
   return parse_desc(f, lookahead, desc);
 }
 
-static uint32_t parse_object_type(std::ifstream &f,
-                                  std::string *lookahead,
+static uint32_t parse_object_type(description_reader &f,
+                                  std::string_view *lookahead,
                                   object_type_t *type)
 {
   uint32_t i;
@@ -602,7 +798,7 @@ static uint32_t parse_object_type(std::ifstream &f,
   f >> *lookahead;
 
   for (i = 0; types_lookup[i].name; i++) {
-    if (*lookahead == types_lookup[i].name) {
+    if (token_equals(*lookahead, types_lookup[i].name)) {
       *type = types_lookup[i].value;
       break;
     }
@@ -622,8 +818,8 @@ static uint32_t parse_object_type(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_object_color(std::ifstream &f,
-                                   std::string *lookahead,
+static uint32_t parse_object_color(description_reader &f,
+                                   std::string_view *lookahead,
                                    uint32_t *color)
 {
   return parse_color(f, lookahead, color);
@@ -638,8 +834,8 @@ static dice_parser_func_t parse_object_speed = parse_dice;
 static dice_parser_func_t parse_object_attr = parse_dice;
 static dice_parser_func_t parse_object_val = parse_dice;
 
-static uint32_t parse_object_description(std::ifstream &f,
-                                         std::string *lookahead,
+static uint32_t parse_object_description(description_reader &f,
+                                         std::string_view *lookahead,
                                          std::vector<object_description> *v)
 {
   std::string s;
@@ -661,19 +857,19 @@ static uint32_t parse_object_description(std::ifstream &f,
               read_weight = read_speed = read_attr = read_val =
               read_art = read_rrty = false;
 
-  if (*lookahead != "BEGIN") {
+  if (!token_is(*lookahead, "BEGIN")) {
     std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
               << "Parse error in object description.\n"
               << "Discarding object." << std::endl;
     do {
       f >> *lookahead;
-    } while (*lookahead != "BEGIN" && f.peek() != EOF);
+    } while (!token_is(*lookahead, "BEGIN") && f.peek() != EOF);
   }
   if (f.peek() == EOF) {
     return 1;
   }
   f >> *lookahead;
-  if (*lookahead != "OBJECT") {
+  if (!token_is(*lookahead, "OBJECT")) {
     return 1;
   }
 
@@ -681,7 +877,7 @@ static uint32_t parse_object_description(std::ifstream &f,
        count < NUM_OBJECT_DESCRIPTION_FIELDS;
        count++) {
     /* This could definately be more concise. */
-    if (*lookahead == "NAME")  {
+    if (token_is(*lookahead, "NAME"))  {
       if (read_name || parse_object_name(f, lookahead, &name)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object name.\n"
@@ -689,7 +885,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_name = true;
-    } else if (*lookahead == "DESC")  {
+    } else if (token_is(*lookahead, "DESC"))  {
       if (read_desc || parse_object_desc(f, lookahead, &desc)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object description.\n"
@@ -697,7 +893,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_desc = true;
-    } else if (*lookahead == "TYPE")  {
+    } else if (token_is(*lookahead, "TYPE"))  {
       if (read_type || parse_object_type(f, lookahead, &type)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object type.\n"
@@ -705,7 +901,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_type = true;
-    } else if (*lookahead == "COLOR") {
+    } else if (token_is(*lookahead, "COLOR")) {
       if (read_color || parse_object_color(f, lookahead, &color)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object color.\n"
@@ -713,7 +909,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_color = true;
-    } else if (*lookahead == "HIT")   {
+    } else if (token_is(*lookahead, "HIT"))   {
       if (read_hit || parse_object_hit(f, lookahead, &hit)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object hit bonux.\n"
@@ -721,7 +917,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_hit = true;
-    } else if (*lookahead == "DAM")   {
+    } else if (token_is(*lookahead, "DAM"))   {
       if (read_dam || parse_object_dam(f, lookahead, &dam)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object damage bonus.\n"
@@ -729,7 +925,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_dam = true;
-    } else if (*lookahead == "DODGE")   {
+    } else if (token_is(*lookahead, "DODGE"))   {
       if (read_dodge || parse_object_dodge(f, lookahead, &dodge)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object dodge bonus.\n"
@@ -737,7 +933,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_dodge = true;
-    } else if (*lookahead == "DEF")   {
+    } else if (token_is(*lookahead, "DEF"))   {
       if (read_def || parse_object_def(f, lookahead, &def)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object defence bonus.\n"
@@ -745,7 +941,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_def = true;
-    } else if (*lookahead == "WEIGHT")   {
+    } else if (token_is(*lookahead, "WEIGHT"))   {
       if (read_weight || parse_object_weight(f, lookahead, &weight)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object weight.\n"
@@ -753,7 +949,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_weight = true;
-    } else if (*lookahead == "SPEED") {
+    } else if (token_is(*lookahead, "SPEED")) {
       if (read_speed || parse_object_speed(f, lookahead, &speed)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object speed bonus.\n"
@@ -761,7 +957,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_speed = true;
-    } else if (*lookahead == "ATTR")  {
+    } else if (token_is(*lookahead, "ATTR"))  {
       if (read_attr || parse_object_attr(f, lookahead, &attr)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object special attribute bonus.\n"
@@ -769,7 +965,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_attr = true;
-    } else if (*lookahead == "VAL")    {
+    } else if (token_is(*lookahead, "VAL"))    {
       if (read_val || parse_object_val(f, lookahead, &val)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object value.\n"
@@ -777,7 +973,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_val = true;
-    } else if (*lookahead == "ART")    {
+    } else if (token_is(*lookahead, "ART"))    {
       if (read_art || parse_object_art(f, lookahead, &art)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object value.\n"
@@ -785,7 +981,7 @@ static uint32_t parse_object_description(std::ifstream &f,
         return 1;
       }
       read_art = true;
-    } else if (*lookahead == "RRTY")    {
+    } else if (token_is(*lookahead, "RRTY"))    {
       if (read_rrty || parse_object_rrty(f, lookahead, &rrty)) {
         std::cerr << "Discovered at " << __FILE__ << ":" << __LINE__ << "\n"
                   << "Parse error in object value.\n"
@@ -801,7 +997,7 @@ static uint32_t parse_object_description(std::ifstream &f,
     }
   }
 
-  if (*lookahead != "END") {
+  if (!token_is(*lookahead, "END")) {
     return 1;
   }
 
@@ -811,20 +1007,20 @@ static uint32_t parse_object_description(std::ifstream &f,
   }
   f >> *lookahead;
 
-  o.set(name, desc, type, color, hit, dam, dodge,
+  o.set(std::move(name), std::move(desc), type, color, hit, dam, dodge,
         def, weight, speed, attr, val, art, rrty);
-  v->push_back(o);
+  v->push_back(std::move(o));
 
   return 0;
 }
 
-static uint32_t parse_monster_descriptions(std::ifstream &f,
+static uint32_t parse_monster_descriptions(description_reader &f,
                                            dungeon_t *d,
                                            std::vector<monster_description> *v)
 {
   std::string s;
   std::stringstream expected;
-  std::string lookahead;
+  std::string_view lookahead;
 
   expected << MONSTER_FILE_SEMANTIC << " " << MONSTER_FILE_VERSION;
 
@@ -848,13 +1044,13 @@ static uint32_t parse_monster_descriptions(std::ifstream &f,
   return 0;
 }
 
-static uint32_t parse_object_descriptions(std::ifstream &f,
+static uint32_t parse_object_descriptions(description_reader &f,
                                           dungeon_t *d,
                                           std::vector<object_description> *v)
 {
   std::string s;
   std::stringstream expected;
-  std::string lookahead;
+  std::string_view lookahead;
 
   expected << OBJECT_FILE_SEMANTIC << " " << OBJECT_FILE_VERSION;
 
@@ -878,43 +1074,42 @@ static uint32_t parse_object_descriptions(std::ifstream &f,
   return 0;
 }
 
-uint32_t parse_descriptions(dungeon_t *d)
+uint32_t parse_description_files(dungeon_t *d,
+                                 const char *monster_file,
+                                 const char *object_file)
 {
-  std::string file;
-  std::ifstream f;
   uint32_t retval;
 
   retval = 0;
 
-  file = getenv("HOME");
-  if (file.length() == 0) {
-    file = ".";
-  }
-  file += std::string("/") + SAVE_DIR + "/" + MONSTER_DESC_FILE;
+  description_reader m(monster_file);
 
-  f.open(file.c_str());
-
-  if (parse_monster_descriptions(f, d, &d->monster_descriptions)) {
+  if (parse_monster_descriptions(m, d, &d->monster_descriptions)) {
     retval = 1;
   }
 
-  f.close();
+  description_reader o(object_file);
 
-  file = getenv("HOME");
-  if (file.length() == 0) {
-    file = ".";
+  if (parse_object_descriptions(o, d, &d->object_descriptions)) {
+    retval = 1;
   }
-  file += std::string("/") + SAVE_DIR + "/" + OBJECT_DESC_FILE;
 
-  f.open(file.c_str());
+  return retval;
+}
 
-  if (parse_object_descriptions(f, d, &d->object_descriptions)) {
-    retval = 1;
-  }
+uint32_t parse_descriptions(dungeon_t *d)
+{
+  std::string monster_file, object_file;
 
-  f.close();
+  monster_file = getenv("HOME");
+  if (monster_file.length() == 0) {
+    monster_file = ".";
+  }
+  object_file = monster_file;
+  monster_file += std::string("/") + SAVE_DIR + "/" + MONSTER_DESC_FILE;
+  object_file += std::string("/") + SAVE_DIR + "/" + OBJECT_DESC_FILE;
 
-  return retval;
+  return parse_description_files(d, monster_file.c_str(), object_file.c_str());
 }
 
 uint32_t print_descriptions(dungeon_t *d)
@@ -936,20 +1131,20 @@ uint32_t print_descriptions(dungeon_t *d)
   return 0;
 }
 
-void monster_description::set(const std::string &name,
-                              const std::string &description,
+void monster_description::set(std::string name,
+                              std::string description,
                               const char symbol,
-                              const std::vector<uint32_t> &color,
+                              std::vector<uint32_t> color,
                               const dice &speed,
                               const uint32_t abilities,
                               const dice &hitpoints,
                               const dice &damage,
                               const uint32_t rrty)
 {
-  this->name = name;
-  this->description = description;
+  this->name = std::move(name);
+  this->description = std::move(description);
   this->symbol = symbol;
-  this->color = color;
+  this->color = std::move(color);
   this->speed = speed;
   this->abilities = abilities;
   this->hitpoints = hitpoints;
@@ -1004,8 +1199,8 @@ uint32_t destroy_descriptions(dungeon_t *d)
   return 0;
 }
 
-void object_description::set(const std::string &name,
-                             const std::string &description,
+void object_description::set(std::string name,
+                             std::string description,
                              const object_type_t type,
                              const uint32_t color,
                              const dice &hit,
@@ -1019,8 +1214,8 @@ void object_description::set(const std::string &name,
                              const bool art,
                              const uint32_t rrty)
 {
-  this->name = name;
-  this->description = description;
+  this->name = std::move(name);
+  this->description = std::move(description);
   this->type = type;
   this->color = color;
   this->hit = hit;
@@ -1071,14 +1266,16 @@ npc *monster_description::generate_monster(dungeon *d)
   std::vector<monster_description> &v = d->monster_descriptions;
   uint32_t i;
 
-  while (!v[(i = (rand() % v.size()))].can_be_generated() ||
-         !v[i].pass_rarity_roll());
+  do {
+    i = rng_under(&d->rng[rng_generation], v.size());
+  } while (!v[i].can_be_generated() ||
+           !v[i].pass_rarity_roll(&d->rng[rng_generation]));
 
   monster_description &m = v[i];
 
   n = new npc(d, m);
 
-  heap_insert(&d->events, new_event(d, event_character_turn, n, 0));
+  d->events.push(new_event(d, event_character_turn, n, 0));
 
   return n;
 }
@@ -8,10 +8,15 @@
 
 # include "dice.h"
 # include "npc.h"
+# include "rng.h"
 
 typedef struct dungeon dungeon_t;
 
 uint32_t parse_descriptions(dungeon_t *d);
+/* Reads the files named rather than those in the save directory. */
+uint32_t parse_description_files(dungeon_t *d,
+                                 const char *monster_file,
+                                 const char *object_file);
 uint32_t print_descriptions(dungeon_t *d);
 uint32_t destroy_descriptions(dungeon_t *d);
 
@@ -56,9 +61,9 @@ class monster_description {
     return (((abilities & NPC_UNIQ) && !num_alive && !num_killed) ||
             !(abilities & NPC_UNIQ));
   }
-  inline bool pass_rarity_roll()
+  inline bool pass_rarity_roll(rng_t *r)
   {
-    return rarity > (unsigned) (rand() % 100);
+    return rarity > rng_under(r, 100);
   }
 
  public:
@@ -67,10 +72,11 @@ class monster_description {
                           rarity(0), num_alive(0), num_killed(0)
   {
   }
-  void set(const std::string &name,
-           const std::string &description,
+  /* Takes the strings and colors, which the parser has no more use for. */
+  void set(std::string name,
+           std::string description,
            const char symbol,
-           const std::vector<uint32_t> &color,
+           std::vector<uint32_t> color,
            const dice &speed,
            const uint32_t abilities,
            const dice &hitpoints,
@@ -94,6 +100,7 @@ class monster_description {
   }
   friend npc;
   friend bool boss_is_alive(dungeon *d);
+  friend struct game_save;
 };
 
 class object_description {
@@ -119,12 +126,12 @@ class object_description {
   {
     return !artifact || (artifact && !num_generated && !num_found && (type != objtype_POTION));
   }
-  inline bool pass_rarity_roll()
+  inline bool pass_rarity_roll(rng_t *r)
   {
-    return rarity > (unsigned) (rand() % 100);
+    return rarity > rng_under(r, 100);
   }
-  void set(const std::string &name,
-           const std::string &description,
+  void set(std::string name,
+           std::string description,
            const object_type_t type,
            const uint32_t color,
            const dice &hit,
@@ -155,6 +162,7 @@ class object_description {
   inline void generate() { num_generated++; }
   inline void destroy() { num_generated--; }
   inline void find() { num_found++; }
+  friend struct game_save;
 };
 
 std::ostream &operator<<(std::ostream &o, monster_description &m);
@@ -3,7 +3,7 @@
 #include "dice.h"
 #include "utils.h"
 
-int32_t dice::roll(void) const
+int32_t dice::roll(rng_t *r) const
 {
   int32_t total;
   uint32_t i;
@@ -12,7 +12,7 @@ int32_t dice::roll(void) const
 
   if (sides) {
     for (i = 0; i < number; i++) {
-      total += rand_range(1, sides);
+      total += rand_range(r, 1, sides);
     }
   }
 
@@ -1,29 +1,37 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <sys/time.h>
-#include <limits.h>
 #include <errno.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+# define SMOOTH_SSE2
+# define CLASSIFY_SSE2
+#endif
 
 #include "dungeon.h"
 #include "utils.h"
-#include "heap.h"
+#include "dary_heap.h"
 #include "event.h"
 #include "pc.h"
 #include "npc.h"
 #include "io.h"
 #include "object.h"
+#include "path.h"
+#include "save.h"
 
 #define DUMP_HARDNESS_IMAGES 0
 
-typedef struct corridor_path {
-  heap_node_t *hn;
-  uint8_t pos[2];
-  uint8_t from[2];
-  int32_t cost;
-} corridor_path_t;
-
 /* Will need this later.
 static uint32_t in_room(dungeon_t *d, int16_t y, int16_t x)
 {
@@ -55,207 +63,268 @@ static uint32_t is_open_space(dungeon_t *d, int16_t y, int16_t x)
   return !hardnessxy(x, y);
 }
 
-static int32_t corridor_path_cmp(const void *key, const void *with) {
-  return ((corridor_path_t *) key)->cost - ((corridor_path_t *) with)->cost;
+/* Corridors follow the cheapest 4-connected path between two points,  *
+ * where stepping off of a cell costs that cell's weight.  The search  *
+ * is A*, guided by a lower bound built from the cheapest cell in each *
+ * column and row: moving one column toward the goal means stepping    *
+ * off of some cell in the column being left, and likewise for rows,   *
+ * so the bound never overestimates, and it only ever shrinks by the   *
+ * weight of the cell being left, so no cell is expanded twice.  Only  *
+ * cells the search actually reaches are queued, and it stops as soon  *
+ * as it reaches the goal.                                             *
+ *                                                                     *
+ * On a default-sized map, the search may go anywhere, as it always    *
+ * could.  On a bigger one, it stays within a few cells of the box     *
+ * around the two ends, so that each of the thousands of corridors     *
+ * costs about what one on a default-sized map does.                   */
+#define CORRIDOR_MARGIN_X 4
+#define CORRIDOR_MARGIN_Y 2
+
+typedef struct corridor_node {
+  uint32_t estimate;
+  uint32_t cost;
+  uint32_t cell;
+} corridor_node_t;
+
+struct corridor_node_cmp {
+  inline bool operator()(const corridor_node_t &a,
+                         const corridor_node_t &b) const
+  {
+    return (a.estimate < b.estimate ||
+            (a.estimate == b.estimate && a.cost > b.cost));
+  }
+};
+
+typedef dary_heap<corridor_node_t, corridor_node_cmp> corridor_heap_t;
+
+typedef struct corridor_search {
+  /* A cell's cost and from are only meaningful if its reached matches *
+   * the current search, so nothing is reset between searches.         */
+  std::vector<uint32_t> cost;
+  std::vector<uint32_t> reached;
+  std::vector<uint32_t> from;
+  std::vector<corridor_heap_t::handle_t> handle;
+  /* The cheapest weight in every column (row) of the window, and the *
+   * sums of those before each one.                                   */
+  std::vector<uint8_t> column_min;
+  std::vector<uint8_t> row_min;
+  std::vector<uint32_t> column;
+  std::vector<uint32_t> row;
+  std::vector<uint8_t> inverse;
+  uint32_t width, height;
+  /* The window, [x0, x1) by [y0, y1), and how far it reaches past *
+   * the ends of the corridor.                                     */
+  uint32_t x0, x1, y0, y1;
+  uint32_t margin[2];
+  int32_t neighbor[4];
+  uint32_t search;
+  uint32_t goal[2];
+  corridor_heap_t frontier;
+} corridor_search_t;
+
+/* Sizes the search for d's map.  Stamps are kept across dungeons of *
+ * the same size, and cleared along with everything else otherwise.  */
+static void corridor_size(dungeon_t *d, corridor_search_t *s)
+{
+  if (s->width == d->width && s->height == d->height) {
+    return;
+  }
+
+  s->width = d->width;
+  s->height = d->height;
+  s->cost.assign(d->width * d->height, 0);
+  s->reached.assign(d->width * d->height, 0);
+  s->from.assign(d->width * d->height, 0);
+  s->handle.assign(d->width * d->height, corridor_heap_t::none);
+  s->column_min.assign(d->width, 0);
+  s->row_min.assign(d->height, 0);
+  s->column.assign(d->width + 1, 0);
+  s->row.assign(d->height + 1, 0);
+  s->inverse.assign(d->width * d->height, 0);
+  s->neighbor[0] = -d->width;
+  s->neighbor[1] = -1;
+  s->neighbor[2] = 1;
+  s->neighbor[3] = d->width;
+  s->search = 0;
+  if (dungeon_scale(d) > 1) {
+    s->margin[dim_x] = CORRIDOR_MARGIN_X;
+    s->margin[dim_y] = CORRIDOR_MARGIN_Y;
+  } else {
+    s->margin[dim_x] = d->width;
+    s->margin[dim_y] = d->height;
+  }
 }
 
-static void dijkstra_corridor(dungeon_t *d, pair_t from, pair_t to)
+static void corridor_window(corridor_search_t *s, pair_t from, pair_t to)
 {
-  static corridor_path_t path[DUNGEON_Y][DUNGEON_X], *p;
-  static uint32_t initialized = 0;
-  heap_t h;
-  int32_t x, y;
+  int32_t lo, hi;
+
+  lo = std::min(from[dim_x], to[dim_x]) - (int32_t) s->margin[dim_x];
+  hi = std::max(from[dim_x], to[dim_x]) + 1 + (int32_t) s->margin[dim_x];
+  s->x0 = lo < 0 ? 0 : lo;
+  s->x1 = hi > (int32_t) s->width ? s->width : hi;
+  lo = std::min(from[dim_y], to[dim_y]) - (int32_t) s->margin[dim_y];
+  hi = std::max(from[dim_y], to[dim_y]) + 1 + (int32_t) s->margin[dim_y];
+  s->y0 = lo < 0 ? 0 : lo;
+  s->y1 = hi > (int32_t) s->height ? s->height : hi;
+}
+
+static void corridor_bounds(corridor_search_t *s, const uint8_t *weight)
+{
+  uint8_t *column, *row;
+  uint32_t x, y;
+
+  column = s->column_min.data();
+  row = s->row_min.data();
 
-  if (!initialized) {
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        path[y][x].pos[dim_y] = y;
-        path[y][x].pos[dim_x] = x;
+  /* The border is immutable, and no path enters it. */
+  for (x = s->x0; x < s->x1; x++) {
+    column[x] = (x && x < s->width - 1) ? 255 : 0;
+  }
+  for (y = s->y0; y < s->y1; y++) {
+    row[y] = (y && y < s->height - 1) ? 255 : 0;
+  }
+  for (y = s->y0 ? s->y0 : 1; y < s->y1 && y < s->height - 1; y++) {
+    for (x = s->x0 ? s->x0 : 1; x < s->x1 && x < s->width - 1; x++) {
+      if (weight[y * s->width + x] < column[x]) {
+        column[x] = weight[y * s->width + x];
+      }
+      if (weight[y * s->width + x] < row[y]) {
+        row[y] = weight[y * s->width + x];
       }
     }
-    initialized = 1;
   }
-  
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      path[y][x].cost = INT_MAX;
-    }
+
+  for (s->column[s->x0] = 0, x = s->x0; x < s->x1; x++) {
+    s->column[x + 1] = s->column[x] + column[x];
+  }
+  for (s->row[s->y0] = 0, y = s->y0; y < s->y1; y++) {
+    s->row[y + 1] = s->row[y] + row[y];
   }
+}
 
-  path[from[dim_y]][from[dim_x]].cost = 0;
+/* Going right from x crosses columns x to goal - 1; going left crosses *
+ * columns goal + 1 to x.                                               */
+static inline uint32_t corridor_bound(const uint32_t *sum, uint32_t at,
+                                      uint32_t goal)
+{
+  return at < goal ? sum[goal] - sum[at] : sum[at + 1] - sum[goal + 1];
+}
 
-  heap_init(&h, corridor_path_cmp, NULL);
+static inline uint32_t corridor_estimate(corridor_search_t *s, uint32_t c)
+{
+  return (corridor_bound(s->column.data(), c % s->width, s->goal[dim_x]) +
+          corridor_bound(s->row.data(), c / s->width, s->goal[dim_y]));
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) != ter_wall_immutable) {
-        path[y][x].hn = heap_insert(&h, &path[y][x]);
-      } else {
-        path[y][x].hn = NULL;
-      }
-    }
+static void corridor_reach(corridor_search_t *s, uint32_t c,
+                           uint32_t from, uint32_t cost)
+{
+  corridor_node_t n;
+
+  n.estimate = cost + corridor_estimate(s, c);
+  n.cost = cost;
+  n.cell = c;
+  if (s->reached[c] != s->search) {
+    s->reached[c] = s->search;
+    s->handle[c] = s->frontier.push(n);
+  } else {
+    s->frontier.decrease_key(s->handle[c], n);
   }
+  s->cost[c] = cost;
+  s->from[c] = from;
+}
 
-  while ((p = (corridor_path_t *) heap_remove_min(&h))) {
-    p->hn = NULL;
+static inline uint32_t corridor_in_window(corridor_search_t *s, uint32_t c)
+{
+  return (c % s->width >= s->x0 && c % s->width < s->x1 &&
+          c / s->width >= s->y0 && c / s->width < s->y1);
+}
 
-    if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
-      for (x = to[dim_x], y = to[dim_y];
-           (x != from[dim_x]) || (y != from[dim_y]);
-           p = &path[y][x], x = p->from[dim_x], y = p->from[dim_y]) {
-        if (mapxy(x, y) != ter_floor_room) {
-          mapxy(x, y) = ter_floor_hall;
-          hardnessxy(x, y) = 0;
+static void corridor_carve(dungeon_t *d, corridor_search_t *s,
+                           const uint8_t *weight, pair_t from, pair_t to)
+{
+  corridor_node_t p;
+  uint32_t c, n, i, start, goal, next;
+
+  corridor_window(s, from, to);
+  corridor_bounds(s, weight);
+  if (!++s->search) {
+    std::fill(s->reached.begin(), s->reached.end(), 0);
+    s->search = 1;
+  }
+  s->frontier.clear();
+  s->goal[dim_x] = to[dim_x];
+  s->goal[dim_y] = to[dim_y];
+  start = from[dim_y] * s->width + from[dim_x];
+  goal = to[dim_y] * s->width + to[dim_x];
+
+  corridor_reach(s, start, start, 0);
+
+  while (!s->frontier.empty()) {
+    p = s->frontier.pop();
+    s->handle[p.cell] = corridor_heap_t::none;
+
+    if (p.cell == goal) {
+      for (c = goal; c != start; c = s->from[c]) {
+        if (d->map.data()[c] != ter_floor_room) {
+          d->map.data()[c] = ter_floor_hall;
+          d->hardness.data()[c] = 0;
         }
       }
-      heap_delete(&h);
       return;
     }
 
-    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] - 1]
-                                           [p->pos[dim_x]    ].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] - 1].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] + 1].hn);
-    }
-    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair(p->pos))) {
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair(p->pos);
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] + 1]
-                                           [p->pos[dim_x]    ].hn);
-    }
-  }
-}
-
-/* This is a cut-and-paste of the above.  The code is modified to  *
- * calculate paths based on inverse hardnesses so that we get a    *
- * high probability of creating at least one cycle in the dungeon. */
-static void dijkstra_corridor_inv(dungeon_t *d, pair_t from, pair_t to)
-{
-  static corridor_path_t path[DUNGEON_Y][DUNGEON_X], *p;
-  static uint32_t initialized = 0;
-  heap_t h;
-  int32_t x, y;
-
-  if (!initialized) {
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        path[y][x].pos[dim_y] = y;
-        path[y][x].pos[dim_x] = x;
+    next = p.cost + weight[p.cell];
+    for (i = 0; i < 4; i++) {
+      n = p.cell + s->neighbor[i];
+      if (d->map.data()[n] != ter_wall_immutable &&
+          corridor_in_window(s, n) &&
+          (s->reached[n] != s->search ||
+           (s->handle[n] != corridor_heap_t::none && s->cost[n] > next))) {
+        corridor_reach(s, n, p.cell, next);
       }
     }
-    initialized = 1;
-  }
-  
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      path[y][x].cost = INT_MAX;
-    }
   }
+}
 
-  path[from[dim_y]][from[dim_x]].cost = 0;
+/* The search state is per thread, so that dungeons can be generated in *
+ * parallel, and its frontier keeps its memory from one corridor to the *
+ * next.                                                                */
+static thread_local corridor_search_t corridor_search;
 
-  heap_init(&h, corridor_path_cmp, NULL);
+static void dijkstra_corridor(dungeon_t *d, pair_t from, pair_t to)
+{
+  corridor_size(d, &corridor_search);
+  corridor_carve(d, &corridor_search, d->hardness.data(), from, to);
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) != ter_wall_immutable) {
-        path[y][x].hn = heap_insert(&h, &path[y][x]);
+/* Weighs cells by inverse hardness, so that we get a high probability *
+ * of creating at least one cycle in the dungeon.  Only the cells the  *
+ * search may visit need weights.                                      */
+static void dijkstra_corridor_inv(dungeon_t *d, pair_t from, pair_t to)
+{
+  corridor_search_t *s;
+  int16_t x, y;
+
+  s = &corridor_search;
+  corridor_size(d, s);
+  corridor_window(s, from, to);
+  for (y = s->y0; y < (int32_t) s->y1; y++) {
+    for (x = s->x0; x < (int32_t) s->x1; x++) {
+      if (mapxy(x, y) == ter_wall_immutable) {
+        s->inverse[y * d->width + x] = 255;
+      } else if (is_open_space(d, y, x)) {
+        s->inverse[y * d->width + x] = 127;
+      } else if (adjacent_to_room(d, y, x)) {
+        s->inverse[y * d->width + x] = 191;
       } else {
-        path[y][x].hn = NULL;
+        s->inverse[y * d->width + x] = 255 - hardnessxy(x, y);
       }
     }
   }
 
-  while ((p = (corridor_path_t *) heap_remove_min(&h))) {
-    p->hn = NULL;
-
-    if ((p->pos[dim_y] == to[dim_y]) && p->pos[dim_x] == to[dim_x]) {
-      for (x = to[dim_x], y = to[dim_y];
-           (x != from[dim_x]) || (y != from[dim_y]);
-           p = &path[y][x], x = p->from[dim_x], y = p->from[dim_y]) {
-        if (mapxy(x, y) != ter_floor_room) {
-          mapxy(x, y) = ter_floor_hall;
-          hardnessxy(x, y) = 0;
-        }
-      }
-      heap_delete(&h);
-      return;
-    }
-
-#define hardnesspair_inv(p) (is_open_space(d, p[dim_y], p[dim_x]) ? 127 :     \
-                             (adjacent_to_room(d, p[dim_y], p[dim_x]) ? 191 : \
-                              (255 - hardnesspair(p))))
-
-    if ((path[p->pos[dim_y] - 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] - 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] - 1]
-                                           [p->pos[dim_x]    ].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] - 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] - 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] - 1].hn);
-    }
-    if ((path[p->pos[dim_y]    ][p->pos[dim_x] + 1].hn) &&
-        (path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y]    ][p->pos[dim_x] + 1].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y]    ]
-                                           [p->pos[dim_x] + 1].hn);
-    }
-    if ((path[p->pos[dim_y] + 1][p->pos[dim_x]    ].hn) &&
-        (path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost >
-         p->cost + hardnesspair_inv(p->pos))) {
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].cost =
-        p->cost + hardnesspair_inv(p->pos);
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_y] = p->pos[dim_y];
-      path[p->pos[dim_y] + 1][p->pos[dim_x]    ].from[dim_x] = p->pos[dim_x];
-      heap_decrease_key_no_replace(&h, path[p->pos[dim_y] + 1]
-                                           [p->pos[dim_x]    ].hn);
-    }
-  }
+  corridor_carve(d, s, s->inverse.data(), from, to);
 }
 
 /* Chooses a random point inside each room and connects them with a *
@@ -264,14 +333,16 @@ static void dijkstra_corridor_inv(dungeon_t *d, pair_t from, pair_t to)
 static int connect_two_rooms(dungeon_t *d, room_t *r1, room_t *r2)
 {
   pair_t e1, e2;
+  rng_t *rng;
 
-  e1[dim_y] = rand_range(r1->position[dim_y],
+  rng = &d->rng[rng_generation];
+  e1[dim_y] = rand_range(rng, r1->position[dim_y],
                          r1->position[dim_y] + r1->size[dim_y] - 1);
-  e1[dim_x] = rand_range(r1->position[dim_x],
+  e1[dim_x] = rand_range(rng, r1->position[dim_x],
                          r1->position[dim_x] + r1->size[dim_x] - 1);
-  e2[dim_y] = rand_range(r2->position[dim_y],
+  e2[dim_y] = rand_range(rng, r2->position[dim_y],
                          r2->position[dim_y] + r2->size[dim_y] - 1);
-  e2[dim_x] = rand_range(r2->position[dim_x],
+  e2[dim_x] = rand_range(rng, r2->position[dim_x],
                          r2->position[dim_x] + r2->size[dim_x] - 1);
 
   /*  return connect_two_points_recursive(d, e1, e2);*/
@@ -280,16 +351,22 @@ static int connect_two_rooms(dungeon_t *d, room_t *r1, room_t *r2)
   return 0;
 }
 
-static int create_cycle(dungeon_t *d)
+static int create_cycle(dungeon_t *d, uint32_t first, uint32_t last)
 {
-  /* Find the (approximately) farthest two rooms, then connect *
-   * them by the shortest path using inverted hardnesses.      */
+  /* Find the (approximately) farthest two rooms of those in [first, *
+   * last), then connect them by the shortest path using inverted    *
+   * hardnesses.                                                     */
 
   uint32_t max, tmp, i, j, p, q;
   pair_t e1, e2;
+  rng_t *rng;
+
+  if (last - first < 2) {
+    return 0;
+  }
 
-  for (i = max = 0; i < d->num_rooms - 1; i++) {
-    for (j = i + 1; j < d->num_rooms; j++) {
+  for (i = first, max = 0; i < last - 1; i++) {
+    for (j = i + 1; j < last; j++) {
       tmp = (((d->rooms[i].position[dim_x] - d->rooms[j].position[dim_x])  *
               (d->rooms[i].position[dim_x] - d->rooms[j].position[dim_x])) +
              ((d->rooms[i].position[dim_y] - d->rooms[j].position[dim_y])  *
@@ -304,16 +381,17 @@ static int create_cycle(dungeon_t *d)
 
   /* Can't simply call connect_two_rooms() because it doesn't *
    * use inverse hardnesses, so duplicate it here.            */
-  e1[dim_y] = rand_range(d->rooms[p].position[dim_y],
+  rng = &d->rng[rng_generation];
+  e1[dim_y] = rand_range(rng, d->rooms[p].position[dim_y],
                          (d->rooms[p].position[dim_y] +
                           d->rooms[p].size[dim_y] - 1));
-  e1[dim_x] = rand_range(d->rooms[p].position[dim_x],
+  e1[dim_x] = rand_range(rng, d->rooms[p].position[dim_x],
                          (d->rooms[p].position[dim_x] +
                           d->rooms[p].size[dim_x] - 1));
-  e2[dim_y] = rand_range(d->rooms[q].position[dim_y],
+  e2[dim_y] = rand_range(rng, d->rooms[q].position[dim_y],
                          (d->rooms[q].position[dim_y] +
                           d->rooms[q].size[dim_y] - 1));
-  e2[dim_x] = rand_range(d->rooms[q].position[dim_x],
+  e2[dim_x] = rand_range(rng, d->rooms[q].position[dim_x],
                          (d->rooms[q].position[dim_x] +
                           d->rooms[q].size[dim_x] - 1));
 
@@ -322,185 +400,371 @@ static int create_cycle(dungeon_t *d)
   return 0;
 }
 
+/* Bands of DUNGEON_Y rows, left to right and then right to left. */
+static int compare_room_band(const void *v1, const void *v2)
+{
+  const room_t *r1 = (const room_t *) v1;
+  const room_t *r2 = (const room_t *) v2;
+  int32_t band;
+
+  if ((band = r1->position[dim_y] / DUNGEON_Y) !=
+      r2->position[dim_y] / DUNGEON_Y) {
+    return band - r2->position[dim_y] / DUNGEON_Y;
+  }
+  if (r1->position[dim_x] != r2->position[dim_x]) {
+    return ((band & 1 ? -1 : 1) *
+            (r1->position[dim_x] - r2->position[dim_x]));
+  }
+  return r1->position[dim_y] - r2->position[dim_y];
+}
+
 static int connect_rooms(dungeon_t *d)
 {
-  uint32_t i;
+  uint32_t i, k, scale;
+
+  /* Rooms are placed at random, so consecutive rooms can be anywhere.   *
+   * That's fine on a default-sized map, but on a bigger one, it means   *
+   * thousands of corridors across the whole map, so rooms are connected *
+   * in a sweep across it instead.                                       */
+  scale = dungeon_scale(d);
+  if (scale > 1) {
+    qsort(d->rooms, d->num_rooms, sizeof (*d->rooms), compare_room_band);
+  }
 
   for (i = 1; i < d->num_rooms; i++) {
     connect_two_rooms(d, d->rooms + i - 1, d->rooms + i);
   }
 
-  create_cycle(d);
+  /* A big map gets a cycle for each run of the sweep holding as many *
+   * rooms as a default-sized map would, rather than one across the   *
+   * whole map.                                                       */
+  for (k = 0; k < scale; k++) {
+    create_cycle(d, k * d->num_rooms / scale,
+                 (k + 1) * d->num_rooms / scale);
+  }
 
   return 0;
 }
 
-int gaussian[5][5] = {
-  {  1,  4,  7,  4,  1 },
-  {  4, 16, 26, 16,  4 },
-  {  7, 26, 41, 26,  7 },
-  {  4, 16, 26, 16,  4 },
-  {  1,  4,  7,  4,  1 }
-};
+/* The hardness map is blurred with this 5x5 kernel:                  *
+ *                                                                    *
+ *    1  4  7  4  1                                                   *
+ *    4 16 26 16  4                                                   *
+ *    7 26 41 26  7                                                   *
+ *    4 16 26 16  4                                                   *
+ *    1  4  7  4  1                                                   *
+ *                                                                    *
+ * which isn't quite separable, but it is the outer product of        *
+ * 1 4 7 4 1 with itself, minus 2 on the three center cells of the    *
+ * middle row, 2 on the three center cells of the middle column, and  *
+ * 4 more on the center.  So two 1-D passes and a little correction   *
+ * give exactly the sums the 2-D kernel does.  Cells off of the map   *
+ * count as zero, and each sum is divided by the weight of the taps   *
+ * that fell on the map.                                              */
+#define SMOOTH_PAD 2
+
+/* Rows of h5 and h3 are rounded up to a whole number of 16-cell blocks, *
+ * and rows of in have room for the loads past the end of the last one.  */
+typedef struct smooth_grid {
+  uint32_t width, height;
+  uint32_t stride;
+  uint32_t in_stride;
+  /* The hardness, padded with SMOOTH_PAD cells of zero all around. */
+  int32_t *in;
+  /* Row sums, weighted 1 4 7 4 1 and 1 1 1, of the padded rows. */
+  int32_t *h5;
+  int32_t *h3;
+  /* The weight of the on-map taps is y_weight * x_weight - x_center - *
+   * y_center - 4, where the centers are twice the number of on-map    *
+   * cells under the 1 1 1 taps.                                       */
+  float *x_weight;
+  float *x_center;
+  float *y_weight;
+  float *y_center;
+} smooth_grid_t;
+
+#define smooth_in(g, r, x) ((g)->in + (r) * (g)->in_stride + (x))
+#define smooth_h5(g, r, x) ((g)->h5 + (r) * (g)->stride + (x))
+#define smooth_h3(g, r, x) ((g)->h3 + (r) * (g)->stride + (x))
+
+static const int32_t gaussian[5] = { 1, 4, 7, 4, 1 };
+
+static void smooth_weights(float *weight, float *center, int32_t n)
+{
+  int32_t i, j;
+
+  for (i = 0; i < n; i++) {
+    for (weight[i] = j = 0; j < 5; j++) {
+      if (i + j - 2 >= 0 && i + j - 2 < n) {
+        weight[i] += gaussian[j];
+      }
+    }
+    center[i] = 2 * ((i > 0) + 1 + (i < n - 1));
+  }
+}
+
+/* One output cell, in integers. */
+static inline uint8_t smooth_one(smooth_grid_t *g, uint32_t y, uint32_t x)
+{
+  uint32_t r;
+  int32_t t, s;
+
+  r = y + SMOOTH_PAD;
+  t = (*smooth_h5(g, r - 2, x) + 4 * *smooth_h5(g, r - 1, x) +
+       7 * *smooth_h5(g, r, x) + 4 * *smooth_h5(g, r + 1, x) +
+       *smooth_h5(g, r + 2, x) - 2 * *smooth_h3(g, r, x) -
+       2 * (*smooth_in(g, r - 1, x + SMOOTH_PAD) +
+            *smooth_in(g, r, x + SMOOTH_PAD) +
+            *smooth_in(g, r + 1, x + SMOOTH_PAD)) -
+       4 * *smooth_in(g, r, x + SMOOTH_PAD));
+  s = (g->y_weight[y] * g->x_weight[x] - g->x_center[x] -
+       g->y_center[y] - 4);
+
+  return t / s;
+}
+
+#ifdef SMOOTH_SSE2
+
+static void smooth_rows(smooth_grid_t *g)
+{
+  __m128i p0, p1, p2, p3, p4, q;
+  uint32_t r, x;
+  int32_t *in;
+
+  for (r = 0; r < g->height + 2 * SMOOTH_PAD; r++) {
+    in = smooth_in(g, r, 0);
+    for (x = 0; x < g->stride; x += 4) {
+      p0 = _mm_loadu_si128((__m128i *) &in[x]);
+      p1 = _mm_loadu_si128((__m128i *) &in[x + 1]);
+      p2 = _mm_loadu_si128((__m128i *) &in[x + 2]);
+      p3 = _mm_loadu_si128((__m128i *) &in[x + 3]);
+      p4 = _mm_loadu_si128((__m128i *) &in[x + 4]);
+      q = _mm_add_epi32(p1, p3);
+      _mm_storeu_si128((__m128i *) smooth_h3(g, r, x), _mm_add_epi32(q, p2));
+      _mm_storeu_si128((__m128i *) smooth_h5(g, r, x),
+                       _mm_add_epi32(
+                         _mm_add_epi32(_mm_add_epi32(p0, p4),
+                                       _mm_slli_epi32(q, 2)),
+                         _mm_sub_epi32(_mm_slli_epi32(p2, 3), p2)));
+    }
+  }
+}
+
+/* Four columns of one output row, as 32-bit sums divided by the weight *
+ * in single precision; the sums are small enough that the truncated    *
+ * quotient is exactly the integer one.                                 */
+static inline __m128i smooth_four(smooth_grid_t *g, uint32_t y, uint32_t x)
+{
+  __m128i t, c, v;
+  __m128 s;
+  uint32_t r;
+
+  r = y + SMOOTH_PAD;
+  t = _mm_add_epi32(
+        _mm_add_epi32(_mm_loadu_si128((__m128i *) smooth_h5(g, r - 2, x)),
+                      _mm_loadu_si128((__m128i *) smooth_h5(g, r + 2, x))),
+        _mm_slli_epi32(
+          _mm_add_epi32(_mm_loadu_si128((__m128i *) smooth_h5(g, r - 1, x)),
+                        _mm_loadu_si128((__m128i *) smooth_h5(g, r + 1, x))),
+          2));
+  v = _mm_loadu_si128((__m128i *) smooth_h5(g, r, x));
+  t = _mm_add_epi32(t, _mm_sub_epi32(_mm_slli_epi32(v, 3), v));
+
+  c = _mm_loadu_si128((__m128i *) smooth_in(g, r, x + SMOOTH_PAD));
+  v = _mm_add_epi32(
+        _mm_add_epi32(_mm_loadu_si128((__m128i *) smooth_h3(g, r, x)),
+                      _mm_add_epi32(_mm_slli_epi32(c, 1), c)),
+        _mm_add_epi32(
+          _mm_loadu_si128((__m128i *) smooth_in(g, r - 1, x + SMOOTH_PAD)),
+          _mm_loadu_si128((__m128i *) smooth_in(g, r + 1, x + SMOOTH_PAD))));
+  t = _mm_sub_epi32(t, _mm_slli_epi32(v, 1));
+
+  s = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(g->y_weight[y]),
+                                       _mm_loadu_ps(&g->x_weight[x])),
+                            _mm_loadu_ps(&g->x_center[x])),
+                 _mm_set1_ps(g->y_center[y] + 4));
+
+  return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(t), s));
+}
+
+static void smooth_columns(dungeon_t *d, smooth_grid_t *g)
+{
+  uint32_t y, x;
+
+  for (y = 0; y < g->height; y++) {
+    for (x = 0; x + 16 <= g->width; x += 16) {
+      _mm_storeu_si128((__m128i *) &d->hardness[y][x],
+                       _mm_packus_epi16(
+                         _mm_packs_epi32(smooth_four(g, y, x),
+                                         smooth_four(g, y, x + 4)),
+                         _mm_packs_epi32(smooth_four(g, y, x + 8),
+                                         smooth_four(g, y, x + 12))));
+    }
+    for (; x < g->width; x++) {
+      d->hardness[y][x] = smooth_one(g, y, x);
+    }
+  }
+}
+
+#else
+
+static void smooth_rows(smooth_grid_t *g)
+{
+  uint32_t r, x;
+  int32_t *p;
+
+  for (r = 0; r < g->height + 2 * SMOOTH_PAD; r++) {
+    for (x = 0; x < g->width; x++) {
+      p = smooth_in(g, r, x);
+      *smooth_h5(g, r, x) = p[0] + 4 * p[1] + 7 * p[2] + 4 * p[3] + p[4];
+      *smooth_h3(g, r, x) = p[1] + p[2] + p[3];
+    }
+  }
+}
+
+static void smooth_columns(dungeon_t *d, smooth_grid_t *g)
+{
+  uint32_t y, x;
 
-typedef struct queue_node {
-  int x, y;
-  struct queue_node *next;
-} queue_node_t;
+  for (y = 0; y < g->height; y++) {
+    for (x = 0; x < g->width; x++) {
+      d->hardness[y][x] = smooth_one(g, y, x);
+    }
+  }
+}
+
+#endif
+
+/* smooth_hardness()'s working space is kept per thread, like the     *
+ * corridor search's, and only reallocated when the map size changes. *
+ * The grid's padding is zeroed then and never written again.         */
+typedef struct smooth_scratch {
+  uint32_t width, height;
+  /* Every cell is queued at most once, so the queue never wraps. */
+  std::vector<uint32_t> queue;
+  std::vector<uint8_t> diffused;
+  std::vector<int32_t> sums;
+  std::vector<float> weights;
+  smooth_grid_t grid;
+} smooth_scratch_t;
+
+static thread_local smooth_scratch_t smooth_scratch;
+
+static void smooth_size(dungeon_t *d, smooth_scratch_t *s)
+{
+  size_t in, sums;
+  smooth_grid_t *g;
+
+  if (s->width == d->width && s->height == d->height) {
+    return;
+  }
+
+  s->width = d->width;
+  s->height = d->height;
+  s->queue.assign(d->width * d->height, 0);
+  s->diffused.assign(d->width * d->height, 0);
+
+  g = &s->grid;
+  g->width = d->width;
+  g->height = d->height;
+  g->stride = (d->width + 15) & ~15;
+  g->in_stride = g->stride + 8;
+  in = (size_t) (d->height + 2 * SMOOTH_PAD) * g->in_stride;
+  sums = (size_t) (d->height + 2 * SMOOTH_PAD) * g->stride;
+  s->sums.assign(in + 2 * sums, 0);
+  s->weights.assign(2 * g->stride + 2 * d->height, 0);
+  g->in = s->sums.data();
+  g->h5 = g->in + in;
+  g->h3 = g->h5 + sums;
+  g->x_weight = s->weights.data();
+  g->x_center = g->x_weight + g->stride;
+  g->y_weight = g->x_center + g->stride;
+  g->y_center = g->y_weight + d->height;
+  smooth_weights(g->x_weight, g->x_center, d->width);
+  smooth_weights(g->y_weight, g->y_center, d->height);
+}
 
+/* Bigger maps get proportionally more seeds, each cycling through the *
+ * same values, so the rock looks the same at any size.                */
 static int smooth_hardness(dungeon_t *d)
 {
-  int32_t i, x, y;
-  int32_t s, t, p, q;
-  queue_node_t *head, *tail, *tmp;
+  int32_t i, x, y, dx, dy;
+  uint32_t head, tail, k, scale;
 #if DUMP_HARDNESS_IMAGES
   FILE *out;
 #endif
-  uint8_t hardness[DUNGEON_Y][DUNGEON_X];
-
-  memset(&hardness, 0, sizeof (hardness));
+  smooth_scratch_t *s;
+  uint8_t *hardness;
+  uint32_t *queue;
+  smooth_grid_t *g;
+
+  s = &smooth_scratch;
+  smooth_size(d, s);
+  hardness = s->diffused.data();
+  queue = s->queue.data();
+  g = &s->grid;
+  memset(hardness, 0, s->diffused.size());
 
   /* Seed with some values */
-  for (i = 1; i < 255; i += 20) {
-    do {
-      x = rand() % DUNGEON_X;
-      y = rand() % DUNGEON_Y;
-    } while (hardness[y][x]);
-    hardness[y][x] = i;
-    if (i == 1) {
-      head = tail = (queue_node_t *) malloc(sizeof (*tail));
-    } else {
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-    }
-    tail->next = NULL;
-    tail->x = x;
-    tail->y = y;
+  scale = dungeon_scale(d);
+  for (tail = k = 0; k < scale; k++) {
+    for (i = 1; i < 255; i += 20) {
+      do {
+        x = rng_under(&d->rng[rng_generation], d->width);
+        y = rng_under(&d->rng[rng_generation], d->height);
+      } while (hardness[y * d->width + x]);
+      hardness[y * d->width + x] = i;
+      queue[tail++] = y * d->width + x;
+    }
   }
 
 #if DUMP_HARDNESS_IMAGES
   out = fopen("seeded.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", DUNGEON_X, DUNGEON_Y);
-  fwrite(&hardness, sizeof (hardness), 1, out);
+  fprintf(out, "P5\n%u %u\n255\n", d->width, d->height);
+  fwrite(hardness, s->diffused.size(), 1, out);
   fclose(out);
 #endif
 
   /* Diffuse the vaules to fill the space */
-  while (head) {
-    x = head->x;
-    y = head->y;
-    i = hardness[y][x];
-
-    if (x - 1 >= 0 && y - 1 >= 0 && !hardness[y - 1][x - 1]) {
-      hardness[y - 1][x - 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x - 1;
-      tail->y = y - 1;
-    }
-    if (x - 1 >= 0 && !hardness[y][x - 1]) {
-      hardness[y][x - 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x - 1;
-      tail->y = y;
-    }
-    if (x - 1 >= 0 && y + 1 < DUNGEON_Y && !hardness[y + 1][x - 1]) {
-      hardness[y + 1][x - 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x - 1;
-      tail->y = y + 1;
-    }
-    if (y - 1 >= 0 && !hardness[y - 1][x]) {
-      hardness[y - 1][x] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x;
-      tail->y = y - 1;
-    }
-    if (y + 1 < DUNGEON_Y && !hardness[y + 1][x]) {
-      hardness[y + 1][x] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x;
-      tail->y = y + 1;
-    }
-    if (x + 1 < DUNGEON_X && y - 1 >= 0 && !hardness[y - 1][x + 1]) {
-      hardness[y - 1][x + 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x + 1;
-      tail->y = y - 1;
-    }
-    if (x + 1 < DUNGEON_X && !hardness[y][x + 1]) {
-      hardness[y][x + 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x + 1;
-      tail->y = y;
-    }
-    if (x + 1 < DUNGEON_X && y + 1 < DUNGEON_Y && !hardness[y + 1][x + 1]) {
-      hardness[y + 1][x + 1] = i;
-      tail->next = (queue_node_t *) malloc(sizeof (*tail));
-      tail = tail->next;
-      tail->next = NULL;
-      tail->x = x + 1;
-      tail->y = y + 1;
-    }
-
-    tmp = head;
-    head = head->next;
-    free(tmp);
-  }
-
-  /* And smooth it a bit with a gaussian convolution */
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      for (s = t = p = 0; p < 5; p++) {
-        for (q = 0; q < 5; q++) {
-          if (y + (p - 2) >= 0 && y + (p - 2) < DUNGEON_Y &&
-              x + (q - 2) >= 0 && x + (q - 2) < DUNGEON_X) {
-            s += gaussian[p][q];
-            t += hardness[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
-          }
-        }
-      }
-      d->hardness[y][x] = t / s;
-    }
-  }
-  /* Let's do it again, until it's smooth like Kenny G. */
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      for (s = t = p = 0; p < 5; p++) {
-        for (q = 0; q < 5; q++) {
-          if (y + (p - 2) >= 0 && y + (p - 2) < DUNGEON_Y &&
-              x + (q - 2) >= 0 && x + (q - 2) < DUNGEON_X) {
-            s += gaussian[p][q];
-            t += hardness[y + (p - 2)][x + (q - 2)] * gaussian[p][q];
-          }
+  for (head = 0; head != tail; head++) {
+    x = queue[head] % d->width;
+    y = queue[head] / d->width;
+    i = hardness[queue[head]];
+
+    for (dx = -1; dx <= 1; dx++) {
+      for (dy = -1; dy <= 1; dy++) {
+        if ((dx || dy) &&
+            x + dx >= 0 && x + dx < d->width &&
+            y + dy >= 0 && y + dy < d->height &&
+            !hardness[(y + dy) * d->width + x + dx]) {
+          hardness[(y + dy) * d->width + x + dx] = i;
+          queue[tail++] = (y + dy) * d->width + x + dx;
         }
       }
-      d->hardness[y][x] = t / s;
     }
   }
 
+  /* And smooth it a bit with a gaussian convolution.  This used to be *
+   * done twice, but both passes read the unsmoothed map, so the       *
+   * second one only ever rewrote the same values.                     */
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
+      *smooth_in(g, y + SMOOTH_PAD, x + SMOOTH_PAD) =
+        hardness[y * d->width + x];
+    }
+  }
+  smooth_rows(g);
+  smooth_columns(d, g);
+
 #if DUMP_HARDNESS_IMAGES
   out = fopen("diffused.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", DUNGEON_X, DUNGEON_Y);
-  fwrite(&hardness, sizeof (hardness), 1, out);
+  fprintf(out, "P5\n%u %u\n255\n", d->width, d->height);
+  fwrite(hardness, s->diffused.size(), 1, out);
   fclose(out);
 
   out = fopen("smoothed.pgm", "w");
-  fprintf(out, "P5\n%u %u\n255\n", DUNGEON_X, DUNGEON_Y);
-  fwrite(&d->hardness, sizeof (d->hardness), 1, out);
+  fprintf(out, "P5\n%u %u\n255\n", d->width, d->height);
+  fwrite(d->hardness.data(), d->hardness.bytes(), 1, out);
   fclose(out);
 #endif
 
@@ -509,18 +773,17 @@ static int smooth_hardness(dungeon_t *d)
 
 static int empty_dungeon(dungeon_t *d)
 {
-  uint8_t x, y;
+  uint32_t x, y;
 
   smooth_hardness(d);
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       mapxy(x, y) = ter_wall;
-      if (y == 0 || y == DUNGEON_Y - 1 ||
-          x == 0 || x == DUNGEON_X - 1) {
+      if (y == 0 || y == d->height - 1u ||
+          x == 0 || x == d->width - 1u) {
         mapxy(x, y) = ter_wall_immutable;
         hardnessxy(x, y) = 255;
       }
-      charxy(x, y) = NULL;
     }
   }
 
@@ -529,59 +792,171 @@ static int empty_dungeon(dungeon_t *d)
   return 0;
 }
 
+/* Cells taken by rooms are marked in a bitmap, so testing whether a    *
+ * room fits costs a few word operations per row rather than a look at  *
+ * every cell.  A room fits if neither it nor the one-cell gap around   *
+ * it touches another room.                                             */
+typedef struct occupancy {
+  uint32_t words;
+  std::vector<uint64_t> bits;
+  inline uint64_t *row(uint32_t y)
+  {
+    return &bits[y * words];
+  }
+} occupancy_t;
+
+/* The bits of word w that fall in columns [x0, x1). */
+static inline uint64_t occupancy_mask(uint32_t w, uint32_t x0, uint32_t x1)
+{
+  uint64_t mask;
+
+  if (x0 >= (w + 1) * 64 || x1 <= w * 64) {
+    return 0;
+  }
+  mask = ~0ULL;
+  if (x0 > w * 64) {
+    mask &= ~0ULL << (x0 - w * 64);
+  }
+  if (x1 < (w + 1) * 64) {
+    mask &= ~0ULL >> ((w + 1) * 64 - x1);
+  }
+
+  return mask;
+}
+
+/* Rooms are narrower than a word, so at most two words are involved. */
+static uint32_t room_fits(occupancy_t *o, room_t *r)
+{
+  uint32_t y, x0, x1, w0, w1;
+  uint64_t mask0, mask1;
+
+  x0 = r->position[dim_x] - 1;
+  x1 = r->position[dim_x] + r->size[dim_x] + 1;
+  w0 = x0 / 64;
+  w1 = (x1 - 1) / 64;
+  mask0 = occupancy_mask(w0, x0, x1);
+  mask1 = occupancy_mask(w1, x0, x1);
+  for (y = r->position[dim_y] - 1;
+       y < (uint32_t) r->position[dim_y] + r->size[dim_y] + 1;
+       y++) {
+    if ((o->row(y)[w0] & mask0) || (o->row(y)[w1] & mask1)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Counts every spot where the room still fits, in scan order, and *
+ * draws one of them.  Returns 0 if there are none.                */
+static uint32_t place_room_anywhere(dungeon_t *d, occupancy_t *o, room_t *r,
+                                    rng_t *rng)
+{
+  uint32_t count, pick;
+  int32_t x, y;
+
+  for (count = 0, y = 1; y < d->height - 1 - r->size[dim_y]; y++) {
+    for (x = 1; x < d->width - 1 - r->size[dim_x]; x++) {
+      r->position[dim_y] = y;
+      r->position[dim_x] = x;
+      count += room_fits(o, r);
+    }
+  }
+  if (!count) {
+    return 0;
+  }
+
+  pick = rng_under(rng, count);
+  for (y = 1; y < d->height - 1 - r->size[dim_y]; y++) {
+    for (x = 1; x < d->width - 1 - r->size[dim_x]; x++) {
+      r->position[dim_y] = y;
+      r->position[dim_x] = x;
+      if (room_fits(o, r) && !pick--) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/* Each room gets a few random tries at a spot, as it always has, and *
+ * then a spot chosen from all the places it still fits.  A room that *
+ * fits nowhere is left out of the dungeon; this never happens to the *
+ * first few rooms, so there are always enough to connect.            */
 static int place_rooms(dungeon_t *d)
 {
+  occupancy_t o;
   pair_t p;
-  uint32_t i;
-  int success;
+  uint32_t i, j, tries, w;
   room_t *r;
+  rng_t *rng;
+
+  o.words = (d->width + 63) / 64;
+  o.bits.assign(o.words * d->height, 0);
+  rng = &d->rng[rng_generation];
+
+  for (i = j = 0; i < d->num_rooms; i++) {
+    d->rooms[j] = d->rooms[i];
+    r = d->rooms + j;
+    for (tries = 0; tries < ROOM_PLACEMENT_TRIES; tries++) {
+      r->position[dim_x] = 1 + rng_under(rng, d->width - 2 - r->size[dim_x]);
+      r->position[dim_y] = 1 + rng_under(rng, d->height - 2 - r->size[dim_y]);
+      if (room_fits(&o, r)) {
+        break;
+      }
+    }
+    if (tries == ROOM_PLACEMENT_TRIES &&
+        !place_room_anywhere(d, &o, r, rng)) {
+      continue;
+    }
 
-  for (success = 0; !success; ) {
-    success = 1;
-    for (i = 0; success && i < d->num_rooms; i++) {
-      r = d->rooms + i;
-      r->position[dim_x] = 1 + rand() % (DUNGEON_X - 2 - r->size[dim_x]);
-      r->position[dim_y] = 1 + rand() % (DUNGEON_Y - 2 - r->size[dim_y]);
-      for (p[dim_y] = r->position[dim_y] - 1;
-           success && p[dim_y] < r->position[dim_y] + r->size[dim_y] + 1;
-           p[dim_y]++) {
-        for (p[dim_x] = r->position[dim_x] - 1;
-             success && p[dim_x] < r->position[dim_x] + r->size[dim_x] + 1;
-             p[dim_x]++) {
-          if (mappair(p) >= ter_floor) {
-            success = 0;
-            empty_dungeon(d);
-          } else if ((p[dim_y] != r->position[dim_y] - 1)              &&
-                     (p[dim_y] != r->position[dim_y] + r->size[dim_y]) &&
-                     (p[dim_x] != r->position[dim_x] - 1)              &&
-                     (p[dim_x] != r->position[dim_x] + r->size[dim_x])) {
-            mappair(p) = ter_floor_room;
-            hardnesspair(p) = 0;
-          }
-        }
+    for (p[dim_y] = r->position[dim_y];
+         p[dim_y] < r->position[dim_y] + r->size[dim_y];
+         p[dim_y]++) {
+      for (w = r->position[dim_x] / 64;
+           w <= (uint32_t) (r->position[dim_x] + r->size[dim_x] - 1) / 64;
+           w++) {
+        o.row(p[dim_y])[w] |=
+          occupancy_mask(w, r->position[dim_x],
+                         r->position[dim_x] + r->size[dim_x]);
+      }
+      for (p[dim_x] = r->position[dim_x];
+           p[dim_x] < r->position[dim_x] + r->size[dim_x];
+           p[dim_x]++) {
+        mappair(p) = ter_floor_room;
+        hardnesspair(p) = 0;
       }
     }
+    j++;
   }
+  d->num_rooms = j;
 
   return 0;
 }
 
 static int make_rooms(dungeon_t *d)
 {
-  uint32_t i;
-
-  for (i = MIN_ROOMS; i < MAX_ROOMS && rand_under(6, 8); i++)
-    ;
-  d->num_rooms = i;
+  uint32_t i, k, scale;
+  rng_t *rng;
+
+  /* A big map gets as many rooms as the default-sized maps it would *
+   * take to cover it.                                               */
+  rng = &d->rng[rng_generation];
+  for (d->num_rooms = k = 0, scale = dungeon_scale(d); k < scale; k++) {
+    for (i = MIN_ROOMS; i < MAX_ROOMS && rand_under(rng, 6, 8); i++)
+      ;
+    d->num_rooms += i;
+  }
   d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
 
   for (i = 0; i < d->num_rooms; i++) {
     d->rooms[i].size[dim_x] = ROOM_MIN_X;
     d->rooms[i].size[dim_y] = ROOM_MIN_Y;
-    while (rand_under(3, 4) && d->rooms[i].size[dim_x] < ROOM_MAX_X) {
+    while (rand_under(rng, 3, 4) && d->rooms[i].size[dim_x] < ROOM_MAX_X) {
       d->rooms[i].size[dim_x]++;
     }
-    while (rand_under(3, 4) && d->rooms[i].size[dim_y] < ROOM_MAX_Y) {
+    while (rand_under(rng, 3, 4) && d->rooms[i].size[dim_y] < ROOM_MAX_Y) {
       d->rooms[i].size[dim_y]++;
     }
   }
@@ -592,32 +967,36 @@ static int make_rooms(dungeon_t *d)
 static void place_stairs(dungeon_t *d)
 {
   pair_t p;
+  rng_t *rng;
+
+  rng = &d->rng[rng_generation];
   do {
-    while ((p[dim_y] = rand_range(1, DUNGEON_Y - 2)) &&
-           (p[dim_x] = rand_range(1, DUNGEON_X - 2)) &&
-           ((mappair(p) < ter_floor)                 ||
+    while ((p[dim_y] = rand_range(rng, 1, d->height - 2)) &&
+           (p[dim_x] = rand_range(rng, 1, d->width - 2)) &&
+           ((mappair(p) < ter_floor)                      ||
             (mappair(p) > ter_stairs)))
       ;
     mappair(p) = ter_stairs_down;
-  } while (rand_under(1, 3));
+  } while (rand_under(rng, 1, 3));
   do {
-    while ((p[dim_y] = rand_range(1, DUNGEON_Y - 2)) &&
-           (p[dim_x] = rand_range(1, DUNGEON_X - 2)) &&
-           ((mappair(p) < ter_floor)                 ||
+    while ((p[dim_y] = rand_range(rng, 1, d->height - 2)) &&
+           (p[dim_x] = rand_range(rng, 1, d->width - 2)) &&
+           ((mappair(p) < ter_floor)                      ||
             (mappair(p) > ter_stairs)))
       
       ;
     mappair(p) = ter_stairs_up;
-  } while (rand_under(2, 4));
+  } while (rand_under(rng, 2, 4));
 }
 
 static void gen_marketplace(dungeon_t *d)
 {
   pair_t p;
   room_t *r = d->rooms;
+  rng_t *rng = &d->rng[rng_generation];
   do {
-    p[dim_y] = rand_range(r->position[dim_y], (r->position[dim_y] + r->size[dim_y] - 1));
-    p[dim_x] = rand_range(r->position[dim_x], (r->position[dim_x] + r->size[dim_x] - 1));
+    p[dim_y] = rand_range(rng, r->position[dim_y], (r->position[dim_y] + r->size[dim_y] - 1));
+    p[dim_x] = rand_range(rng, r->position[dim_x], (r->position[dim_x] + r->size[dim_x] - 1));
   } while (mappair(p) != ter_floor_room);
 
   mappair(p) = ter_marketplace;
@@ -639,329 +1018,458 @@ int gen_dungeon(dungeon_t *d)
 void delete_dungeon(dungeon_t *d)
 {
   free(d->rooms);
-  heap_delete(&d->events);
-  memset(d->character_map, 0, sizeof (d->character_map));
+  while (!d->events.empty()) {
+    event_delete(d, d->events.pop());
+  }
+  d->character_map.clear();
   destroy_objects(d);
+  path_context_delete(d);
+  chunk_context_delete(d);
 }
 
-void init_dungeon(dungeon_t *d)
+void reset_level(dungeon_t *d)
 {
-  empty_dungeon(d);
-  memset(&d->events, 0, sizeof (d->events));
-  heap_init(&d->events, compare_events, event_delete);
+  d->events.clear();
+  memset(d->census, 0, sizeof (d->census));
+  d->event_sequence_number = 0;
+  d->paths = NULL;
+  d->chunks = NULL;
+  dijkstra_invalidate(d);
 }
 
-int write_dungeon_map(dungeon_t *d, FILE *f)
+uint32_t dungeon_scale(dungeon_t *d)
 {
-  uint32_t x, y;
+  uint32_t scale;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      fwrite(&d->hardness[y][x], sizeof (unsigned char), 1, f);
-    }
+  scale = (d->width * d->height) / (DUNGEON_X * DUNGEON_Y);
+
+  return scale ? scale : 1;
+}
+
+/* Maps large enough to page are backed by files.  If that fails, *
+ * they go on the heap like everything else.                      */
+template <typename T>
+static void size_grid(dungeon_t *d, grid<T> &g)
+{
+  const char *dir;
+
+  if (!(dir = chunk_directory(d)) || g.back(d->width, d->height, dir)) {
+    g.resize(d->width, d->height);
   }
+}
 
-  return 0;
+static void size_terrain(dungeon_t *d)
+{
+  if (!d->width || !d->height) {
+    d->width = DUNGEON_X;
+    d->height = DUNGEON_Y;
+  }
+  size_grid(d, d->map);
+  size_grid(d, d->hardness);
 }
 
-int write_rooms(dungeon_t *d, FILE *f)
+void init_dungeon(dungeon_t *d)
+{
+  size_terrain(d);
+  d->pc_distance.resize(d->width, d->height);
+  d->pc_tunnel.resize(d->width, d->height);
+  size_grid(d, d->character_map);
+  size_grid(d, d->objmap);
+  empty_dungeon(d);
+  reset_level(d);
+}
+
+void seed_dungeon(dungeon_t *d, uint64_t seed)
 {
   uint32_t i;
-  uint8_t p;
 
-  for (i = 0; i < d->num_rooms; i++) {
-    /* write order is xpos, ypos, width, height */
-    p = d->rooms[i].position[dim_y];
-    fwrite(&p, 1, 1, f);
-    p = d->rooms[i].position[dim_x];
-    fwrite(&p, 1, 1, f);
-    p = d->rooms[i].size[dim_y];
-    fwrite(&p, 1, 1, f);
-    p = d->rooms[i].size[dim_x];
-    fwrite(&p, 1, 1, f);
+  for (i = 0; i < num_rng_streams; i++) {
+    rng_seed(&d->rng[i], seed, i);
   }
-
-  return 0;
 }
 
+/* The semantic, version, and size. */
+#define DUNGEON_SAVE_HEADER 20
+
 uint32_t calculate_dungeon_size(dungeon_t *d)
 {
-  return (20 /* The semantic, version, and size */     +
-          (DUNGEON_X * DUNGEON_Y) /* The hardnesses */ +
+  return (DUNGEON_SAVE_HEADER                         +
+          (d->width * d->height) /* The hardnesses */ +
           (d->num_rooms * 4) /* Four bytes per room */);
 }
 
-int write_dungeon(dungeon_t *d, char *file)
+int store_dungeon(dungeon_t *d, const char *file, const char **error)
 {
-  const char *home;
-  char *filename;
+  std::vector<uint8_t> rooms;
+  uint32_t be32, i;
   FILE *f;
-  size_t len;
-  uint32_t be32;
 
-  if (!file) {
-    if (!(home = getenv("HOME"))) {
-      fprintf(stderr, "\"HOME\" is undefined.  Using working directory.\n");
-      home = ".";
-    }
-
-    len = (strlen(home) + strlen(SAVE_DIR) + strlen(DUNGEON_SAVE_FILE) +
-           1 /* The NULL terminator */                                 +
-           2 /* The slashes */);
-
-    filename = (char *) malloc(len * sizeof (*filename));
-    sprintf(filename, "%s/%s/", home, SAVE_DIR);
-    makedirectory(filename);
-    strcat(filename, DUNGEON_SAVE_FILE);
-
-    if (!(f = fopen(filename, "w"))) {
-      perror(filename);
-      free(filename);
+  /* Room positions are single bytes, too. */
+  if (d->width != DUNGEON_X || d->height != DUNGEON_Y) {
+    *error = "Version 0 save files only hold default-sized dungeons.";
+    return -1;
+  }
 
-      return 1;
-    }
-    free(filename);
-  } else {
-    if (!(f = fopen(file, "w"))) {
-      perror(file);
-      exit(-1);
-    }
+  if (!(f = fopen(file, "w"))) {
+    *error = strerror(errno);
+    return -1;
   }
 
-  /* The semantic, which is 6 bytes, 0-5 */
+  /* The semantic, which is 12 bytes, 0-11 */
   fwrite(DUNGEON_SAVE_SEMANTIC, 1, sizeof (DUNGEON_SAVE_SEMANTIC) - 1, f);
 
-  /* The version, 4 bytes, 6-9 */
+  /* The version, 4 bytes, 12-15 */
   be32 = htobe32(DUNGEON_SAVE_VERSION);
   fwrite(&be32, sizeof (be32), 1, f);
 
-  /* The size of the file, 4 bytes, 10-13 */
+  /* The size of the file, 4 bytes, 16-19 */
   be32 = htobe32(calculate_dungeon_size(d));
   fwrite(&be32, sizeof (be32), 1, f);
 
-  /* The dungeon map, 1680 bytes, 14-1693 */
-  write_dungeon_map(d, f);
+  /* The dungeon map, 1680 bytes, 20-1699, row by row as it's stored */
+  fwrite(d->hardness.data(), 1, d->hardness.size(), f);
 
-  /* And the rooms, num_rooms * 4 bytes, 1694-end */
-  write_rooms(d, f);
+  /* And the rooms, num_rooms * 4 bytes, 1700-end.  Write order is *
+   * ypos, xpos, height, width.                                    */
+  rooms.resize(d->num_rooms * 4);
+  for (i = 0; i < d->num_rooms; i++) {
+    rooms[i * 4] = d->rooms[i].position[dim_y];
+    rooms[i * 4 + 1] = d->rooms[i].position[dim_x];
+    rooms[i * 4 + 2] = d->rooms[i].size[dim_y];
+    rooms[i * 4 + 3] = d->rooms[i].size[dim_x];
+  }
+  fwrite(rooms.data(), 1, rooms.size(), f);
 
-  fclose(f);
+  if (ferror(f) | fclose(f)) {
+    *error = "Write failed.";
+    return -1;
+  }
 
   return 0;
 }
 
-int read_dungeon_map(dungeon_t *d, FILE *f)
+int write_dungeon(dungeon_t *d, char *file)
 {
-  uint32_t x, y;
+  const char *home, *error;
+  std::string filename;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      fread(&d->hardness[y][x], sizeof (d->hardness[y][x]), 1, f);
-      if (d->hardness[y][x] == 0) {
-        /* Mark it as a corridor.  We can't recognize room cells until *
-         * after we've read the room array, which we haven't done yet. */
-        d->map[y][x] = ter_floor_hall;
-      } else if (d->hardness[y][x] == 255) {
-        d->map[y][x] = ter_wall_immutable;
-      } else {
-        d->map[y][x] = ter_wall;
-      }
+  if (!file) {
+    if (!(home = getenv("HOME"))) {
+      fprintf(stderr, "\"HOME\" is undefined.  Using working directory.\n");
+      home = ".";
     }
-  }
 
+    filename = std::string(home) + "/" + SAVE_DIR + "/";
+    makedirectory((char *) filename.c_str());
+    filename += DUNGEON_SAVE_FILE;
+
+    if (store_dungeon(d, filename.c_str(), &error)) {
+      fprintf(stderr, "%s: %s\n", filename.c_str(), error);
+
+      return 1;
+    }
+  } else if (store_dungeon(d, file, &error)) {
+    fprintf(stderr, "%s: %s\n", file, error);
+    exit(-1);
+  }
 
   return 0;
 }
 
-int read_rooms(dungeon_t *d, FILE *f)
+/* Every cell of a loaded map is a hall, a wall, or the immutable    *
+ * border, by its hardness alone; rooms are painted in afterward.    *
+ * Terrain is a byte, so sixteen cells are classified at a time.     */
+static void classify_terrain(dungeon_t *d)
+{
+  const uint8_t *h;
+  uint8_t *m;
+  size_t i, n;
+
+  h = d->hardness.data();
+  m = (uint8_t *) d->map.data();
+  n = d->map.size();
+  i = 0;
+
+#ifdef CLASSIFY_SSE2
+  __m128i v, open, rock, zero, full, hall, wall, border;
+
+  zero = _mm_setzero_si128();
+  full = _mm_set1_epi8((char) 255);
+  hall = _mm_set1_epi8(ter_floor_hall);
+  wall = _mm_set1_epi8(ter_wall);
+  border = _mm_set1_epi8(ter_wall_immutable);
+  for (; i + 16 <= n; i += 16) {
+    v = _mm_loadu_si128((__m128i *) (h + i));
+    open = _mm_cmpeq_epi8(v, zero);
+    rock = _mm_cmpeq_epi8(v, full);
+    _mm_storeu_si128((__m128i *) (m + i),
+                     _mm_or_si128(_mm_andnot_si128(_mm_or_si128(open, rock),
+                                                   wall),
+                                  _mm_or_si128(_mm_and_si128(open, hall),
+                                               _mm_and_si128(rock, border))));
+  }
+#endif
+
+  for (; i < n; i++) {
+    m[i] = (!h[i] ? ter_floor_hall :
+            (h[i] == 255 ? ter_wall_immutable : ter_wall));
+  }
+}
+
+int room_in_dungeon(dungeon_t *d, const room_t *r)
+{
+  return (r->size[dim_y] >= 1 && r->size[dim_x] >= 1           &&
+          r->position[dim_y] >= 1 && r->position[dim_x] >= 1   &&
+          r->position[dim_y] + r->size[dim_y] <= d->height - 1 &&
+          r->position[dim_x] + r->size[dim_x] <= d->width - 1);
+}
+
+int terrain_in_range(const grid<terrain_type_t> &map, uint32_t walled)
+{
+  uint32_t y, x;
+
+  for (y = 0; y < map.height(); y++) {
+    for (x = 0; x < map.width(); x++) {
+      if (map[y][x] > ter_marketplace) {
+        return 0;
+      }
+      if (walled && (!y || y == map.height() - 1 ||
+                     !x || x == map.width() - 1) &&
+          map[y][x] != ter_wall_immutable) {
+        return 0;
+      }
+    }
+  }
+
+  return 1;
+}
+
+/* Rooms are four bytes each: y and x position, then height and width. */
+static int read_rooms(dungeon_t *d, const uint8_t *p, const char **error)
 {
   uint32_t i;
-  int32_t x, y;
-  uint8_t p;
+  int32_t y;
 
-  for (i = 0; i < d->num_rooms; i++) {
-    fread(&p, 1, 1, f);
-    d->rooms[i].position[dim_y] = p;
-    fread(&p, 1, 1, f);
-    d->rooms[i].position[dim_x] = p;
-    fread(&p, 1, 1, f);
-    d->rooms[i].size[dim_y] = p;
-    fread(&p, 1, 1, f);
-    d->rooms[i].size[dim_x] = p;
+  for (i = 0; i < d->num_rooms; i++, p += 4) {
+    d->rooms[i].position[dim_y] = p[0];
+    d->rooms[i].position[dim_x] = p[1];
+    d->rooms[i].size[dim_y] = p[2];
+    d->rooms[i].size[dim_x] = p[3];
 
     if (d->rooms[i].size[dim_x] < 1             ||
         d->rooms[i].size[dim_y] < 1             ||
-        d->rooms[i].size[dim_x] > DUNGEON_X - 1 ||
-        d->rooms[i].size[dim_y] > DUNGEON_X - 1) {
-      fprintf(stderr, "Invalid room size in restored dungeon.\n");
-
-      exit(-1);
+        d->rooms[i].size[dim_x] > d->width - 1  ||
+        d->rooms[i].size[dim_y] > d->width - 1) {
+      *error = "Invalid room size in restored dungeon.";
+      return -1;
     }
 
     if (d->rooms[i].position[dim_x] < 1                                       ||
         d->rooms[i].position[dim_y] < 1                                       ||
-        d->rooms[i].position[dim_x] > DUNGEON_X - 1                           ||
-        d->rooms[i].position[dim_y] > DUNGEON_Y - 1                           ||
-        d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] > DUNGEON_X - 1 ||
+        d->rooms[i].position[dim_x] > d->width - 1                            ||
+        d->rooms[i].position[dim_y] > d->height - 1                           ||
+        d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] > d->width - 1  ||
         d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x] < 0             ||
-        d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] > DUNGEON_Y - 1 ||
+        d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] > d->height - 1 ||
         d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y] < 0)             {
-      fprintf(stderr, "Invalid room position in restored dungeon.\n");
-
-      exit(-1);
+      *error = "Invalid room position in restored dungeon.";
+      return -1;
     }
-        
 
     /* After reading each room, we need to reconstruct them in the dungeon. */
     for (y = d->rooms[i].position[dim_y];
          y < d->rooms[i].position[dim_y] + d->rooms[i].size[dim_y];
          y++) {
-      for (x = d->rooms[i].position[dim_x];
-           x < d->rooms[i].position[dim_x] + d->rooms[i].size[dim_x];
-           x++) {
-        mapxy(x, y) = ter_floor_room;
-      }
+      memset(&mapxy(d->rooms[i].position[dim_x], y), ter_floor_room,
+             d->rooms[i].size[dim_x]);
     }
   }
 
   return 0;
 }
 
-int calculate_num_rooms(uint32_t dungeon_bytes)
+/* The header is checked in place and the hardness copied out whole; *
+ * in a version 0 file it's laid out row by row, just as the map is. */
+static int load_mapped(dungeon_t *d, const uint8_t *p, off_t size,
+                       const char **error)
 {
-  return ((dungeon_bytes -
-          (20 /* The semantic, version, and size */       +
-           (DUNGEON_X * DUNGEON_Y) /* The hardnesses */)) /
-          4 /* Four bytes per room */);
+  uint32_t be32, version;
+
+  if (size < DUNGEON_SAVE_HEADER ||
+      memcmp(p, DUNGEON_SAVE_SEMANTIC, sizeof (DUNGEON_SAVE_SEMANTIC) - 1)) {
+    *error = "Not an RLG327 save file.";
+    return -1;
+  }
+
+  memcpy(&be32, p + 12, sizeof (be32));
+  version = be32toh(be32);
+  if (version == GAME_SAVE_VERSION) {
+    return GAME_SAVE_VERSION;
+  }
+  if (version != DUNGEON_SAVE_VERSION) {
+    *error = "File version mismatch.";
+    return -1;
+  }
+
+  if (d->width != DUNGEON_X || d->height != DUNGEON_Y) {
+    *error = "Version 0 save files only hold default-sized dungeons.";
+    return -1;
+  }
+
+  memcpy(&be32, p + 16, sizeof (be32));
+  if (size != be32toh(be32) ||
+      size < (off_t) (DUNGEON_SAVE_HEADER + d->hardness.size()) ||
+      (size - DUNGEON_SAVE_HEADER - d->hardness.size()) % 4) {
+    *error = "File size mismatch.";
+    return -1;
+  }
+  memcpy(d->hardness.data(), p + DUNGEON_SAVE_HEADER, d->hardness.size());
+  classify_terrain(d);
+  d->num_rooms = ((size - DUNGEON_SAVE_HEADER - d->hardness.size()) /
+                  4 /* Four bytes per room */);
+  d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
+  if (read_rooms(d, p + DUNGEON_SAVE_HEADER + d->hardness.size(), error)) {
+    free(d->rooms);
+    d->rooms = NULL;
+    d->num_rooms = 0;
+
+    return -1;
+  }
+
+  return DUNGEON_SAVE_VERSION;
+}
+
+/* The file is mapped rather than read through a stream. */
+int load_dungeon(dungeon_t *d, const char *file, const char **error)
+{
+  struct stat buf;
+  const uint8_t *p;
+  int fd, version;
+
+  if ((fd = open(file, O_RDONLY)) < 0) {
+    *error = strerror(errno);
+    return -1;
+  }
+  if (fstat(fd, &buf)) {
+    *error = strerror(errno);
+    close(fd);
+
+    return -1;
+  }
+  if (!buf.st_size) {
+    close(fd);
+    *error = "Not an RLG327 save file.";
+
+    return -1;
+  }
+  if ((p = (const uint8_t *) mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE,
+                                  fd, 0)) == MAP_FAILED) {
+    *error = strerror(errno);
+    close(fd);
+
+    return -1;
+  }
+
+  version = load_mapped(d, p, buf.st_size, error);
+
+  munmap((void *) p, buf.st_size);
+  close(fd);
+
+  return version;
 }
 
 int read_dungeon(dungeon_t *d, char *file)
 {
-  char semantic[sizeof (DUNGEON_SAVE_SEMANTIC)];
+  std::string filename;
+  const char *home, *error;
   uint32_t be32;
+  int version;
   FILE *f;
-  const char *home;
-  size_t len;
-  char *filename;
-  struct stat buf;
 
   if (!file) {
     if (!(home = getenv("HOME"))) {
       fprintf(stderr, "\"HOME\" is undefined.  Using working directory.\n");
       home = ".";
     }
+    filename = std::string(home) + "/" + SAVE_DIR + "/" + DUNGEON_SAVE_FILE;
+    file = (char *) filename.c_str();
+  }
 
-    len = (strlen(home) + strlen(SAVE_DIR) + strlen(DUNGEON_SAVE_FILE) +
-           1 /* The NULL terminator */                                 +
-           2 /* The slashes */);
-
-    filename = (char *) malloc(len * sizeof (*filename));
-    sprintf(filename, "%s/%s/%s", home, SAVE_DIR, DUNGEON_SAVE_FILE);
-
-    if (!(f = fopen(filename, "r"))) {
-      perror(filename);
-      free(filename);
-      exit(-1);
-    }
-
-    if (stat(filename, &buf)) {
-      perror(filename);
-      exit(-1);
-    }
+  if ((version = load_dungeon(d, file, &error)) < 0) {
+    fprintf(stderr, "%s: %s\n", file, error);
+    exit(-1);
+  }
 
-    free(filename);
-  } else {
-    if (!(f = fopen(file, "r"))) {
-      perror(file);
-      exit(-1);
-    }
-    if (stat(file, &buf)) {
+  /* Whole games are read a section at a time instead; the section *
+   * count is the last word of the header.                         */
+  if (version == GAME_SAVE_VERSION) {
+    if (!(f = fopen(file, "r"))                                   ||
+        fseek(f, DUNGEON_SAVE_HEADER - sizeof (be32), SEEK_SET)   ||
+        fread(&be32, sizeof (be32), 1, f) != 1) {
       perror(file);
       exit(-1);
     }
+    read_game(d, f, be32toh(be32));
+    fclose(f);
   }
 
-  d->num_rooms = 0;
-
-  fread(semantic, sizeof (DUNGEON_SAVE_SEMANTIC) - 1, 1, f);
-  semantic[sizeof (DUNGEON_SAVE_SEMANTIC) - 1] = '\0';
-  if (strncmp(semantic, DUNGEON_SAVE_SEMANTIC,
-	      sizeof (DUNGEON_SAVE_SEMANTIC) - 1)) {
-    fprintf(stderr, "Not an RLG327 save file.\n");
-    exit(-1);
-  }
-  fread(&be32, sizeof (be32), 1, f);
-  if (be32toh(be32) != 0) { /* Since we expect zero, be32toh() is a no-op. */
-    fprintf(stderr, "File version mismatch.\n");
-    exit(-1);
-  }
-  fread(&be32, sizeof (be32), 1, f);
-  if (buf.st_size != be32toh(be32)) {
-    fprintf(stderr, "File size mismatch.\n");
-    exit(-1);
-  }
-  read_dungeon_map(d, f);
-  d->num_rooms = calculate_num_rooms(buf.st_size);
-  d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
-  read_rooms(d, f);
-
-  fclose(f);
-
-  return 0;
+  return version;
 }
 
-int read_pgm(dungeon_t *d, char *pgm)
+int load_pgm(dungeon_t *d, const char *pgm, const char **error)
 {
   FILE *f;
   char s[80];
-  uint8_t gm[DUNGEON_Y - 2][DUNGEON_X - 2];
-  uint32_t x, y;
+  std::vector<uint8_t> image;
+  uint8_t *gm;
+  uint32_t x, y, w, h;
   uint32_t i;
-  char size[8]; /* Big enough to hold two 3-digit values with a space between. */
 
   if (!(f = fopen(pgm, "r"))) {
-    perror(pgm);
-    exit(-1);
+    *error = strerror(errno);
+    return -1;
   }
 
+  *error = NULL;
   if (!fgets(s, 80, f) || strncmp(s, "P5", 2)) {
-    fprintf(stderr, "Expected P5\n");
-    exit(-1);
-  }
-  if (!fgets(s, 80, f) || s[0] != '#') {
-    fprintf(stderr, "Expected comment\n");
-    exit(-1);
-  }
-  snprintf(size, 8, "%d %d", DUNGEON_X - 2, DUNGEON_Y - 2);
-  if (!fgets(s, 80, f) || strncmp(s, size, 5)) {
-    fprintf(stderr, "Expected %s\n", size);
-    exit(-1);
-  }
-  if (!fgets(s, 80, f) || strncmp(s, "255", 2)) {
-    fprintf(stderr, "Expected 255\n");
-    exit(-1);
+    *error = "Expected P5";
+  } else if (!fgets(s, 80, f) || s[0] != '#') {
+    *error = "Expected comment";
+  } else if (!fgets(s, 80, f) || sscanf(s, "%u %u", &w, &h) != 2 ||
+             /* The image is the dungeon without its border. */
+             w != d->width - 2u || h != d->height - 2u) {
+    *error = "Expected an image the size of the dungeon, less its border";
+  } else if (!fgets(s, 80, f) || strncmp(s, "255", 2)) {
+    *error = "Expected 255";
+  } else {
+    image.resize(w * h);
+    if (fread(image.data(), 1, w * h, f) != w * h) {
+      *error = "Image is truncated";
+    }
   }
 
-  fread(gm, 1, (DUNGEON_X - 2) * (DUNGEON_Y - 2), f);
-
   fclose(f);
+  if (*error) {
+    return -1;
+  }
+  gm = image.data();
 
   /* In our gray map, treat black (0) as corridor, white (255) as room, *
    * all other values as a hardness.  For simplicity, treat every white *
    * cell as its own room, so we have to count white after reading the  *
    * image in order to allocate the room array.                         */
-  for (d->num_rooms = 0, y = 0; y < DUNGEON_Y - 2; y++) {
-    for (x = 0; x < DUNGEON_X - 2; x++) {
-      if (!gm[y][x]) {
+  for (d->num_rooms = 0, y = 0; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      if (!gm[y * w + x]) {
         d->num_rooms++;
       }
     }
   }
   d->rooms = (room_t *) malloc(sizeof (*d->rooms) * d->num_rooms);
 
-  for (i = 0, y = 0; y < DUNGEON_Y - 2; y++) {
-    for (x = 0; x < DUNGEON_X - 2; x++) {
-      if (!gm[y][x]) {
+  for (i = 0, y = 0; y < h; y++) {
+    for (x = 0; x < w; x++) {
+      if (!gm[y * w + x]) {
         d->rooms[i].position[dim_x] = x + 1;
         d->rooms[i].position[dim_y] = y + 1;
         d->rooms[i].size[dim_x] = 1;
@@ -969,45 +1477,150 @@ int read_pgm(dungeon_t *d, char *pgm)
         i++;
         d->map[y + 1][x + 1] = ter_floor_room;
         d->hardness[y + 1][x + 1] = 0;
-      } else if (gm[y][x] == 255) {
+      } else if (gm[y * w + x] == 255) {
         d->map[y + 1][x + 1] = ter_floor_hall;
         d->hardness[y + 1][x + 1] = 0;
       } else {
         d->map[y + 1][x + 1] = ter_wall;
-        d->hardness[y + 1][x + 1] = gm[y][x];
+        d->hardness[y + 1][x + 1] = gm[y * w + x];
       }
     }
   }
 
-  for (x = 0; x < DUNGEON_X; x++) {
+  for (x = 0; x < d->width; x++) {
     d->map[0][x] = ter_wall_immutable;
     d->hardness[0][x] = 255;
-    d->map[DUNGEON_Y - 1][x] = ter_wall_immutable;
-    d->hardness[DUNGEON_Y - 1][x] = 255;
+    d->map[d->height - 1][x] = ter_wall_immutable;
+    d->hardness[d->height - 1][x] = 255;
   }
-  for (y = 1; y < DUNGEON_Y - 1; y++) {
+  for (y = 1; y < d->height - 1u; y++) {
     d->map[y][0] = ter_wall_immutable;
     d->hardness[y][0] = 255;
-    d->map[y][DUNGEON_X - 1] = ter_wall_immutable;
-    d->hardness[y][DUNGEON_X - 1] = 255;
+    d->map[y][d->width - 1] = ter_wall_immutable;
+    d->hardness[y][d->width - 1] = 255;
   }
 
   return 0;
 }
 
+int read_pgm(dungeon_t *d, char *pgm)
+{
+  const char *error;
+
+  if (load_pgm(d, pgm, &error)) {
+    fprintf(stderr, "%s: %s\n", pgm, error);
+    exit(-1);
+  }
+
+  return 0;
+}
+
+/* Levels after the first are generated in a dungeon of their own,      *
+ * seeded with the next draw from the level stream, so the terrain of   *
+ * every level is the same whether or not it was made ahead of time.    *
+ * Generation only touches the dungeon it's given and per-thread state, *
+ * so it can run while the current level is being played.  Monsters and *
+ * objects are still made when the PC takes the stairs, because which   *
+ * uniques and artifacts may appear depends on that play.               */
+struct level_prefetch {
+  dungeon next;
+  std::thread worker;
+  /* The level stream before the seed was drawn from it. */
+  rng_t level_stream;
+};
+
+static void generate_level(dungeon_t *next, uint64_t seed)
+{
+  seed_dungeon(next, seed);
+  gen_dungeon(next);
+}
+
+static level_prefetch_t *start_level(dungeon_t *d, uint32_t background)
+{
+  level_prefetch_t *l;
+  uint64_t seed;
+
+  l = new level_prefetch_t();
+  l->next.width = d->width;
+  l->next.height = d->height;
+  size_terrain(&l->next);
+  l->level_stream = d->rng[rng_level];
+  seed = rng_next(&d->rng[rng_level]);
+  seed = (seed << 32) | rng_next(&d->rng[rng_level]);
+  if (background) {
+    l->worker = std::thread(generate_level, &l->next, seed);
+  } else {
+    generate_level(&l->next, seed);
+  }
+
+  return l;
+}
+
+static level_prefetch_t *finish_level(dungeon_t *d)
+{
+  level_prefetch_t *l;
+
+  if ((l = d->next_level)) {
+    if (l->worker.joinable()) {
+      l->worker.join();
+    }
+    d->next_level = NULL;
+  } else {
+    l = start_level(d, 0);
+  }
+
+  return l;
+}
+
+void prefetch_level(dungeon_t *d)
+{
+  if (!d->next_level) {
+    d->next_level = start_level(d, 1);
+  }
+}
+
+void prefetch_level_stream(dungeon_t *d, rng_t *r)
+{
+  *r = d->next_level ? d->next_level->level_stream : d->rng[rng_level];
+}
+
+void prefetch_level_delete(dungeon_t *d)
+{
+  level_prefetch_t *l;
+
+  if (d->next_level) {
+    l = finish_level(d);
+    free(l->next.rooms);
+    delete l;
+  }
+}
+
 void new_dungeon(dungeon_t *d)
 {
-  uint32_t sequence_number;
+  uint32_t sequence_number, event_sequence_number;
+  level_prefetch_t *l;
 
   sequence_number = d->character_sequence_number;
+  event_sequence_number = d->event_sequence_number;
 
+  l = finish_level(d);
   delete_dungeon(d);
-  init_dungeon(d);
-  gen_dungeon(d);
+  d->map = std::move(l->next.map);
+  d->hardness = std::move(l->next.hardness);
+  d->rooms = l->next.rooms;
+  d->num_rooms = l->next.num_rooms;
+  d->is_new = 1;
+  delete l;
+  reset_level(d);
   d->character_sequence_number = sequence_number;
+  d->event_sequence_number = event_sequence_number;
 
   place_pc(d);
   d->character_map[d->PC->position[dim_y]][d->PC->position[dim_x]] = d->PC;
   gen_monsters(d);
   gen_objects(d);
+
+  if (d->prefetch_levels) {
+    prefetch_level(d);
+  }
 }
@@ -1,25 +1,40 @@
 #ifndef DUNGEON_H
 # define DUNGEON_H
 
-# include "heap.h"
 # include "macros.h"
 # undef swap
 # undef min
 # include "dims.h"
 # include "character.h"
 # include "descriptions.h"
+# include "npc.h"
+# include "path.h"
+# include "rng.h"
+# include "event.h"
+# include "level.h"
+# include "grid.h"
+# include "chunk.h"
 
+/* The size of a dungeon unless --size says otherwise, and the size  *
+ * of the screen's view of it.  Room counts, and the hardness seeds, *
+ * scale with the area of the map relative to this.                  */
 #define DUNGEON_X              80
 #define DUNGEON_Y              21
+#define MIN_DUNGEON_X          24
+#define MIN_DUNGEON_Y          12
+#define MAX_DUNGEON_X          4096
+#define MAX_DUNGEON_Y          4096
 #define MIN_ROOMS              5
 #define MAX_ROOMS              9
 #define ROOM_MIN_X             4
 #define ROOM_MIN_Y             2
 #define ROOM_MAX_X             14
 #define ROOM_MAX_Y             8
+#define ROOM_PLACEMENT_TRIES   100
 #define PC_VISUAL_RANGE        3
 #define NPC_VISUAL_RANGE       15
 #define PC_SPEED               10
+#define MAX_SPEED              1000
 #define MAX_MONSTERS           12
 #define MAX_OBJECTS            12
 #define SAVE_DIR               ".rlg327"
@@ -53,6 +68,18 @@ typedef enum __attribute__ ((__packed__)) terrain_type {
   ter_marketplace
 } terrain_type_t;
 
+/* Each use of randomness draws from its own stream, so that, e.g.,    *
+ * redrawing the screen or changing the AI doesn't change the dungeons *
+ * that a seed generates.  The level stream seeds each new level.      */
+typedef enum rng_stream {
+  rng_generation,
+  rng_ai,
+  rng_combat,
+  rng_display,
+  rng_level,
+  num_rng_streams
+} rng_stream_t;
+
 typedef struct room {
   pair_t position;
   pair_t size;
@@ -60,12 +87,17 @@ typedef struct room {
 
 class pc;
 class object;
+typedef struct level_prefetch level_prefetch_t;
 
 class dungeon {
  public:
   uint32_t num_rooms;
   room_t *rooms;
-  terrain_type_t map[DUNGEON_Y][DUNGEON_X];
+  /* The map's size, border included.  init_dungeon() sizes every map *
+   * by it, and fills in DUNGEON_X by DUNGEON_Y if it's still zero.   */
+  uint16_t width;
+  uint16_t height;
+  grid<terrain_type_t> map;
   /* Since hardness is usually not used, it would be expensive to pull it *
    * into cache every time we need a map cell, so we store it in a        *
    * parallel array, rather than using a structure to represent the       *
@@ -74,18 +106,25 @@ class dungeon {
    * that structure.  Pathfinding will require efficient use of the map,  *
    * and pulling in unnecessary data with each map cell would add a lot   *
    * of overhead to the memory system.                                    */
-  uint8_t hardness[DUNGEON_Y][DUNGEON_X];
-  uint8_t pc_distance[DUNGEON_Y][DUNGEON_X];
-  uint8_t pc_tunnel[DUNGEON_Y][DUNGEON_X];
-  character *character_map[DUNGEON_Y][DUNGEON_X];
-  object *objmap[DUNGEON_Y][DUNGEON_X];
+  grid<uint8_t> hardness;
+  /* Distances saturate at PATH_UNREACHED, which is also "unreached". */
+  grid<path_distance_t> pc_distance;
+  grid<path_distance_t> pc_tunnel;
+  grid<character *> character_map;
+  grid<object *> objmap;
   pc *PC;
-  heap_t events;
+  event_queue events;
+  /* The PC's turn is rescheduled with this one event, which lives here *
+   * rather than in the queue's pool.  See do_moves().                  */
+  event_t pc_event;
   uint16_t num_monsters;
   uint16_t max_monsters;
+  /* Living monsters, counted by the bits that pick their move function. */
+  uint16_t census[NPC_MOVE_BITS + 1];
   uint16_t num_objects;
   uint16_t max_objects;
   uint32_t character_sequence_number;
+  uint32_t event_sequence_number;
   /* Game time isn't strictly necessary.  It's implicit in the turn number *
    * of the most recent thing removed from the event queue; however,       *
    * including it here--and keeping it up to date--provides a measure of   *
@@ -94,18 +133,64 @@ class dungeon {
   uint32_t time;
   uint32_t is_new;
   uint32_t quit;
+  /* Headless games have no terminal; the PC is driven by pc_next_pos(). */
+  uint32_t headless;
+  /* Set when the PC moves or the map changes under a distance map that *
+   * nobody is reading.  See dijkstra_ensure().                         */
+  uint32_t pc_distance_dirty;
+  uint32_t pc_tunnel_dirty;
+  path_context_t *paths;
+  /* Which parts of a file-backed map are in use; see chunk.h. */
+  chunk_context_t *chunks;
+  /* The next level, if it's being generated ahead of time. */
+  level_prefetch_t *next_level;
+  uint32_t prefetch_levels;
+  /* Stairs go up and down from here; the first level is depth 0. */
+  int32_t depth;
+  level_store_t *levels;
+  rng_t rng[num_rng_streams];
   std::vector<monster_description> monster_descriptions;
   std::vector<object_description> object_descriptions;
 };
 
+/* Seed before init_dungeon(), which already draws on the generation *
+ * stream; unseeded streams are all zero and never leave zero.       */
+void seed_dungeon(dungeon *d, uint64_t seed);
 void init_dungeon(dungeon *d);
 void new_dungeon(dungeon *d);
+/* Everything about a level but its terrain. */
+void reset_level(dungeon *d);
+/* How many default-sized dungeons would cover this one, at least 1. */
+uint32_t dungeon_scale(dungeon *d);
+/* Starts generating the next level's terrain on another thread.  With *
+ * prefetch_levels set, new_dungeon() starts the one after it, too.    *
+ * prefetch_level_delete() waits for the thread and discards its work. */
+void prefetch_level(dungeon *d);
+/* The level stream as it was before any pending prefetch drew on it, *
+ * so that a saved game prefetches the same level when it's resumed.  */
+void prefetch_level_stream(dungeon *d, rng_t *r);
+void prefetch_level_delete(dungeon *d);
 void delete_dungeon(dungeon *d);
 int gen_dungeon(dungeon *d);
 void render_dungeon(dungeon *d);
 int write_dungeon(dungeon *d, char *file);
+/* Returns the version of the file.  A version 0 file only fills in *
+ * the terrain; GAME_SAVE_VERSION restores the whole game, PC and   *
+ * all.  See save.h.                                                */
 int read_dungeon(dungeon *d, char *file);
 int read_pgm(dungeon *d, char *pgm);
+/* The above print what was wrong and exit; these return -1 and point *
+ * error at a message instead, for callers going through many files.  *
+ * load_dungeon() checks a version 1 file's header and returns        *
+ * GAME_SAVE_VERSION, but leaves reading the game to read_dungeon().  */
+int load_dungeon(dungeon *d, const char *file, const char **error);
+int load_pgm(dungeon *d, const char *pgm, const char **error);
+int store_dungeon(dungeon *d, const char *file, const char **error);
+/* For loaders of saved games.  room_in_dungeon() is nonzero if r lies *
+ * inside d's border.  terrain_in_range() is nonzero if every cell of  *
+ * map is a terrain_type_t and, if walled, the edge is all immutable.  */
+int room_in_dungeon(dungeon *d, const room_t *r);
+int terrain_in_range(const grid<terrain_type_t> &map, uint32_t walled);
 void render_distance_map(dungeon *d);
 void render_tunnel_distance_map(dungeon *d);
 void init_dungeon(dungeon_t *d);
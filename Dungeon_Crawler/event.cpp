@@ -1,39 +1,174 @@
+#include <string.h>
+#include <assert.h>
+
 #include "event.h"
+#include "dungeon.h"
 #include "character.h"
 
-static uint32_t next_event_number(void)
+event_queue::event_queue() : today(0), count(0), spare(NULL)
 {
-  static uint32_t sequence_number;
+  memset(head, 0, sizeof (head));
+  memset(tail, 0, sizeof (tail));
+  memset(busy, 0, sizeof (busy));
+  memset(&stats, 0, sizeof (stats));
+}
 
-  /* We need to special case the first PC insert, because monsters go *
-   * into the queue before the PC.  Pre-increment ensures that this   *
-   * starts at 1, so we can use a zero there.                         */
-  return ++sequence_number;
+void event_queue::push(event_t *e)
+{
+  event_t *n;
+  uint32_t day;
+
+  /* Times wrap, so compare them by their difference. */
+  if (!count || (int32_t) (e->time - today) < 0) {
+    today = e->time;
+  }
+  assert(e->time - today < EVENT_QUEUE_DAYS);
+
+  day = e->time % EVENT_QUEUE_DAYS;
+  if (!head[day]) {
+    e->next = e->prev = NULL;
+    head[day] = tail[day] = e;
+    busy[day / 64] |= 1ULL << (day % 64);
+  } else if (tail[day]->sequence < e->sequence) {
+    /* New events have the highest sequence number yet, so this is the *
+     * usual case.  Only the PC, at 0, cuts in line.                   */
+    e->next = NULL;
+    e->prev = tail[day];
+    tail[day]->next = e;
+    tail[day] = e;
+  } else {
+    for (n = head[day]; n->sequence < e->sequence; n = n->next)
+      ;
+    e->next = n;
+    e->prev = n->prev;
+    if (n->prev) {
+      n->prev->next = e;
+    } else {
+      head[day] = e;
+    }
+    n->prev = e;
+  }
+  count++;
+  stats.scheduled++;
 }
 
-int32_t compare_events(const void *event1, const void *event2)
+event_t *event_queue::pop()
 {
-  int32_t difference;
+  uint32_t day, word;
+  uint64_t bits;
+  event_t *e;
 
-  difference = (((event_t *) event1)->time -
-                ((event_t *) event2)->time);
-  return difference ? difference : (((event_t *) event1)->sequence -
-                                    ((event_t *) event2)->sequence);
+  if (!count) {
+    return NULL;
+  }
+
+  /* Every pending event is within EVENT_QUEUE_DAYS of today, so the *
+   * first busy day at or after today, wrapping around, is the next. */
+  day = today % EVENT_QUEUE_DAYS;
+  word = day / 64;
+  for (bits = busy[word] & (~0ULL << (day % 64)); !bits; bits = busy[word]) {
+    word = (word + 1) % (EVENT_QUEUE_DAYS / 64);
+  }
+  day = word * 64 + __builtin_ctzll(bits);
 
+  e = head[day];
+  today = e->time;
+  unlink(e);
+  stats.dispatched++;
+
+  return e;
+}
+
+void event_queue::unlink(event_t *e)
+{
+  uint32_t day;
+
+  day = e->time % EVENT_QUEUE_DAYS;
+  assert((e->prev ? e->prev->next : head[day]) == e);
+
+  if (e->prev) {
+    e->prev->next = e->next;
+  } else {
+    head[day] = e->next;
+  }
+  if (e->next) {
+    e->next->prev = e->prev;
+  } else {
+    tail[day] = e->prev;
+  }
+  if (!head[day]) {
+    busy[day / 64] &= ~(1ULL << (day % 64));
+  }
+  count--;
+}
+
+void event_queue::remove(event_t *e)
+{
+  unlink(e);
+  stats.cancelled++;
+}
+
+void event_queue::clear()
+{
+  uint32_t i, j;
+
+  memset(head, 0, sizeof (head));
+  memset(tail, 0, sizeof (tail));
+  memset(busy, 0, sizeof (busy));
+  today = count = 0;
+
+  for (spare = NULL, i = 0; i < blocks.size(); i++) {
+    for (j = 0; j < EVENT_QUEUE_BLOCK; j++) {
+      release(&blocks[i][j]);
+    }
+  }
+}
+
+event_t *event_queue::alloc()
+{
+  event_t *e;
+  uint32_t i;
+
+  if (!spare) {
+    blocks.push_back(std::unique_ptr<event_t[]>
+                     (new event_t[EVENT_QUEUE_BLOCK]));
+    for (i = 0; i < EVENT_QUEUE_BLOCK; i++) {
+      release(&blocks.back()[i]);
+    }
+  }
+  e = spare;
+  spare = e->next;
+
+  return e;
+}
+
+void event_queue::release(event_t *e)
+{
+  e->next = spare;
+  spare = e;
+}
+
+static uint32_t next_event_number(dungeon *d)
+{
+  /* We need to special case the first PC insert, because monsters go *
+   * into the queue before the PC.  Pre-increment ensures that this   *
+   * starts at 1, so we can use a zero there.                         */
+  return ++d->event_sequence_number;
 }
 
 event_t *new_event(dungeon *d, event_type_t t, void *v, uint32_t delay)
 {
   event_t *e;
 
-  e = (event_t *) malloc(sizeof (*e));
+  e = d->events.alloc();
 
   e->type = t;
   e->time = d->time + delay;
-  e->sequence = next_event_number();
+  e->sequence = next_event_number(d);
   switch (t) {
   case event_character_turn:
     e->c = (character *) v;
+    e->c->turn = e;
   }
 
   return e;
@@ -42,20 +177,28 @@ event_t *new_event(dungeon *d, event_type_t t, void *v, uint32_t delay)
 event_t *update_event(dungeon *d, event_t *e, uint32_t delay)
 {
   e->time = d->time + delay;
-  e->sequence = next_event_number();
+  e->sequence = next_event_number(d);
 
   return e;
 }
 
-void event_delete(void *e)
+/* Takes a character's turn out of the queue when it dies, rather than *
+ * leaving it for do_moves() to find, and deletes both.                */
+void event_cancel(dungeon *d, event_t *e)
 {
-  event_t *event = (event_t *) e;
+  d->events.remove(e);
+  event_delete(d, e);
+}
 
-  switch (event->type) {
+void event_delete(dungeon *d, event_t *e)
+{
+  switch (e->type) {
   case event_character_turn:
-    character_delete(event->c);
+    character_delete(e->c);
     break;
   }
 
-  free(event);
+  if (e != &d->pc_event) {
+    d->events.release(e);
+  }
 }
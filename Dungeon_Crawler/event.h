@@ -2,8 +2,11 @@
 # define EVENT_H
 
 # include <stdint.h>
+# include <vector>
+# include <memory>
 
-# include "dungeon.h"
+struct dungeon;
+class character;
 
 typedef enum event_type {
   event_character_turn,
@@ -16,11 +19,68 @@ typedef struct event {
   union {
     character *c;
   };
+  struct event *next;
+  struct event *prev;
 } event_t;
 
-int32_t compare_events(const void *event1, const void *event2);
+/* Turns the queue has handled, for measuring the scheduler.  Every *
+ * cancelled event is one that would otherwise have been dispatched *
+ * dead, to be thrown away by do_moves().                           */
+typedef struct event_stats {
+  uint64_t scheduled;
+  uint64_t dispatched;
+  uint64_t cancelled;
+} event_stats_t;
+
+/* Events are never scheduled more than 1000 / speed ahead, and speeds *
+ * are at least 1, so a calendar with more days than that never holds  *
+ * two different times on the same day.                                */
+# define EVENT_QUEUE_DAYS      1024
+# define EVENT_QUEUE_BLOCK     64
+
+/* A calendar queue: one list of events per day, kept in sequence order, *
+ * so insertion, removal of the next event, and remove() of any event    *
+ * are O(1), and a bitmap of the days that have events finds the next    *
+ * one in a few word operations.  Events come out by time, and then by   *
+ * sequence number, which is unique (the PC's is 0, so it goes first on  *
+ * a tie).  Events are allocated from the queue in blocks, and clear()   *
+ * takes all of them back for the next level.                            */
+class event_queue {
+ private:
+  event_t *head[EVENT_QUEUE_DAYS];
+  event_t *tail[EVENT_QUEUE_DAYS];
+  uint64_t busy[EVENT_QUEUE_DAYS / 64];
+  uint32_t today;
+  uint32_t count;
+  std::vector<std::unique_ptr<event_t[]> > blocks;
+  event_t *spare;
+  event_stats_t stats;
+  void unlink(event_t *e);
+ public:
+  event_queue();
+  inline bool empty() const
+  {
+    return !count;
+  }
+  inline uint32_t size() const
+  {
+    return count;
+  }
+  inline const event_stats_t &get_stats() const
+  {
+    return stats;
+  }
+  void push(event_t *e);
+  event_t *pop();
+  void remove(event_t *e);
+  void clear();
+  event_t *alloc();
+  void release(event_t *e);
+};
+
 event_t *new_event(dungeon *d, event_type_t t, void *v, uint32_t delay);
 event_t *update_event(dungeon *d, event_t *e, uint32_t delay);
-void event_delete(void *e);
+void event_delete(dungeon *d, event_t *e);
+void event_cancel(dungeon *d, event_t *e);
 
 #endif
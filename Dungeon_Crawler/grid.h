@@ -0,0 +1,204 @@
+#ifndef GRID_H
+# define GRID_H
+
+# include <stdint.h>
+# include <stdlib.h>
+# include <stdio.h>
+# include <string.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+
+/* MADV_PAGEOUT writes pages out and frees them now; where it's missing, *
+ * MADV_DONTNEED at least drops them from the process.                   */
+# ifdef MADV_PAGEOUT
+#  define GRID_EVICT MADV_PAGEOUT
+# else
+#  define GRID_EVICT MADV_DONTNEED
+# endif
+
+/* One value per map cell, stored row-major in a single block sized at  *
+ * run time.  g[y] is a pointer to row y, so g[y][x] reads just like    *
+ * the fixed arrays these replaced, and &g[0][0] is still the whole map *
+ * as one flat array.  Grids are moved, never copied, since maps can be *
+ * tens of megabytes; copy() makes the copy explicit.  Cells must be    *
+ * plain data.  The block is on the heap, unless back() puts it in a    *
+ * file mapped into memory, which the kernel can page in and out.       */
+template <typename T>
+class grid {
+ private:
+  T *cells;
+  uint32_t columns;
+  uint32_t rows;
+  /* The backing file and how much of it is mapped, or -1 and 0. */
+  int fd;
+  size_t mapped;
+  void release()
+  {
+    if (fd >= 0) {
+      munmap(cells, mapped);
+      close(fd);
+      fd = -1;
+      mapped = 0;
+    } else {
+      free(cells);
+    }
+    cells = NULL;
+  }
+ public:
+  grid() : cells(NULL), columns(0), rows(0), fd(-1), mapped(0) {}
+  grid(const grid &) = delete;
+  grid &operator=(const grid &) = delete;
+  grid(grid &&g) : cells(g.cells), columns(g.columns), rows(g.rows),
+                   fd(g.fd), mapped(g.mapped)
+  {
+    g.cells = NULL;
+    g.columns = g.rows = 0;
+    g.fd = -1;
+    g.mapped = 0;
+  }
+  grid &operator=(grid &&g)
+  {
+    if (this != &g) {
+      release();
+      cells = g.cells;
+      columns = g.columns;
+      rows = g.rows;
+      fd = g.fd;
+      mapped = g.mapped;
+      g.cells = NULL;
+      g.columns = g.rows = 0;
+      g.fd = -1;
+      g.mapped = 0;
+    }
+    return *this;
+  }
+  ~grid()
+  {
+    release();
+  }
+  /* Every cell is zero afterward.  A new size goes on the heap. */
+  void resize(uint32_t width, uint32_t height)
+  {
+    if ((size_t) width * height != size()) {
+      release();
+      cells = (T *) calloc((size_t) width * height, sizeof (T));
+    } else {
+      clear();
+    }
+    columns = width;
+    rows = height;
+  }
+  /* Like resize(), but the cells are kept in an unlinked file in dir, *
+   * mapped shared.  Returns nonzero, and leaves the grid as it was,   *
+   * if the file can't be made.                                        */
+  int back(uint32_t width, uint32_t height, const char *dir)
+  {
+    size_t length, page;
+    char *path;
+    void *p;
+    int f;
+
+    page = sysconf(_SC_PAGESIZE);
+    length = ((size_t) width * height * sizeof (T) + page - 1) & ~(page - 1);
+    path = (char *) malloc(strlen(dir) + sizeof ("/grid.XXXXXX"));
+    sprintf(path, "%s/grid.XXXXXX", dir);
+    if ((f = mkstemp(path)) >= 0) {
+      unlink(path);
+    }
+    free(path);
+    if (f < 0) {
+      return 1;
+    }
+    if (ftruncate(f, length) ||
+        (p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, f, 0)) == MAP_FAILED) {
+      close(f);
+      return 1;
+    }
+    release();
+    cells = (T *) p;
+    columns = width;
+    rows = height;
+    fd = f;
+    mapped = length;
+
+    return 0;
+  }
+  /* Hands the whole pages within rows [first, first + count) of a     *
+   * backed grid back to the kernel, which writes them out if need be. *
+   * They read back in unchanged when next touched.  Heap grids keep   *
+   * everything.                                                       */
+  void evict(uint32_t first, uint32_t count)
+  {
+    uintptr_t start, end, page;
+
+    if (fd < 0 || first >= rows) {
+      return;
+    }
+    if (count > rows - first) {
+      count = rows - first;
+    }
+    page = sysconf(_SC_PAGESIZE);
+    start = ((uintptr_t) (*this)[first] + page - 1) & ~(page - 1);
+    end = (uintptr_t) (*this)[first + count] & ~(page - 1);
+    if (start < end &&
+        madvise((void *) start, end - start, GRID_EVICT) &&
+        GRID_EVICT != MADV_DONTNEED) {
+      madvise((void *) start, end - start, MADV_DONTNEED);
+    }
+  }
+  inline int backed() const
+  {
+    return fd >= 0;
+  }
+  void copy(const grid &g)
+  {
+    if (g.columns != columns || g.rows != rows) {
+      resize(g.columns, g.rows);
+    }
+    memcpy(cells, g.cells, bytes());
+  }
+  inline T *operator[](uint32_t y)
+  {
+    return cells + (size_t) y * columns;
+  }
+  inline const T *operator[](uint32_t y) const
+  {
+    return cells + (size_t) y * columns;
+  }
+  inline T *data()
+  {
+    return cells;
+  }
+  inline const T *data() const
+  {
+    return cells;
+  }
+  inline uint32_t width() const
+  {
+    return columns;
+  }
+  inline uint32_t height() const
+  {
+    return rows;
+  }
+  inline size_t size() const
+  {
+    return (size_t) columns * rows;
+  }
+  inline size_t bytes() const
+  {
+    return size() * sizeof (T);
+  }
+  /* A backed grid punches out its file rather than write every page. */
+  inline void clear()
+  {
+    if (fd < 0 ||
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, mapped)) {
+      memset(cells, 0, bytes());
+    }
+  }
+};
+
+#endif
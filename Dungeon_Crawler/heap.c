@@ -3,16 +3,6 @@
 
 #undef min
 
-struct heap_node {
-  heap_node_t *next;
-  heap_node_t *prev;
-  heap_node_t *parent;
-  heap_node_t *child;
-  void *datum;
-  uint32_t degree;
-  uint32_t mark;
-};
-
 #define splice_heap_node_lists(n1, n2) ({ \
   if ((n1) && (n2)) {                     \
     (n1)->next->prev = (n2)->prev;        \
@@ -83,14 +73,76 @@ void print_heap_node_list(heap_node_t *n)
   printf("\n");
 }
 
+void heap_pool_init(heap_pool_t *p, heap_node_t *nodes, uint32_t size)
+{
+  p->nodes = nodes;
+  p->size = size;
+  p->spilled = 0;
+  heap_pool_reset(p);
+}
+
+void heap_pool_reset(heap_pool_t *p)
+{
+  p->free = NULL;
+  p->used = 0;
+}
+
 void heap_init(heap_t *h,
                int32_t (*compare)(const void *key, const void *with),
                void (*datum_delete)(void *))
+{
+  heap_init_pool(h, compare, datum_delete, NULL);
+}
+
+void heap_init_pool(heap_t *h,
+                    int32_t (*compare)(const void *key, const void *with),
+                    void (*datum_delete)(void *),
+                    heap_pool_t *p)
 {
   h->min = NULL;
   h->size = 0;
   h->compare = compare;
   h->datum_delete = datum_delete;
+  h->pool = p;
+}
+
+static heap_node_t *heap_node_alloc(heap_t *h)
+{
+  heap_pool_t *p;
+  heap_node_t *n;
+
+  if (!(p = h->pool)) {
+    return calloc(1, sizeof (*n));
+  }
+
+  if ((n = p->free)) {
+    p->free = n->next;
+  } else if (p->used < p->size) {
+    n = p->nodes + p->used++;
+  } else {
+    p->spilled++;
+    return calloc(1, sizeof (*n));
+  }
+
+  n->parent = n->child = NULL;
+  n->degree = n->mark = 0;
+
+  return n;
+}
+
+static void heap_node_free(heap_t *h, heap_node_t *n)
+{
+  heap_pool_t *p;
+
+  if ((p = h->pool) && n >= p->nodes && n < p->nodes + p->size) {
+    n->next = p->free;
+    p->free = n;
+  } else {
+    if (p) {
+      p->spilled--;
+    }
+    free(n);
+  }
 }
 
 void heap_node_delete(heap_t *h, heap_node_t *hn)
@@ -106,27 +158,30 @@ void heap_node_delete(heap_t *h, heap_node_t *hn)
     if (h->datum_delete) {
       h->datum_delete(hn->datum);
     }
-    free(hn);
+    heap_node_free(h, hn);
     hn = next;
   }
 }
 
 void heap_delete(heap_t *h)
 {
-  if (h->min) {
+  /* Pooled nodes are all reclaimed by heap_pool_reset(), so unless we *
+   * have data or malloc()ed nodes to free, there's no need to visit.  */
+  if (h->min && (h->datum_delete || !h->pool || h->pool->spilled)) {
     heap_node_delete(h, h->min);
   }
   h->min = NULL;
   h->size = 0;
   h->compare = NULL;
   h->datum_delete = NULL;
+  h->pool = NULL;
 }
 
 heap_node_t *heap_insert(heap_t *h, void *v)
 {
   heap_node_t *n;
 
-  n = calloc(1, sizeof (*n));
+  n = heap_node_alloc(h);
   n->datum = v;
 
   if (h->min) {
@@ -212,7 +267,7 @@ void *heap_remove_min(heap_t *h)
   if (h->min) {
     v = h->min->datum;
     if (h->size == 1) {
-      free(h->min);
+      heap_node_free(h, h->min);
       h->min = NULL;
     } else {
       if ((n = h->min->child)) {
@@ -226,7 +281,7 @@ void *heap_remove_min(heap_t *h)
       n = h->min;
       remove_heap_node_from_list(n);
       h->min = n->next;
-      free(n);
+      heap_node_free(h, n);
 
       heap_consolidate(h);
     }
@@ -240,12 +295,14 @@ void *heap_remove_min(heap_t *h)
 int heap_combine(heap_t *h, heap_t *h1, heap_t *h2)
 {
   if (h1->compare != h2->compare ||
-      h1->datum_delete != h2->datum_delete) {
+      h1->datum_delete != h2->datum_delete ||
+      h1->pool != h2->pool) {
     return 1;
   }
 
   h->compare = h1->compare;
   h->datum_delete = h1->datum_delete;
+  h->pool = h1->pool;
 
   if (!h1->min) {
     h->min = h2->min;
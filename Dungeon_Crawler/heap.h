@@ -7,19 +7,51 @@ extern "C" {
 
 # include <stdint.h>
 
-struct heap_node;
 typedef struct heap_node heap_node_t;
 
+struct heap_node {
+  heap_node_t *next;
+  heap_node_t *prev;
+  heap_node_t *parent;
+  heap_node_t *child;
+  void *datum;
+  uint32_t degree;
+  uint32_t mark;
+};
+
+/* A pool hands out nodes from an array that the caller supplies, so a   *
+ * heap that's built and torn down over and over (e.g., for a search)    *
+ * needn't malloc and free every node.  Removed nodes are kept for reuse *
+ * by the pool's heaps, and if the array runs out, nodes come from       *
+ * malloc() as usual.  heap_delete() on a pooled heap with no            *
+ * datum_delete doesn't walk the heap at all; heap_pool_reset() takes    *
+ * back every node at once, and must only be called when none of its     *
+ * heaps are still in use.                                               */
+typedef struct heap_pool {
+  heap_node_t *nodes;
+  heap_node_t *free;
+  uint32_t size;
+  uint32_t used;
+  uint32_t spilled;
+} heap_pool_t;
+
 typedef struct heap {
   heap_node_t *min;
   uint32_t size;
   int32_t (*compare)(const void *key, const void *with);
   void (*datum_delete)(void *);
+  heap_pool_t *pool;
 } heap_t;
 
+void heap_pool_init(heap_pool_t *p, heap_node_t *nodes, uint32_t size);
+void heap_pool_reset(heap_pool_t *p);
 void heap_init(heap_t *h,
                int32_t (*compare)(const void *key, const void *with),
                void (*datum_delete)(void *));
+void heap_init_pool(heap_t *h,
+                    int32_t (*compare)(const void *key, const void *with),
+                    void (*datum_delete)(void *),
+                    heap_pool_t *p);
 void heap_delete(heap_t *h);
 heap_node_t *heap_insert(heap_t *h, void *v);
 void *heap_peek_min(heap_t *h);
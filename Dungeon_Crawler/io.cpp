@@ -3,6 +3,7 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 
 #include "io.h"
@@ -17,8 +18,10 @@
 #define DIVIDER "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"
 #define DIVIDER_44 "~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~"
 
-/* Same ugly hack we did in path.c */
-static dungeon *the_dungeon;
+/* Same ugly hack we did in path.c.  This, and the message queue   *
+ * below, are per thread, so that games played on separate threads *
+ * (see batch.cpp) don't share them.                               */
+static thread_local dungeon *the_dungeon;
 
 typedef struct io_message {
   /* Will print " --more-- " at end of line when another message follows. *
@@ -27,11 +30,75 @@ typedef struct io_message {
   struct io_message *next;
 } io_message_t;
 
-static io_message_t *io_head, *io_tail;
+static thread_local io_message_t *io_head, *io_tail;
 
-void io_init_terminal(void)
+/* With no terminal, there's nobody to read the messages and no way to *
+ * page through them, so headless runs simply drop them.               */
+static uint32_t io_headless;
+
+/* A map larger than the screen is shown through an IO_VIEW_X by      *
+ * IO_VIEW_Y window onto it, whose upper left corner is at io_view.   *
+ * At the default dungeon size, the window is the whole map and never *
+ * moves.                                                             */
+#define IO_VIEW_X DUNGEON_X
+#define IO_VIEW_Y DUNGEON_Y
+
+static thread_local int32_t io_view[num_dims];
+
+/* Scrolls the window, if need be, so that center and the light radius *
+ * around it are on screen.  Returns nonzero if the window moved.      */
+static uint32_t io_view_follow(dungeon *d, pair_t center)
+{
+  static const int32_t view[num_dims] = { IO_VIEW_X, IO_VIEW_Y };
+  int32_t size[num_dims], origin, margin;
+  uint32_t dim, moved;
+
+  size[dim_x] = d->width;
+  size[dim_y] = d->height;
+  margin = PC_VISUAL_RANGE + 1;
+
+  for (moved = 0, dim = 0; dim < num_dims; dim++) {
+    origin = io_view[dim];
+    if (center[dim] < origin + margin ||
+        center[dim] >= origin + view[dim] - margin) {
+      origin = center[dim] - view[dim] / 2;
+    }
+    if (origin > size[dim] - view[dim]) {
+      origin = size[dim] - view[dim];
+    }
+    if (origin < 0) {
+      origin = 0;
+    }
+    if (origin != io_view[dim]) {
+      io_view[dim] = origin;
+      moved = 1;
+    }
+  }
+
+  return moved;
+}
+
+/* One past the last row (dim_y) or column (dim_x) of the map on screen. */
+static int32_t io_view_end(dungeon *d, dim_t dim)
+{
+  if (dim == dim_x) {
+    return std::min<int32_t>(io_view[dim_x] + IO_VIEW_X, d->width);
+  }
+  return std::min<int32_t>(io_view[dim_y] + IO_VIEW_Y, d->height);
+}
+
+/* Draws ch for map cell (x, y), if it's on screen. */
+static void io_map_addch(int32_t y, int32_t x, chtype ch)
+{
+  y -= io_view[dim_y];
+  x -= io_view[dim_x];
+  if (y >= 0 && y < IO_VIEW_Y && x >= 0 && x < IO_VIEW_X) {
+    mvaddch(y + 1, x, ch);
+  }
+}
+
+static void io_init_screen(void)
 {
-  initscr();
   raw();
   noecho();
   curs_set(0);
@@ -46,6 +113,34 @@ void io_init_terminal(void)
   init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK);
 }
 
+void io_init_terminal(void)
+{
+  initscr();
+  io_init_screen();
+}
+
+/* Renders into a terminal attached to /dev/null, so that the display *
+ * code can be exercised (and timed) without a tty.                   */
+int io_init_offscreen(void)
+{
+  FILE *out, *in;
+
+  if (!(out = fopen("/dev/null", "w")) || !(in = fopen("/dev/null", "r"))) {
+    return 1;
+  }
+  if (!newterm(getenv("TERM") ? getenv("TERM") : "xterm", out, in)) {
+    return 1;
+  }
+  io_init_screen();
+
+  return 0;
+}
+
+void io_init_headless(void)
+{
+  io_headless = 1;
+}
+
 static std::vector<std::string> split(const std::string& string, int n)
 {
    /* Initialize variables */
@@ -94,6 +189,10 @@ void io_queue_message(const char *format, ...)
   io_message_t *tmp;
   va_list ap;
 
+  if (io_headless) {
+    return;
+  }
+
   if (!(tmp = (io_message_t *) malloc(sizeof (*tmp)))) {
     perror("malloc");
     exit(1);
@@ -137,16 +236,18 @@ static void io_print_message_queue(uint32_t y, uint32_t x)
 
 void io_display_tunnel(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
+  dijkstra_tunnel_ensure(d);
+  io_view_follow(d, d->PC->position);
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = io_view[dim_y]; y < io_view_end(d, dim_y); y++) {
+    for (x = io_view[dim_x]; x < io_view_end(d, dim_x); x++) {
       if (charxy(x, y) == d->PC) {
-        mvaddch(y + 1, x, charxy(x, y)->symbol);
+        io_map_addch(y, x, charxy(x, y)->symbol);
       } else if (hardnessxy(x, y) == 255) {
-        mvaddch(y + 1, x, '*');
+        io_map_addch(y, x, '*');
       } else {
-        mvaddch(y + 1, x, '0' + (d->pc_tunnel[y][x] % 10));
+        io_map_addch(y, x, '0' + (d->pc_tunnel[y][x] % 10));
       }
     }
   }
@@ -155,16 +256,18 @@ void io_display_tunnel(dungeon *d)
 
 void io_display_distance(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
+  dijkstra_ensure(d);
+  io_view_follow(d, d->PC->position);
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = io_view[dim_y]; y < io_view_end(d, dim_y); y++) {
+    for (x = io_view[dim_x]; x < io_view_end(d, dim_x); x++) {
       if (charxy(x, y)) {
-        mvaddch(y + 1, x, charxy(x, y)->symbol);
+        io_map_addch(y, x, charxy(x, y)->symbol);
       } else if (hardnessxy(x, y) != 0) {
-        mvaddch(y + 1, x, ' ');
+        io_map_addch(y, x, ' ');
       } else {
-        mvaddch(y + 1, x, '0' + (d->pc_distance[y][x] % 10));
+        io_map_addch(y, x, '0' + (d->pc_distance[y][x] % 10));
       }
     }
   }
@@ -176,17 +279,18 @@ static char hardness_to_char[] =
 
 void io_display_hardness(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
+  io_view_follow(d, d->PC->position);
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = io_view[dim_y]; y < io_view_end(d, dim_y); y++) {
+    for (x = io_view[dim_x]; x < io_view_end(d, dim_x); x++) {
       /* Maximum hardness is 255.  We have 62 values to display it, but *
        * we only want one zero value, so we need to cover [1,255] with  *
        * 61 values, which gives us a divisor of 254 / 61 = 4.164.       *
        * Generally, we want to avoid floating point math, but this is   *
        * not gameplay, so we'll make an exception here to get maximal   *
        * hardness display resolution.                                   */
-      mvaddch(y + 1, x, (d->hardness[y][x]                             ?
+      io_map_addch(y, x, (d->hardness[y][x]                             ?
                          hardness_to_char[1 + (int) ((d->hardness[y][x] /
                                                       4.2))] : ' '));
     }
@@ -218,9 +322,9 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
          pos[dim_x] <= PC_VISUAL_RANGE;
          pos[dim_x]++) {
       if ((d->PC->position[dim_y] + pos[dim_y] < 0) ||
-          (d->PC->position[dim_y] + pos[dim_y] >= DUNGEON_Y) ||
+          (d->PC->position[dim_y] + pos[dim_y] >= d->height) ||
           (d->PC->position[dim_x] + pos[dim_x] < 0) ||
-          (d->PC->position[dim_x] + pos[dim_x] >= DUNGEON_X)) {
+          (d->PC->position[dim_x] + pos[dim_x] >= d->width)) {
         continue;
       }
       if ((illuminated = is_illuminated(d->PC,
@@ -230,8 +334,8 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
       }
       if (cursor[dim_y] == d->PC->position[dim_y] + pos[dim_y] &&
           cursor[dim_x] == d->PC->position[dim_x] + pos[dim_x]) {
-        mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                d->PC->position[dim_x] + pos[dim_x], '*');
+        io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                     d->PC->position[dim_x] + pos[dim_x], '*');
       } else if (d->character_map[d->PC->position[dim_y] + pos[dim_y]]
                           [d->PC->position[dim_x] + pos[dim_x]] &&
           can_see(d, d->PC->position,
@@ -241,13 +345,14 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
         attron(COLOR_PAIR((color = d->character_map[d->PC->position[dim_y] +
                                                     pos[dim_y]]
                                                    [d->PC->position[dim_x] +
-                                                    pos[dim_x]]->get_color())));
-        mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                d->PC->position[dim_x] + pos[dim_x],
-                character_get_symbol(d->character_map[d->PC->position[dim_y] +
-                                                      pos[dim_y]]
-                                                     [d->PC->position[dim_x] +
-                                                      pos[dim_x]]));
+                                                    pos[dim_x]]->
+                                   get_color(&d->rng[rng_display]))));
+        io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                     d->PC->position[dim_x] + pos[dim_x],
+                     character_get_symbol(d->character_map
+                                          [d->PC->position[dim_y] + pos[dim_y]]
+                                          [d->PC->position[dim_x] +
+                                           pos[dim_x]]));
         attroff(COLOR_PAIR(color));
       } else if (d->objmap[d->PC->position[dim_y] + pos[dim_y]]
                           [d->PC->position[dim_x] + pos[dim_x]] &&
@@ -260,10 +365,11 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
         attron(COLOR_PAIR(d->objmap[d->PC->position[dim_y] + pos[dim_y]]
                                    [d->PC->position[dim_x] +
                                     pos[dim_x]]->get_color()));
-        mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                d->PC->position[dim_x] + pos[dim_x],
-                d->objmap[d->PC->position[dim_y] + pos[dim_y]]
-                         [d->PC->position[dim_x] + pos[dim_x]]->get_symbol());
+        io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                     d->PC->position[dim_x] + pos[dim_x],
+                     d->objmap[d->PC->position[dim_y] + pos[dim_y]]
+                              [d->PC->position[dim_x] + pos[dim_x]]->
+                       get_symbol());
         attroff(COLOR_PAIR(d->objmap[d->PC->position[dim_y] + pos[dim_y]]
                                     [d->PC->position[dim_x] +
                                      pos[dim_x]]->get_color()));
@@ -275,39 +381,39 @@ static void io_redisplay_visible_monsters(dungeon *d, pair_t cursor)
         case ter_wall:
         case ter_wall_immutable:
         case ter_unknown:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], ' ');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], ' ');
           break;
         case ter_floor:
         case ter_floor_room:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '.');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], '.');
           break;
         case ter_floor_hall:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '#');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], '#');
           break;
         case ter_debug:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '*');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], '*');
           break;
         case ter_stairs_up:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '<');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], '<');
           break;
         case ter_stairs_down:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '>');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], '>');
           break;
         case ter_marketplace:
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '+');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], '+');
           break;
         default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-          mvaddch(d->PC->position[dim_y] + pos[dim_y] + 1,
-                  d->PC->position[dim_x] + pos[dim_x], '0');
+          io_map_addch(d->PC->position[dim_y] + pos[dim_y],
+                       d->PC->position[dim_x] + pos[dim_x], '0');
         }
       }
       attroff(A_BOLD);
@@ -336,8 +442,8 @@ static character *io_nearest_visible_monster(dungeon *d)
   c = (character **) malloc(d->num_monsters * sizeof (*c));
 
   /* Get a linear list of monsters */
-  for (count = 0, y = 1; y < DUNGEON_Y - 1; y++) {
-    for (x = 1; x < DUNGEON_X - 1; x++) {
+  for (count = 0, y = 1; y < d->height - 1u; y++) {
+    for (x = 1; x < d->width - 1u; x++) {
       if (d->character_map[y][x] && d->character_map[y][x] != d->PC) {
         c[count++] = d->character_map[y][x];
         assert(count <= d->num_monsters);
@@ -346,6 +452,7 @@ static character *io_nearest_visible_monster(dungeon *d)
   }
 
   /* Sort it by distance from PC */
+  dijkstra_ensure(d);
   the_dungeon = d;
   qsort(c, count, sizeof (*c), compare_monster_distance);
 
@@ -369,11 +476,14 @@ void io_display(dungeon *d)
   character *c;
   int32_t visible_monsters;
 
+  io_view_follow(d, d->PC->position);
   clear();
-  for (visible_monsters = -1, pos[dim_y] = 0;
-       pos[dim_y] < DUNGEON_Y;
+  for (visible_monsters = -1, pos[dim_y] = io_view[dim_y];
+       pos[dim_y] < io_view_end(d, dim_y);
        pos[dim_y]++) {
-    for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x]++) {
+    for (pos[dim_x] = io_view[dim_x];
+         pos[dim_x] < io_view_end(d, dim_x);
+         pos[dim_x]++) {
       if ((illuminated = is_illuminated(d->PC, pos[dim_y], pos[dim_x]))) {
         attron(A_BOLD);
       }
@@ -382,47 +492,49 @@ void io_display(dungeon *d)
                   character_get_pos(d->character_map[pos[dim_y]][pos[dim_x]]), 1, 0)) {
 
         visible_monsters++;
-        attron(COLOR_PAIR((color = d->character_map[pos[dim_y]][pos[dim_x]]->get_color())));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
-                character_get_symbol(d->character_map[pos[dim_y]][pos[dim_x]]));
+        attron(COLOR_PAIR((color = d->character_map[pos[dim_y]][pos[dim_x]]->
+                                   get_color(&d->rng[rng_display]))));
+        io_map_addch(pos[dim_y], pos[dim_x],
+                     character_get_symbol(d->character_map[pos[dim_y]]
+                                                          [pos[dim_x]]));
         attroff(COLOR_PAIR(color));
       } else if (d->objmap[pos[dim_y]][pos[dim_x]] &&
                  (d->objmap[pos[dim_y]][pos[dim_x]]->have_seen() ||
                   can_see(d, character_get_pos(d->PC), pos, 1, 0))) {
         attron(COLOR_PAIR(d->objmap[pos[dim_y]][pos[dim_x]]->get_color()));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
-                d->objmap[pos[dim_y]][pos[dim_x]]->get_symbol());
+        io_map_addch(pos[dim_y], pos[dim_x],
+                     d->objmap[pos[dim_y]][pos[dim_x]]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[pos[dim_y]][pos[dim_x]]->get_color()));
       } else {
         switch (pc_learned_terrain(d->PC,pos[dim_y], pos[dim_x])) {
         case ter_wall:
         case ter_wall_immutable:
         case ter_unknown:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], ' ');
+          io_map_addch(pos[dim_y], pos[dim_x], ' ');
           break;
         case ter_floor:
         case ter_floor_room:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '.');
+          io_map_addch(pos[dim_y], pos[dim_x], '.');
           break;
         case ter_floor_hall:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '#');
+          io_map_addch(pos[dim_y], pos[dim_x], '#');
           break;
         case ter_debug:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '*');
+          io_map_addch(pos[dim_y], pos[dim_x], '*');
           break;
         case ter_stairs_up:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '<');
+          io_map_addch(pos[dim_y], pos[dim_x], '<');
           break;
         case ter_stairs_down:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '>');
+          io_map_addch(pos[dim_y], pos[dim_x], '>');
           break;
         case ter_marketplace:
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '+');
+          io_map_addch(pos[dim_y], pos[dim_x], '+');
           break;
         default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-          mvaddch(pos[dim_y] + 1, pos[dim_x], '0');
+          io_map_addch(pos[dim_y], pos[dim_x], '0');
         }
       }
       if (illuminated) {
@@ -461,25 +573,31 @@ static void io_redisplay_non_terrain(dungeon *d, pair_t cursor)
   uint32_t color;
   uint32_t illuminated;
 
-  for (pos[dim_y] = 0; pos[dim_y] < DUNGEON_Y; pos[dim_y]++) {
-    for (pos[dim_x] = 0; pos[dim_x] < DUNGEON_X; pos[dim_x]++) {
+  for (pos[dim_y] = io_view[dim_y];
+       pos[dim_y] < io_view_end(d, dim_y);
+       pos[dim_y]++) {
+    for (pos[dim_x] = io_view[dim_x];
+         pos[dim_x] < io_view_end(d, dim_x);
+         pos[dim_x]++) {
       if ((illuminated = is_illuminated(d->PC,
                                         pos[dim_y],
                                         pos[dim_x]))) {
         attron(A_BOLD);
       }
       if (cursor[dim_y] == pos[dim_y] && cursor[dim_x] == pos[dim_x]) {
-        mvaddch(pos[dim_y] + 1, pos[dim_x], '*');
+        io_map_addch(pos[dim_y], pos[dim_x], '*');
       } else if (d->character_map[pos[dim_y]][pos[dim_x]]) {
         attron(COLOR_PAIR((color = d->character_map[pos[dim_y]]
-                                                   [pos[dim_x]]->get_color())));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
-                character_get_symbol(d->character_map[pos[dim_y]][pos[dim_x]]));
+                                                   [pos[dim_x]]->
+                                   get_color(&d->rng[rng_display]))));
+        io_map_addch(pos[dim_y], pos[dim_x],
+                     character_get_symbol(d->character_map[pos[dim_y]]
+                                                          [pos[dim_x]]));
         attroff(COLOR_PAIR(color));
       } else if (d->objmap[pos[dim_y]][pos[dim_x]]) {
         attron(COLOR_PAIR(d->objmap[pos[dim_y]][pos[dim_x]]->get_color()));
-        mvaddch(pos[dim_y] + 1, pos[dim_x],
-                d->objmap[pos[dim_y]][pos[dim_x]]->get_symbol());
+        io_map_addch(pos[dim_y], pos[dim_x],
+                     d->objmap[pos[dim_y]][pos[dim_x]]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[pos[dim_y]][pos[dim_x]]->get_color()));
       }
       attroff(A_BOLD);
@@ -491,50 +609,51 @@ static void io_redisplay_non_terrain(dungeon *d, pair_t cursor)
 
 void io_display_no_fog(dungeon *d)
 {
-  uint32_t y, x;
+  int32_t y, x;
   uint32_t color;
   character *c;
 
   clear();
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = io_view[dim_y]; y < io_view_end(d, dim_y); y++) {
+    for (x = io_view[dim_x]; x < io_view_end(d, dim_x); x++) {
       if (d->character_map[y][x]) {
-        attron(COLOR_PAIR((color = d->character_map[y][x]->get_color())));
-        mvaddch(y + 1, x, character_get_symbol(d->character_map[y][x]));
+        attron(COLOR_PAIR((color = d->character_map[y][x]->
+                                   get_color(&d->rng[rng_display]))));
+        io_map_addch(y, x, character_get_symbol(d->character_map[y][x]));
         attroff(COLOR_PAIR(color));
       } else if (d->objmap[y][x]) {
         attron(COLOR_PAIR(d->objmap[y][x]->get_color()));
-        mvaddch(y + 1, x, d->objmap[y][x]->get_symbol());
+        io_map_addch(y, x, d->objmap[y][x]->get_symbol());
         attroff(COLOR_PAIR(d->objmap[y][x]->get_color()));
       } else {
         switch (mapxy(x, y)) {
         case ter_wall:
         case ter_wall_immutable:
-          mvaddch(y + 1, x, ' ');
+          io_map_addch(y, x, ' ');
           break;
         case ter_floor:
         case ter_floor_room:
-          mvaddch(y + 1, x, '.');
+          io_map_addch(y, x, '.');
           break;
         case ter_floor_hall:
-          mvaddch(y + 1, x, '#');
+          io_map_addch(y, x, '#');
           break;
         case ter_debug:
-          mvaddch(y + 1, x, '*');
+          io_map_addch(y, x, '*');
           break;
         case ter_stairs_up:
-          mvaddch(y + 1, x, '<');
+          io_map_addch(y, x, '<');
           break;
         case ter_stairs_down:
-          mvaddch(y + 1, x, '>');
+          io_map_addch(y, x, '>');
           break;
         case ter_marketplace:
-          mvaddch(y + 1, x, '+');
+          io_map_addch(y, x, '+');
           break;
         default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-          mvaddch(y + 1, x, '0');
+          io_map_addch(y, x, '0');
         }
       }
     }
@@ -584,7 +703,7 @@ uint32_t io_teleport_pc(dungeon *d)
   dest[dim_y] = d->PC->position[dim_y];
   dest[dim_x] = d->PC->position[dim_x];
 
-  mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+  io_map_addch(dest[dim_y], dest[dim_x], '*');
   refresh();
 
   do {
@@ -604,31 +723,31 @@ uint32_t io_teleport_pc(dungeon *d)
     case ter_wall:
     case ter_wall_immutable:
     case ter_unknown:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], ' ');
+      io_map_addch(dest[dim_y], dest[dim_x], ' ');
       break;
     case ter_floor:
     case ter_floor_room:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '.');
+      io_map_addch(dest[dim_y], dest[dim_x], '.');
       break;
     case ter_floor_hall:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '#');
+      io_map_addch(dest[dim_y], dest[dim_x], '#');
       break;
     case ter_debug:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+      io_map_addch(dest[dim_y], dest[dim_x], '*');
       break;
     case ter_stairs_up:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '<');
+      io_map_addch(dest[dim_y], dest[dim_x], '<');
       break;
     case ter_stairs_down:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '>');
+      io_map_addch(dest[dim_y], dest[dim_x], '>');
       break;
     case ter_marketplace:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '+');
+      io_map_addch(dest[dim_y], dest[dim_x], '+');
       break;
     default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '0');
+      io_map_addch(dest[dim_y], dest[dim_x], '0');
     }
     switch ((c = getch())) {
     case '7':
@@ -654,38 +773,38 @@ uint32_t io_teleport_pc(dungeon *d)
       if (dest[dim_y] != 1) {
         dest[dim_y]--;
       }
-      if (dest[dim_x] != DUNGEON_X - 2) {
+      if (dest[dim_x] != d->width - 2) {
         dest[dim_x]++;
       }
       break;
     case '6':
     case 'l':
     case KEY_RIGHT:
-      if (dest[dim_x] != DUNGEON_X - 2) {
+      if (dest[dim_x] != d->width - 2) {
         dest[dim_x]++;
       }
       break;
     case '3':
     case 'n':
     case KEY_NPAGE:
-      if (dest[dim_y] != DUNGEON_Y - 2) {
+      if (dest[dim_y] != d->height - 2) {
         dest[dim_y]++;
       }
-      if (dest[dim_x] != DUNGEON_X - 2) {
+      if (dest[dim_x] != d->width - 2) {
         dest[dim_x]++;
       }
       break;
     case '2':
     case 'j':
     case KEY_DOWN:
-      if (dest[dim_y] != DUNGEON_Y - 2) {
+      if (dest[dim_y] != d->height - 2) {
         dest[dim_y]++;
       }
       break;
     case '1':
     case 'b':
     case KEY_END:
-      if (dest[dim_y] != DUNGEON_Y - 2) {
+      if (dest[dim_y] != d->height - 2) {
         dest[dim_y]++;
       }
       if (dest[dim_x] != 1) {
@@ -700,12 +819,16 @@ uint32_t io_teleport_pc(dungeon *d)
       }
       break;
     }
+    if (io_view_follow(d, dest)) {
+      io_display_no_fog(d);
+      mvprintw(0, 0, "Choose a location.  't' to teleport to; 'r' for random.");
+    }
   } while (c != 't' && c != 'r');
 
   if (c == 'r') {
     do {
-      dest[dim_x] = rand_range(1, DUNGEON_X - 2);
-      dest[dim_y] = rand_range(1, DUNGEON_Y - 2);
+      dest[dim_x] = rand_range(&d->rng[rng_ai], 1, d->width - 2);
+      dest[dim_y] = rand_range(&d->rng[rng_ai], 1, d->height - 2);
     } while (charpair(dest) || mappair(dest) < ter_floor);
   }
 
@@ -720,8 +843,7 @@ uint32_t io_teleport_pc(dungeon *d)
   }
 
   pc_observe_terrain(d->PC, d);
-  dijkstra(d);
-  dijkstra_tunnel(d);
+  dijkstra_invalidate(d);
 
   io_display(d);
 
@@ -811,7 +933,7 @@ static void io_list_monsters_display(dungeon *d,
   mvprintw(3, 19, " %-40s ", "");
   /* Borrow the first element of our array for this string: */
   snprintf(s[0], 40, "You know of %d monsters:", count);
-  mvprintw(4, 19, " %-40s ", s);
+  mvprintw(4, 19, " %-40s ", s[0]);
   mvprintw(5, 19, " %-40s ", "");
 
   for (i = 0; i < count; i++) {
@@ -856,8 +978,8 @@ static void io_list_monsters(dungeon *d)
   c = (character **) malloc(d->num_monsters * sizeof (*c));
 
   /* Get a linear list of monsters */
-  for (count = 0, y = 1; y < DUNGEON_Y - 1; y++) {
-    for (x = 1; x < DUNGEON_X - 1; x++) {
+  for (count = 0, y = 1; y < d->height - 1u; y++) {
+    for (x = 1; x < d->width - 1u; x++) {
       if (d->character_map[y][x] && d->character_map[y][x] != d->PC &&
           can_see(d, character_get_pos(d->PC),
                   character_get_pos(d->character_map[y][x]), 1, 0)) {
@@ -867,6 +989,7 @@ static void io_list_monsters(dungeon *d)
   }
 
   /* Sort it by distance from PC */
+  dijkstra_ensure(d);
   the_dungeon = d;
   qsort(c, count, sizeof (*c), compare_monster_distance);
 
@@ -1225,7 +1348,7 @@ static uint32_t io_inspect_monster(dungeon_t *d)
   dest[dim_y] = d->PC->position[dim_y];
   dest[dim_x] = d->PC->position[dim_x];
 
-  mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+  io_map_addch(dest[dim_y], dest[dim_x], '*');
   refresh();
 
   do {
@@ -1245,31 +1368,31 @@ static uint32_t io_inspect_monster(dungeon_t *d)
     case ter_wall:
     case ter_wall_immutable:
     case ter_unknown:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], ' ');
+      io_map_addch(dest[dim_y], dest[dim_x], ' ');
       break;
     case ter_floor:
     case ter_floor_room:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '.');
+      io_map_addch(dest[dim_y], dest[dim_x], '.');
       break;
     case ter_floor_hall:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '#');
+      io_map_addch(dest[dim_y], dest[dim_x], '#');
       break;
     case ter_debug:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '*');
+      io_map_addch(dest[dim_y], dest[dim_x], '*');
       break;
     case ter_stairs_up:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '<');
+      io_map_addch(dest[dim_y], dest[dim_x], '<');
       break;
     case ter_stairs_down:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '>');
+      io_map_addch(dest[dim_y], dest[dim_x], '>');
       break;
     case ter_marketplace:
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '+');
+      io_map_addch(dest[dim_y], dest[dim_x], '+');
       break;
     default:
  /* Use zero as an error symbol, since it stands out somewhat, and it's *
   * not otherwise used.                                                 */
-      mvaddch(dest[dim_y] + 1, dest[dim_x], '0');
+      io_map_addch(dest[dim_y], dest[dim_x], '0');
     }
     tmp[dim_y] = dest[dim_y];
     tmp[dim_x] = dest[dim_x];
@@ -1306,7 +1429,7 @@ static uint32_t io_inspect_monster(dungeon_t *d)
           can_see(d, d->PC->position, tmp, 1, 0)) {
         dest[dim_y]--;
       }
-      if (dest[dim_x] != DUNGEON_X - 2 &&
+      if (dest[dim_x] != d->width - 2 &&
           can_see(d, d->PC->position, tmp, 1, 0)) {
         dest[dim_x]++;
       }
@@ -1315,7 +1438,7 @@ static uint32_t io_inspect_monster(dungeon_t *d)
     case 'l':
     case KEY_RIGHT:
       tmp[dim_x]++;
-      if (dest[dim_x] != DUNGEON_X - 2 &&
+      if (dest[dim_x] != d->width - 2 &&
           can_see(d, d->PC->position, tmp, 1, 0)) {
         dest[dim_x]++;
       }
@@ -1325,11 +1448,11 @@ static uint32_t io_inspect_monster(dungeon_t *d)
     case KEY_NPAGE:
       tmp[dim_y]++;
       tmp[dim_x]++;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
+      if (dest[dim_y] != d->height - 2 &&
           can_see(d, d->PC->position, tmp, 1, 0)) {
         dest[dim_y]++;
       }
-      if (dest[dim_x] != DUNGEON_X - 2 &&
+      if (dest[dim_x] != d->width - 2 &&
           can_see(d, d->PC->position, tmp, 1, 0)) {
         dest[dim_x]++;
       }
@@ -1338,7 +1461,7 @@ static uint32_t io_inspect_monster(dungeon_t *d)
     case 'j':
     case KEY_DOWN:
       tmp[dim_y]++;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
+      if (dest[dim_y] != d->height - 2 &&
           can_see(d, d->PC->position, tmp, 1, 0)) {
         dest[dim_y]++;
       }
@@ -1348,7 +1471,7 @@ static uint32_t io_inspect_monster(dungeon_t *d)
     case KEY_END:
       tmp[dim_y]++;
       tmp[dim_x]--;
-      if (dest[dim_y] != DUNGEON_Y - 2 &&
+      if (dest[dim_y] != d->height - 2 &&
           can_see(d, d->PC->position, tmp, 1, 0)) {
         dest[dim_y]++;
       }
@@ -1377,9 +1500,9 @@ static uint32_t io_inspect_monster(dungeon_t *d)
    
   mvprintw(3, 10, " %-44s ", "MONSTER DESCRIPTION (Press any key to resume)"); 
   mvprintw(4 , 10, " %-44s ", DIVIDER_44);
-  attron(COLOR_PAIR(charpair(dest)->get_color()));
+  attron(COLOR_PAIR(charpair(dest)->get_color(&d->rng[rng_display])));
   mvprintw(5, 10, " %-44s ", charpair(dest)->name);
-  attroff(COLOR_PAIR(charpair(dest)->get_color()));
+  attroff(COLOR_PAIR(charpair(dest)->get_color(&d->rng[rng_display])));
   mvprintw(6, 10, " %-44s ", " ");
   npc *monster = (npc*) charpair(dest);
   std::vector<std::string> mons_desc = split(monster->description, 45);
@@ -1615,9 +1738,9 @@ static void io_print_pc_stats(dungeon *d)
   mvprintw(15, 44, " %-10s %d", "HP:", d->PC->hp);
   for (i = damage = 0; i < num_eq_slots; i++) {
     if (i == eq_slot_weapon && !d->PC->eq[i]) {
-      damage += d->PC->damage->roll();
+      damage += d->PC->damage->roll(&d->rng[rng_display]);
     } else if (d->PC->eq[i]) {
-      damage += d->PC->eq[i]->roll_dice();
+      damage += d->PC->eq[i]->roll_dice(&d->rng[rng_display]);
     }
   }
   mvprintw(16, 44, " %-10s %d", "Damage:", damage);
@@ -1782,7 +1905,7 @@ static void io_add_gold(dungeon *d)
 { 
   pair_t p;
   std::vector<object_description> &v = d->object_descriptions;
-  object *ingot = new object(v[1], p, NULL);
+  object *ingot = new object(d, v[1], p, NULL);
   object *o;
   if (d->PC->has_gold_in_inv()){
     o = d->PC->in[d->PC->get_gold_slot()];
@@ -1995,7 +2118,7 @@ void io_handle_input(dungeon *d)
   fd_set readfs;
   struct timeval tv;
   uint32_t fog_off = 0;
-  pair_t tmp = { DUNGEON_X, DUNGEON_Y };
+  pair_t tmp = { -1, -1 };
 
   do {
     do{
@@ -4,6 +4,8 @@
 typedef struct dungeon dungeon_t;
 
 void io_init_terminal(void);
+void io_init_headless(void);
+int io_init_offscreen(void);
 void io_reset_terminal(void);
 void io_display(dungeon_t *d);
 void io_handle_input(dungeon_t *d);
@@ -0,0 +1,623 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "level.h"
+#include "dungeon.h"
+#include "utils.h"
+#include "pc.h"
+#include "npc.h"
+#include "io.h"
+#include "object.h"
+#include "event.h"
+
+typedef struct level_monster {
+  npc *n;
+  /* Time until its next turn, counted from when the PC left. */
+  uint32_t delay;
+} level_monster_t;
+
+typedef struct level_pile {
+  pair_t cell;
+  object *o;
+} level_pile_t;
+
+typedef struct level {
+  int32_t depth;
+  grid<terrain_type_t> map;
+  grid<uint8_t> hardness;
+  grid<terrain_type_t> known;
+  pair_t pc_position;
+  uint32_t num_rooms;
+  room_t *rooms;
+  uint16_t num_objects;
+  std::vector<level_monster_t> monsters;
+  std::vector<level_pile_t> piles;
+} level_t;
+
+/* What a spilled level keeps of a monster or an object.  Descriptions  *
+ * are stored by index, so spill files only make sense to the game that *
+ * wrote them, which is all they're for.  Objects are written pile by   *
+ * pile, top first.                                                     */
+typedef struct level_npc_record {
+  uint32_t description;
+  uint32_t delay;
+  int16_t position[num_dims];
+  int16_t pc_last_known_position[num_dims];
+  int32_t speed;
+  uint32_t hp;
+  uint32_t sequence_number;
+  uint32_t kills[num_kill_types];
+  uint32_t characteristics;
+  uint32_t have_seen_pc;
+} level_npc_record_t;
+
+typedef struct level_object_record {
+  uint32_t description;
+  int16_t cell[num_dims];
+  int16_t position[num_dims];
+  int32_t hit, dodge, defence, weight, speed, attribute, value;
+  uint32_t seen;
+} level_object_record_t;
+
+struct level_store {
+  /* Most recently left first. */
+  std::vector<level_t *> resident;
+  std::vector<int32_t> spilled;
+  /* Created on the first spill.  If that fails, nothing is spilled. */
+  std::string dir;
+  bool no_spill;
+
+  static void spill(dungeon_t *d, level_t *l, FILE *f);
+  static level_t *unspill(dungeon_t *d, FILE *f);
+  static void count_in(level_t *l);
+};
+
+static void level_delete(level_t *l)
+{
+  uint32_t i;
+
+  for (i = 0; i < l->monsters.size(); i++) {
+    delete l->monsters[i].n;
+  }
+  for (i = 0; i < l->piles.size(); i++) {
+    delete l->piles[i].o;
+  }
+  free(l->rooms);
+  delete l;
+}
+
+static void level_write(FILE *f, const void *p, size_t size)
+{
+  if (fwrite(p, size, 1, f) != 1) {
+    perror("Writing level");
+    exit(-1);
+  }
+}
+
+static void level_read(FILE *f, void *p, size_t size)
+{
+  if (fread(p, size, 1, f) != 1) {
+    fprintf(stderr, "Spilled level is truncated.\n");
+    exit(-1);
+  }
+}
+
+static std::string level_file(level_store_t *s, int32_t depth)
+{
+  return s->dir + "/" + std::to_string(depth);
+}
+
+void level_store::spill(dungeon_t *d, level_t *l, FILE *f)
+{
+  level_object_record_t or_;
+  level_npc_record_t nr;
+  uint32_t version, i, n;
+  object *o;
+  npc *m;
+
+  version = LEVEL_SAVE_VERSION;
+  level_write(f, LEVEL_SAVE_SEMANTIC, sizeof (LEVEL_SAVE_SEMANTIC) - 1);
+  level_write(f, &version, sizeof (version));
+  level_write(f, &l->depth, sizeof (l->depth));
+  level_write(f, l->map.data(), l->map.bytes());
+  level_write(f, l->hardness.data(), l->hardness.bytes());
+  level_write(f, l->known.data(), l->known.bytes());
+  level_write(f, l->pc_position, sizeof (l->pc_position));
+  level_write(f, &l->num_rooms, sizeof (l->num_rooms));
+  level_write(f, l->rooms, l->num_rooms * sizeof (*l->rooms));
+
+  n = l->monsters.size();
+  level_write(f, &n, sizeof (n));
+  for (i = 0; i < l->monsters.size(); i++) {
+    m = l->monsters[i].n;
+    memset(&nr, 0, sizeof (nr));
+    nr.description = &m->md - &d->monster_descriptions[0];
+    nr.delay = l->monsters[i].delay;
+    nr.position[dim_x] = m->position[dim_x];
+    nr.position[dim_y] = m->position[dim_y];
+    nr.pc_last_known_position[dim_x] = m->pc_last_known_position[dim_x];
+    nr.pc_last_known_position[dim_y] = m->pc_last_known_position[dim_y];
+    nr.speed = m->speed;
+    nr.hp = m->hp;
+    nr.sequence_number = m->sequence_number;
+    memcpy(nr.kills, m->kills, sizeof (nr.kills));
+    nr.characteristics = m->characteristics;
+    nr.have_seen_pc = m->have_seen_pc;
+    level_write(f, &nr, sizeof (nr));
+  }
+
+  for (n = i = 0; i < l->piles.size(); i++) {
+    for (o = l->piles[i].o; o; o = o->next) {
+      n++;
+    }
+  }
+  level_write(f, &l->num_objects, sizeof (l->num_objects));
+  level_write(f, &n, sizeof (n));
+  for (i = 0; i < l->piles.size(); i++) {
+    for (o = l->piles[i].o; o; o = o->next) {
+      memset(&or_, 0, sizeof (or_));
+      or_.description = &o->od - &d->object_descriptions[0];
+      or_.cell[dim_x] = l->piles[i].cell[dim_x];
+      or_.cell[dim_y] = l->piles[i].cell[dim_y];
+      or_.position[dim_x] = o->position[dim_x];
+      or_.position[dim_y] = o->position[dim_y];
+      or_.hit = o->hit;
+      or_.dodge = o->dodge;
+      or_.defence = o->defence;
+      or_.weight = o->weight;
+      or_.speed = o->speed;
+      or_.attribute = o->attribute;
+      or_.value = o->value;
+      or_.seen = o->seen;
+      level_write(f, &or_, sizeof (or_));
+    }
+  }
+}
+
+/* Deleting a spilled level would count its uniques dead and its *
+ * artifacts gone, so they're counted in again first; on disk,   *
+ * they're still around.                                         */
+void level_store::count_in(level_t *l)
+{
+  uint32_t i;
+  object *o;
+
+  for (i = 0; i < l->monsters.size(); i++) {
+    l->monsters[i].n->md.birth();
+  }
+  for (i = 0; i < l->piles.size(); i++) {
+    for (o = l->piles[i].o; o; o = o->next) {
+      o->od.generate();
+    }
+  }
+}
+
+level_t *level_store::unspill(dungeon_t *d, FILE *f)
+{
+  char semantic[sizeof (LEVEL_SAVE_SEMANTIC) - 1];
+  std::vector<uint8_t> taken;
+  level_object_record_t or_;
+  level_npc_record_t nr;
+  uint32_t version, i, n;
+  level_monster_t lm;
+  level_pile_t lp;
+  object *o, *top;
+  level_t *l;
+  npc *m;
+
+  level_read(f, semantic, sizeof (semantic));
+  level_read(f, &version, sizeof (version));
+  if (memcmp(semantic, LEVEL_SAVE_SEMANTIC, sizeof (semantic)) ||
+      version != LEVEL_SAVE_VERSION) {
+    return NULL;
+  }
+
+  l = new level_t();
+  level_read(f, &l->depth, sizeof (l->depth));
+  l->map.resize(d->width, d->height);
+  l->hardness.resize(d->width, d->height);
+  l->known.resize(d->width, d->height);
+  level_read(f, l->map.data(), l->map.bytes());
+  level_read(f, l->hardness.data(), l->hardness.bytes());
+  level_read(f, l->known.data(), l->known.bytes());
+  level_read(f, l->pc_position, sizeof (l->pc_position));
+  level_read(f, &l->num_rooms, sizeof (l->num_rooms));
+  if (!l->num_rooms                                  ||
+      l->num_rooms > (uint32_t) d->width * d->height ||
+      !terrain_in_range(l->map, 1)                   ||
+      !terrain_in_range(l->known, 0)                 ||
+      l->pc_position[dim_y] < 1                      ||
+      l->pc_position[dim_y] > d->height - 2          ||
+      l->pc_position[dim_x] < 1                      ||
+      l->pc_position[dim_x] > d->width - 2)          {
+    level_delete(l);
+    return NULL;
+  }
+  l->rooms = (room_t *) malloc(l->num_rooms * sizeof (*l->rooms));
+  level_read(f, l->rooms, l->num_rooms * sizeof (*l->rooms));
+  for (i = 0; i < l->num_rooms; i++) {
+    if (!room_in_dungeon(d, &l->rooms[i])) {
+      level_delete(l);
+      return NULL;
+    }
+  }
+
+  /* level_store_enter() puts everything straight into the dungeon's *
+   * maps, so no two characters, and no two piles, may share a cell. */
+  taken.resize((size_t) d->width * d->height);
+  taken[l->pc_position[dim_y] * d->width + l->pc_position[dim_x]] = 1;
+
+  level_read(f, &n, sizeof (n));
+  for (i = 0; i < n; i++) {
+    level_read(f, &nr, sizeof (nr));
+    if (nr.description >= d->monster_descriptions.size() ||
+        nr.position[dim_y] < 1                           ||
+        nr.position[dim_y] > d->height - 2               ||
+        nr.position[dim_x] < 1                           ||
+        nr.position[dim_x] > d->width - 2                ||
+        nr.speed < 1                                     ||
+        nr.speed > MAX_SPEED                             ||
+        nr.delay >= EVENT_QUEUE_DAYS                     ||
+        (taken[nr.position[dim_y] * d->width +
+               nr.position[dim_x]] & 1))                 {
+      level_delete(l);
+      return NULL;
+    }
+    taken[nr.position[dim_y] * d->width + nr.position[dim_x]] |= 1;
+    m = new npc(d->monster_descriptions[nr.description]);
+    m->position[dim_x] = nr.position[dim_x];
+    m->position[dim_y] = nr.position[dim_y];
+    m->pc_last_known_position[dim_x] = nr.pc_last_known_position[dim_x];
+    m->pc_last_known_position[dim_y] = nr.pc_last_known_position[dim_y];
+    m->speed = nr.speed;
+    m->hp = nr.hp;
+    m->sequence_number = nr.sequence_number;
+    memcpy(m->kills, nr.kills, sizeof (m->kills));
+    m->characteristics = nr.characteristics;
+    m->have_seen_pc = nr.have_seen_pc;
+    lm.n = m;
+    lm.delay = nr.delay;
+    l->monsters.push_back(lm);
+  }
+
+  level_read(f, &l->num_objects, sizeof (l->num_objects));
+  level_read(f, &n, sizeof (n));
+  for (top = NULL, i = 0; i < n; i++) {
+    level_read(f, &or_, sizeof (or_));
+    if (or_.description >= d->object_descriptions.size() ||
+        or_.cell[dim_y] < 0                              ||
+        or_.cell[dim_y] >= d->height                     ||
+        or_.cell[dim_x] < 0                              ||
+        or_.cell[dim_x] >= d->width)                     {
+      level_delete(l);
+      return NULL;
+    }
+    o = new object(d->object_descriptions[or_.description], NULL);
+    o->position[dim_x] = or_.position[dim_x];
+    o->position[dim_y] = or_.position[dim_y];
+    o->hit = or_.hit;
+    o->dodge = or_.dodge;
+    o->defence = or_.defence;
+    o->weight = or_.weight;
+    o->speed = or_.speed;
+    o->attribute = or_.attribute;
+    o->value = or_.value;
+    o->seen = or_.seen;
+
+    if (l->piles.empty() ||
+        l->piles.back().cell[dim_x] != or_.cell[dim_x] ||
+        l->piles.back().cell[dim_y] != or_.cell[dim_y]) {
+      if (taken[or_.cell[dim_y] * d->width + or_.cell[dim_x]] & 2) {
+        delete o;
+        level_delete(l);
+        return NULL;
+      }
+      taken[or_.cell[dim_y] * d->width + or_.cell[dim_x]] |= 2;
+      lp.cell[dim_x] = or_.cell[dim_x];
+      lp.cell[dim_y] = or_.cell[dim_y];
+      lp.o = o;
+      l->piles.push_back(lp);
+    } else {
+      top->next = o;
+    }
+    top = o;
+  }
+
+  return l;
+}
+
+static level_store_t *level_store_get(dungeon_t *d)
+{
+  if (!d->levels) {
+    d->levels = new level_store_t();
+    d->levels->no_spill = false;
+  }
+
+  return d->levels;
+}
+
+static void level_spill(dungeon_t *d, level_store_t *s)
+{
+  std::string file;
+  char *home, *dir;
+  level_t *l;
+  FILE *f;
+
+  if (s->dir.empty() && !s->no_spill) {
+    if (!(home = getenv("HOME"))) {
+      home = (char *) ".";
+    }
+    dir = (char *) malloc(strlen(home) + strlen(SAVE_DIR) +
+                          sizeof ("/levels.XXXXXX") + 2);
+    sprintf(dir, "%s/%s/", home, SAVE_DIR);
+    makedirectory(dir);
+    strcat(dir, "levels.XXXXXX");
+    if (mkdtemp(dir)) {
+      s->dir = dir;
+    } else {
+      perror(dir);
+      s->no_spill = true;
+    }
+    free(dir);
+  }
+
+  /* With nowhere to put them, levels just stay in memory. */
+  if (s->no_spill) {
+    return;
+  }
+
+  l = s->resident.back();
+  file = level_file(s, l->depth);
+  if (!(f = fopen(file.c_str(), "w"))) {
+    perror(file.c_str());
+    exit(-1);
+  }
+  level_store::spill(d, l, f);
+  fclose(f);
+
+  level_store::count_in(l);
+
+  s->resident.pop_back();
+  s->spilled.push_back(l->depth);
+  level_delete(l);
+}
+
+void level_store_leave(dungeon_t *d)
+{
+  level_monster_t lm;
+  level_pile_t lp;
+  level_store_t *s;
+  uint32_t y, x;
+  level_t *l;
+  event_t *e;
+
+  s = level_store_get(d);
+
+  l = new level_t();
+  l->depth = d->depth;
+
+  /* The only events are monster turns.  The PC's is being handled. */
+  while (!d->events.empty()) {
+    e = d->events.pop();
+    if (e->type == event_character_turn && e->c != d->PC) {
+      lm.n = (npc *) e->c;
+      lm.n->turn = NULL;
+      lm.delay = e->time - d->time;
+      l->monsters.push_back(lm);
+    }
+    if (e != &d->pc_event) {
+      d->events.release(e);
+    }
+  }
+  memset(d->census, 0, sizeof (d->census));
+  d->num_monsters = 0;
+
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
+      if (d->objmap[y][x]) {
+        lp.cell[dim_x] = x;
+        lp.cell[dim_y] = y;
+        lp.o = d->objmap[y][x];
+        l->piles.push_back(lp);
+        d->objmap[y][x] = NULL;
+      }
+    }
+  }
+  l->num_objects = d->num_objects;
+  d->num_objects = 0;
+
+  /* The next level's terrain replaces the map, so it's moved, not *
+   * copied.  A backed map is handed back to the kernel whole.     */
+  l->map = std::move(d->map);
+  l->hardness = std::move(d->hardness);
+  l->map.evict(0, l->map.height());
+  l->hardness.evict(0, l->hardness.height());
+  l->known.copy(d->PC->known_terrain);
+  l->pc_position[dim_x] = d->PC->position[dim_x];
+  l->pc_position[dim_y] = d->PC->position[dim_y];
+  l->rooms = d->rooms;
+  l->num_rooms = d->num_rooms;
+  d->rooms = NULL;
+  d->num_rooms = 0;
+  d->character_map.clear();
+
+  s->resident.insert(s->resident.begin(), l);
+  if (s->resident.size() > LEVEL_CACHE_SIZE) {
+    level_spill(d, s);
+  }
+}
+
+uint32_t level_store_enter(dungeon_t *d)
+{
+  uint32_t sequence_number, event_sequence_number, i;
+  std::vector<int32_t>::iterator spilled;
+  std::string file;
+  level_store_t *s;
+  level_t *l;
+  npc *m;
+  FILE *f;
+
+  if (!(s = d->levels)) {
+    return 0;
+  }
+
+  for (l = NULL, i = 0; i < s->resident.size(); i++) {
+    if (s->resident[i]->depth == d->depth) {
+      l = s->resident[i];
+      s->resident.erase(s->resident.begin() + i);
+      break;
+    }
+  }
+  if (!l) {
+    spilled = std::find(s->spilled.begin(), s->spilled.end(), d->depth);
+    if (spilled == s->spilled.end()) {
+      return 0;
+    }
+    file = level_file(s, d->depth);
+    if (!(f = fopen(file.c_str(), "r"))) {
+      perror(file.c_str());
+      exit(-1);
+    }
+    if (!(l = level_store::unspill(d, f))) {
+      fprintf(stderr, "Spilled level is corrupt.\n");
+      exit(-1);
+    }
+    fclose(f);
+    unlink(file.c_str());
+    s->spilled.erase(spilled);
+  }
+
+  sequence_number = d->character_sequence_number;
+  event_sequence_number = d->event_sequence_number;
+
+  delete_dungeon(d);
+  d->map = std::move(l->map);
+  d->hardness = std::move(l->hardness);
+  d->rooms = l->rooms;
+  d->num_rooms = l->num_rooms;
+  l->rooms = NULL;
+  d->is_new = 1;
+  reset_level(d);
+  d->character_sequence_number = sequence_number;
+  d->event_sequence_number = event_sequence_number;
+
+  d->PC->position[dim_x] = l->pc_position[dim_x];
+  d->PC->position[dim_y] = l->pc_position[dim_y];
+  d->character_map[d->PC->position[dim_y]][d->PC->position[dim_x]] = d->PC;
+  d->PC->known_terrain = std::move(l->known);
+  pc_reset_visibility(d->PC);
+  pc_observe_terrain(d->PC, d);
+
+  /* Monsters pick up where they left off, relative to the PC. */
+  for (i = 0; i < l->monsters.size(); i++) {
+    m = l->monsters[i].n;
+    d->character_map[m->position[dim_y]][m->position[dim_x]] = m;
+    d->census[m->characteristics & NPC_MOVE_BITS]++;
+    d->events.push(new_event(d, event_character_turn, m,
+                             l->monsters[i].delay));
+  }
+  d->num_monsters = l->monsters.size();
+  l->monsters.clear();
+
+  for (i = 0; i < l->piles.size(); i++) {
+    d->objmap[l->piles[i].cell[dim_y]][l->piles[i].cell[dim_x]] =
+      l->piles[i].o;
+  }
+  d->num_objects = l->num_objects;
+  l->piles.clear();
+
+  level_delete(l);
+
+  if (!d->headless) {
+    io_display(d);
+  }
+
+  return 1;
+}
+
+uint32_t level_store_write(dungeon_t *d, FILE *f)
+{
+  std::vector<char> buf;
+  level_store_t *s;
+  std::string file;
+  FILE *spilled;
+  uint32_t i;
+  long size;
+
+  if (!(s = d->levels)) {
+    return 0;
+  }
+
+  for (i = 0; i < s->resident.size(); i++) {
+    level_store::spill(d, s->resident[i], f);
+  }
+  /* Spill files are already what spill() would write.  Like the   *
+   * resident levels, they go most recently left first, so reading *
+   * them back spills them again in the order they were spilled.   */
+  for (i = s->spilled.size(); i--; ) {
+    file = level_file(s, s->spilled[i]);
+    if (!(spilled = fopen(file.c_str(), "r")) ||
+        fseek(spilled, 0, SEEK_END)            ||
+        (size = ftell(spilled)) < 0            ||
+        fseek(spilled, 0, SEEK_SET))           {
+      perror(file.c_str());
+      exit(-1);
+    }
+    buf.resize(size);
+    level_read(spilled, buf.data(), size);
+    level_write(f, buf.data(), size);
+    fclose(spilled);
+  }
+
+  return s->resident.size() + s->spilled.size();
+}
+
+uint32_t level_store_read(dungeon_t *d, FILE *f, uint32_t n)
+{
+  level_store_t *s;
+  uint32_t i;
+  level_t *l;
+
+  s = level_store_get(d);
+
+  for (i = 0; i < n; i++) {
+    if (!(l = level_store::unspill(d, f))) {
+      return 1;
+    }
+    s->resident.push_back(l);
+  }
+  while (s->resident.size() > LEVEL_CACHE_SIZE) {
+    level_spill(d, s);
+  }
+
+  return 0;
+}
+
+void level_store_delete(dungeon_t *d)
+{
+  level_store_t *s;
+  uint32_t i;
+
+  if (!(s = d->levels)) {
+    return;
+  }
+
+  for (i = 0; i < s->resident.size(); i++) {
+    level_delete(s->resident[i]);
+  }
+  for (i = 0; i < s->spilled.size(); i++) {
+    unlink(level_file(s, s->spilled[i]).c_str());
+  }
+  if (!s->dir.empty()) {
+    rmdir(s->dir.c_str());
+  }
+
+  delete s;
+  d->levels = NULL;
+}
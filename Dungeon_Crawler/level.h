@@ -0,0 +1,36 @@
+#ifndef LEVEL_H
+# define LEVEL_H
+
+# include <stdio.h>
+# include <stdint.h>
+
+typedef struct dungeon dungeon_t;
+
+/* Levels the PC has left, kept by depth so that the stairs lead back to *
+ * them: terrain as tunneled, monsters where they stood and when they    *
+ * were next due to move, objects, and what the PC had learned of the    *
+ * map.  The most recently left LEVEL_CACHE_SIZE levels stay in memory;  *
+ * older ones are spilled to files in a directory of their own under     *
+ * SAVE_DIR, which level_store_delete() removes along with everything    *
+ * else.                                                                 */
+typedef struct level_store level_store_t;
+
+# define LEVEL_CACHE_SIZE      4
+# define LEVEL_SAVE_SEMANTIC   "RLG327-LEVEL"
+# define LEVEL_SAVE_VERSION    0U
+
+/* Takes the current level out of the dungeon and files it under *
+ * d->depth.  The PC stays, and is in no level.                  */
+void level_store_leave(dungeon_t *d);
+/* Puts the level filed under d->depth back into the dungeon, with the *
+ * PC where it was when it left.  Returns 0 if there is no such level. */
+uint32_t level_store_enter(dungeon_t *d);
+/* For saved games.  level_store_write() writes every level in the  *
+ * store to f, in the format of a spill file, and returns how many; *
+ * level_store_read() files n of them back into the store, and      *
+ * returns nonzero if one of them is corrupt.                       */
+uint32_t level_store_write(dungeon_t *d, FILE *f);
+uint32_t level_store_read(dungeon_t *d, FILE *f, uint32_t n);
+void level_store_delete(dungeon_t *d);
+
+#endif
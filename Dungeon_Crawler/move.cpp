@@ -5,7 +5,6 @@
 #include <assert.h>
 
 #include "dungeon.h"
-#include "heap.h"
 #include "move.h"
 #include "npc.h"
 #include "pc.h"
@@ -89,18 +88,21 @@ void do_combat(dungeon_t *d, character *atk, character *def)
   };
   if (character_is_alive(def)) {
     if (atk != d->PC) {
-      damage = atk->damage->roll();
+      damage = atk->damage->roll(&d->rng[rng_combat]);
       io_queue_message("%s%s %s your %s for %d.", is_unique(atk) ? "" : "The ",
-                       atk->name, attacks[rand() % (sizeof (attacks) /
-                                                    sizeof (attacks[0]))],
-                       organs[rand() % (sizeof (organs) /
-                                        sizeof (organs[0]))], damage);
+                       atk->name,
+                       attacks[rng_under(&d->rng[rng_display],
+                                         (sizeof (attacks) /
+                                          sizeof (attacks[0])))],
+                       organs[rng_under(&d->rng[rng_display],
+                                        (sizeof (organs) /
+                                         sizeof (organs[0])))], damage);
     } else {
       for (i = damage = 0; i < num_eq_slots; i++) {
         if (i == eq_slot_weapon && !d->PC->eq[i]) {
-          damage += atk->damage->roll();
+          damage += atk->damage->roll(&d->rng[rng_combat]);
         } else if (d->PC->eq[i]) {
-          damage += d->PC->eq[i]->roll_dice();
+          damage += d->PC->eq[i]->roll_dice(&d->rng[rng_combat]);
         }
       }
       io_queue_message("You hit %s%s for %d.", is_unique(def) ? "" : "the ",
@@ -111,8 +113,10 @@ void do_combat(dungeon_t *d, character *atk, character *def)
       if (atk != d->PC) {
         io_queue_message("You die.");
         io_queue_message("As %s%s eats your %s,", is_unique(atk) ? "" : "the ",
-                         atk->name, organs[rand() % (sizeof (organs) /
-                                                     sizeof (organs[0]))]);
+                         atk->name,
+                         organs[rng_under(&d->rng[rng_display],
+                                          (sizeof (organs) /
+                                           sizeof (organs[0])))]);
         io_queue_message("   ...you wonder if there is an afterlife.");
         /* Queue an empty message, otherwise the game will not pause for *
          * player to see above.                                          */
@@ -125,10 +129,14 @@ void do_combat(dungeon_t *d, character *atk, character *def)
       character_increment_dkills(atk);
       character_increment_ikills(atk, (character_get_dkills(def) +
                                        character_get_ikills(def)));
+      charpair(def->position) = NULL;
       if (def != d->PC) {
         d->num_monsters--;
+        d->census[((npc *) def)->characteristics & NPC_MOVE_BITS]--;
+        /* Monsters only die on the PC's turn, when every monster's *
+         * turn is in the queue.                                    */
+        event_cancel(d, def->turn);
       }
-      charpair(def->position) = NULL;
     } else {
       def->hp -= damage;
     }
@@ -171,11 +179,14 @@ void move_character(dungeon_t *d, character *c, pair_t next)
        * instead select a random square from the 8 surrounding    *
        * the target cell.  Keep doing it until either we swap or  *
        * find an empty one for the displacement.                  */
-      for (s = rand() % 9, found_cell = i = 0; i < 9 && !found_cell; i++) {
+      for (s = rng_under(&d->rng[rng_ai], 9), found_cell = i = 0; i < 9 && !found_cell; i++) {
         displacement[dim_y] = next[dim_y] + order[s % 9][dim_y];
         displacement[dim_x] = next[dim_x] + order[s % 9][dim_x];
         if (((npc *) charpair(next))->characteristics & NPC_PASS_WALL) {
-          if (!charpair(displacement) ||
+          /* Even wall passers can't be shoved into the outer wall; *
+           * nothing may ever leave the map.                        */
+          if ((!charpair(displacement) &&
+               (mappair(displacement) != ter_wall_immutable)) ||
               (charpair(displacement) == c)) {
             found_cell = 1;
           }
@@ -243,14 +254,14 @@ void do_moves(dungeon *d)
   event_t *e;
 
   /* Remove the PC when it is PC turn.  Replace on next call.  This allows *
-   * use to completely uninit the heap when generating a new level without *
-   * worrying about deleting the PC.                                       */
+   * use to completely uninit the queue when generating a new level        *
+   * without worrying about deleting the PC.                               */
 
   if (pc_is_alive(d)) {
     /* The PC always goes first one a tie, so we don't use new_event().  *
-     * We generate one manually so that we can set the PC sequence       *
-     * number to zero.                                                   */
-    e = (event_t *) malloc(sizeof (*e));
+     * We reuse the same event every turn, with the PC sequence number   *
+     * set to zero.                                                      */
+    e = &d->pc_event;
     e->type = event_character_turn;
     /* Hack: New dungeons are marked.  Unmark and ensure PC goes at d->time, *
      * otherwise, monsters get a turn before the PC.                         */
@@ -262,42 +273,39 @@ void do_moves(dungeon *d)
     }
     e->sequence = 0;
     e->c = d->PC;
-    heap_insert(&d->events, e);
+    d->PC->turn = e;
+    d->events.push(e);
   }
 
-  while (pc_is_alive(d) &&
-         (e = (event_t *) heap_remove_min(&d->events)) &&
+  while (pc_is_alive(d) && !d->events.empty() &&
+         (e = d->events.pop()) &&
          ((e->type != event_character_turn) || (e->c != d->PC))) {
     d->time = e->time;
     if (e->type == event_character_turn) {
       c = e->c;
     }
-    if (!c->alive) {
-      if (d->character_map[c->position[dim_y]][c->position[dim_x]] == c) {
-        d->character_map[c->position[dim_y]][c->position[dim_x]] = NULL;
-      }
-      if (c != d->PC) {
-        event_delete(e);
-      }
-      continue;
-    }
+    /* Dead monsters have their turns cancelled in do_combat(). */
+    assert(c->alive);
 
     npc_next_pos(d, (npc *) c, next);
     move_character(d, c, next);
+    chunk_touch(d, c->position[dim_y]);
 
-    heap_insert(&d->events, update_event(d, e, 1000 / c->speed));
+    d->events.push(update_event(d, e, 1000 / c->speed));
   }
 
-  io_display(d);
+  if (!d->headless) {
+    io_display(d);
+  }
   if (pc_is_alive(d) && e->c == d->PC) {
     c = e->c;
     d->time = e->time;
-    /* Kind of kludgey, but because the PC is never in the queue when   *
-     * we are outside of this function, the PC event has to get deleted *
-     * and recreated every time we leave and re-enter this function.    */
-    e->c = NULL;
-    event_delete(e);
-    io_handle_input(d);
+    chunk_sweep(d);
+    if (d->headless) {
+      move_pc_autopilot(d);
+    } else {
+      io_handle_input(d);
+    }
   }
 }
 
@@ -305,11 +313,11 @@ void dir_nearest_wall(dungeon *d, character *c, pair_t dir)
 {
   dir[dim_x] = dir[dim_y] = 0;
 
-  if (c->position[dim_x] != 1 && c->position[dim_x] != DUNGEON_X - 2) {
-    dir[dim_x] = (c->position[dim_x] > DUNGEON_X - c->position[dim_x] ? 1 : -1);
+  if (c->position[dim_x] != 1 && c->position[dim_x] != d->width - 2) {
+    dir[dim_x] = (c->position[dim_x] > d->width - c->position[dim_x] ? 1 : -1);
   }
-  if (c->position[dim_y] != 1 && c->position[dim_y] != DUNGEON_Y - 2) {
-    dir[dim_y] = (c->position[dim_y] > DUNGEON_Y - c->position[dim_y] ? 1 : -1);
+  if (c->position[dim_y] != 1 && c->position[dim_y] != d->height - 2) {
+    dir[dim_y] = (c->position[dim_y] > d->height - c->position[dim_y] ? 1 : -1);
   }
 }
 
@@ -345,24 +353,34 @@ uint32_t in_corner(dungeon *d, character *c)
 
 static void new_dungeon_level(dungeon *d, uint32_t dir)
 {
-  /* Eventually up and down will be independantly meaningful. *
-   * For now, simply generate a new dungeon.                  */
+  /* The level being left is kept, and the stairs lead back to it; *
+   * a level the PC hasn't been to yet is generated.               */
 
   switch (dir) {
   case '<':
     io_queue_message("You go up the stairs.");
     io_queue_message(""); /* To force "more" */
-    io_display(d); /* To force queue flush */
-    new_dungeon(d);
+    if (!d->headless) {
+      io_display(d); /* To force queue flush */
+    }
+    level_store_leave(d);
+    d->depth--;
     break;
   case '>':
     io_queue_message("You go down the stairs.");
     io_queue_message(""); /* To force "more" */
-    io_display(d); /* To force queue flush */
-    new_dungeon(d);
+    if (!d->headless) {
+      io_display(d); /* To force queue flush */
+    }
+    level_store_leave(d);
+    d->depth++;
     break;
   default:
-    break;
+    return;
+  }
+
+  if (!level_store_enter(d)) {
+    new_dungeon(d);
   }
 }
 
@@ -427,8 +445,7 @@ uint32_t move_pc(dungeon *d, uint32_t dir)
 
   if ((dir != '>') && (dir != '<') && (mappair(next) >= ter_floor)) {
     move_character(d, d->PC, next);
-    dijkstra(d);
-    dijkstra_tunnel(d);
+    dijkstra_invalidate(d);
     d->PC->pick_up(d);
 
     return 0;
@@ -436,3 +453,29 @@ uint32_t move_pc(dungeon *d, uint32_t dir)
 
   return 1;
 }
+
+void move_pc_autopilot(dungeon *d)
+{
+  /* Maps pc_next_pos() directions onto the numeric keypad codes that *
+   * move_pc() takes, indexed by [dy + 1][dx + 1].                    */
+  static const uint32_t keypad[3][3] = {
+    { 7, 8, 9 },
+    { 4, 5, 6 },
+    { 1, 2, 3 }
+  };
+  pair_t dir;
+
+  /* The autopilot doesn't know how to find the stairs, so once the level *
+   * is cleared, take it down as if it had.                               */
+  if (!dungeon_has_npcs(d)) {
+    new_dungeon_level(d, '>');
+    return;
+  }
+
+  pc_next_pos(d, dir);
+
+  /* Resting, or a failed move into rock, costs the PC its turn. */
+  if (dir[dim_y] || dir[dim_x]) {
+    move_pc(d, keypad[dir[dim_y] + 1][dir[dim_x] + 1]);
+  }
+}
@@ -17,6 +17,7 @@ void dir_nearest_wall(dungeon *d, character *c, pair_t dir);
 uint32_t in_corner(dungeon *d, character *c);
 uint32_t against_wall(dungeon *d, character *c);
 uint32_t move_pc(dungeon *d, uint32_t dir);
+void move_pc_autopilot(dungeon *d);
 void move_character(dungeon *d, character *c, pair_t next);
 
 #endif
@@ -49,7 +49,7 @@ void npc_next_pos_rand_tunnel(dungeon_t *d, npc *c, pair_t next)
   do {
     n[dim_y] = next[dim_y];
     n[dim_x] = next[dim_x];
-    r.i = rand();
+    r.i = rng_next(&d->rng[rng_ai]);
     if (r.a[0] > 85 /* 255 / 3 */) {
       if (r.a[0] & 1) {
         n[dim_y]--;
@@ -72,14 +72,14 @@ void npc_next_pos_rand_tunnel(dungeon_t *d, npc *c, pair_t next)
       mappair(n) = ter_floor_hall;
 
       /* Update distance maps because map has changed. */
-      dijkstra(d);
-      dijkstra_tunnel(d);
+      dijkstra_repair(d, n);
     }
 
     next[dim_x] = n[dim_x];
     next[dim_y] = n[dim_y];
   } else {
     hardnesspair(n) -= 85;
+    dijkstra_repair(d, n);
   }
 }
 
@@ -94,7 +94,7 @@ void npc_next_pos_rand(dungeon_t *d, npc *c, pair_t next)
   do {
     n[dim_y] = next[dim_y];
     n[dim_x] = next[dim_x];
-    r.i = rand();
+    r.i = rng_next(&d->rng[rng_ai]);
     if (r.a[0] > 85 /* 255 / 3 */) {
       if (r.a[0] & 1) {
         n[dim_y]--;
@@ -126,7 +126,7 @@ void npc_next_pos_rand_pass(dungeon *d, character *c, pair_t next)
   do {
     n[dim_y] = next[dim_y];
     n[dim_x] = next[dim_x];
-    r.i = rand();
+    r.i = rng_next(&d->rng[rng_ai]);
     if (r.a[0] > 85 /* 255 / 3 */) {
       if (r.a[0] & 1) {
         n[dim_y]--;
@@ -200,14 +200,14 @@ void npc_next_pos_line_of_sight_tunnel(dungeon_t *d,
       mappair(dir) = ter_floor_hall;
 
       /* Update distance maps because map has changed. */
-      dijkstra(d);
-      dijkstra_tunnel(d);
+      dijkstra_repair(d, dir);
     }
 
     next[dim_x] = dir[dim_x];
     next[dim_y] = dir[dim_y];
   } else {
     hardnesspair(dir) -= 60;
+    dijkstra_repair(d, dir);
   }
 }
 
@@ -215,8 +215,11 @@ void npc_next_pos_gradient(dungeon_t *d, npc *c, pair_t next)
 {
   /* Handles both tunneling and non-tunneling versions */
   pair_t min_next;
-  uint16_t min_cost;
+  /* Wide enough that the border, PATH_UNREACHED away, never wraps *
+   * around to look like the cheapest way through.                 */
+  uint32_t min_cost;
   if (c->characteristics & NPC_TUNNEL) {
+    dijkstra_tunnel_ensure(d);
     min_cost = (d->pc_tunnel[next[dim_y] - 1][next[dim_x]] +
                 (d->hardness[next[dim_y] - 1][next[dim_x]] / 60));
     min_next[dim_x] = next[dim_x];
@@ -276,16 +279,17 @@ void npc_next_pos_gradient(dungeon_t *d, npc *c, pair_t next)
         mappair(min_next) = ter_floor_hall;
 
         /* Update distance maps because map has changed. */
-        dijkstra(d);
-        dijkstra_tunnel(d);
+        dijkstra_repair(d, min_next);
       }
 
       next[dim_x] = min_next[dim_x];
       next[dim_y] = min_next[dim_y];
     } else {
       hardnesspair(min_next) -= 60;
+      dijkstra_repair(d, min_next);
     }
   } else {
+    dijkstra_ensure(d);
     /* Make monsters prefer cardinal directions */
     if (d->pc_distance[next[dim_y] - 1][next[dim_x]    ] <
         d->pc_distance[next[dim_y]][next[dim_x]]) {
@@ -425,7 +429,7 @@ static void npc_next_pos_07(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_08(dungeon_t *d, npc *c, pair_t next)
 {
   /* not smart; not telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand(d, c, next);
   } else {
     npc_next_pos_00(d, c, next);
@@ -435,7 +439,7 @@ static void npc_next_pos_08(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_09(dungeon_t *d, npc *c, pair_t next)
 {
   /*     smart; not telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand(d, c, next);
   } else {
     npc_next_pos_01(d, c, next);
@@ -445,7 +449,7 @@ static void npc_next_pos_09(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_0a(dungeon_t *d, npc *c, pair_t next)
 {
   /* not smart;     telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand(d, c, next);
   } else {
     npc_next_pos_02(d, c, next);
@@ -455,7 +459,7 @@ static void npc_next_pos_0a(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_0b(dungeon_t *d, npc *c, pair_t next)
 {
   /*     smart;     telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand(d, c, next);
   } else {
     npc_next_pos_03(d, c, next);
@@ -465,7 +469,7 @@ static void npc_next_pos_0b(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_0c(dungeon_t *d, npc *c, pair_t next)
 {
   /* not smart; not telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_tunnel(d, c, next);
   } else {
     npc_next_pos_04(d, c, next);
@@ -475,7 +479,7 @@ static void npc_next_pos_0c(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_0d(dungeon_t *d, npc *c, pair_t next)
 {
   /*     smart; not telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_tunnel(d, c, next);
   } else {
     npc_next_pos_05(d, c, next);
@@ -485,7 +489,7 @@ static void npc_next_pos_0d(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_0e(dungeon_t *d, npc *c, pair_t next)
 {
   /* not smart;     telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_tunnel(d, c, next);
   } else {
     npc_next_pos_06(d, c, next);
@@ -495,7 +499,7 @@ static void npc_next_pos_0e(dungeon_t *d, npc *c, pair_t next)
 static void npc_next_pos_0f(dungeon_t *d, npc *c, pair_t next)
 {
   /*     smart;     telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_tunnel(d, c, next);
   } else {
     npc_next_pos_07(d, c, next);
@@ -577,7 +581,7 @@ static void npc_next_pos_17(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_18(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart; not telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_10(d, c, next);
@@ -587,7 +591,7 @@ static void npc_next_pos_18(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_19(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart; not telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_11(d, c, next);
@@ -597,7 +601,7 @@ static void npc_next_pos_19(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1a(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart;     telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_12(d, c, next);
@@ -607,7 +611,7 @@ static void npc_next_pos_1a(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1b(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart;     telepathic; not tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_13(d, c, next);
@@ -617,7 +621,7 @@ static void npc_next_pos_1b(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1c(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart; not telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_14(d, c, next);
@@ -627,7 +631,7 @@ static void npc_next_pos_1c(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1d(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart; not telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_15(d, c, next);
@@ -637,7 +641,7 @@ static void npc_next_pos_1d(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1e(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall; not smart;     telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_16(d, c, next);
@@ -647,7 +651,7 @@ static void npc_next_pos_1e(dungeon *d, npc *c, pair_t next)
 static void npc_next_pos_1f(dungeon *d, npc *c, pair_t next)
 {
   /* pass wall;     smart;     telepathic;     tunneling;     erratic */
-  if (rand() & 1) {
+  if (rng_next(&d->rng[rng_ai]) & 1) {
     npc_next_pos_rand_pass(d, c, next);
   } else {
     npc_next_pos_17(d, c, next);
@@ -698,7 +702,7 @@ void npc_next_pos(dungeon_t *d, npc *c, pair_t next)
   next[dim_y] = c->position[dim_y];
   next[dim_x] = c->position[dim_x];
 
-  npc_move_func[c->characteristics & 0x0000001f](d, c, next);
+  npc_move_func[c->characteristics & NPC_MOVE_BITS](d, c, next);
 }
 
 uint32_t dungeon_has_npcs(dungeon_t *d)
@@ -706,21 +710,38 @@ uint32_t dungeon_has_npcs(dungeon_t *d)
   return d->num_monsters;
 }
 
+/* Smart telepaths that don't pass through walls are the only monsters  *
+ * that follow the distance maps (npc_next_pos_gradient()); the erratic *
+ * ones do half of the time.                                            */
+uint32_t npc_census_uses_distance(dungeon_t *d)
+{
+  return (d->census[NPC_SMART | NPC_TELEPATH] +
+          d->census[NPC_SMART | NPC_TELEPATH | NPC_ERRATIC]);
+}
+
+uint32_t npc_census_uses_tunnel(dungeon_t *d)
+{
+  return (d->census[NPC_SMART | NPC_TELEPATH | NPC_TUNNEL] +
+          d->census[NPC_SMART | NPC_TELEPATH | NPC_TUNNEL | NPC_ERRATIC]);
+}
+
 npc::npc(dungeon *d, monster_description &m) : md(m)
 {
   pair_t p;
   uint32_t room;
   uint32_t i;
+  rng_t *rng;
 
+  rng = &d->rng[rng_generation];
   symbol = m.symbol;
   color = m.color;
   i = 0;
   do {
-    room = rand_range(1, d->num_rooms - 1);
-    p[dim_y] = rand_range(d->rooms[room].position[dim_y],
+    room = rand_range(rng, 1, d->num_rooms - 1);
+    p[dim_y] = rand_range(rng, d->rooms[room].position[dim_y],
                           (d->rooms[room].position[dim_y] +
                            d->rooms[room].size[dim_y] - 1));
-    p[dim_x] = rand_range(d->rooms[room].position[dim_x],
+    p[dim_x] = rand_range(rng, d->rooms[room].position[dim_x],
                           (d->rooms[room].position[dim_x] +
                            d->rooms[room].size[dim_x] - 1));
     i++;
@@ -730,12 +751,13 @@ npc::npc(dungeon *d, monster_description &m) : md(m)
   position[dim_y] = p[dim_y];
   position[dim_x] = p[dim_x];
   d->character_map[p[dim_y]][p[dim_x]] = this;
-  speed = m.speed.roll();
-  hp = m.hitpoints.roll();
+  speed = m.speed.roll(rng);
+  hp = m.hitpoints.roll(rng);
   damage = &m.damage;
   alive = 1;
   sequence_number = ++d->character_sequence_number;
   characteristics = m.abilities;
+  d->census[characteristics & NPC_MOVE_BITS]++;
   have_seen_pc = 0;
   name = m.name.c_str();
   description = (const char *) m.description.c_str();
@@ -745,6 +767,27 @@ npc::npc(dungeon *d, monster_description &m) : md(m)
   m.birth();
 }
 
+/* For monsters coming back from a spilled level, which the caller puts *
+ * back as they were.  They never stopped being alive as far as m is    *
+ * concerned, so there's no birth().                                    */
+npc::npc(monster_description &m) : md(m)
+{
+  uint32_t i;
+
+  symbol = m.symbol;
+  color = m.color;
+  damage = &m.damage;
+  alive = 1;
+  characteristics = m.abilities;
+  have_seen_pc = 0;
+  name = m.name.c_str();
+  description = (const char *) m.description.c_str();
+  for (i = 0; i < num_kill_types; i++) {
+    kills[i] = 0;
+  }
+  turn = NULL;
+}
+
 npc::~npc()
 {
   if (alive) {
@@ -39,6 +39,9 @@
 # define NPC_BIT30         0x40000000
 # define NPC_BIT31         0x80000000
 
+/* The characteristics that select a monster's move function. */
+# define NPC_MOVE_BITS     0x0000001f
+
 # define has_characteristic(character, bit)              \
   (((npc *) character)->characteristics & NPC_##bit)
 # define is_unique(character) has_characteristic(character, UNIQ)
@@ -51,6 +54,7 @@ typedef uint32_t npc_characteristics_t;
 class npc : public character {
  public:
   npc(dungeon *d, monster_description &m);
+  npc(monster_description &m);
   ~npc();
   npc_characteristics_t characteristics;
   uint32_t have_seen_pc;
@@ -59,9 +63,14 @@ class npc : public character {
   monster_description &md;
 };
 
+/* One move function for each combination of the low five NPC_* bits. */
+extern void (*npc_move_func[])(dungeon *d, npc *c, pair_t next);
+
 void gen_monsters(dungeon *d);
 void npc_delete(npc *n);
 void npc_next_pos(dungeon *d, npc *c, pair_t next);
 uint32_t dungeon_has_npcs(dungeon *d);
+uint32_t npc_census_uses_distance(dungeon *d);
+uint32_t npc_census_uses_tunnel(dungeon *d);
 bool boss_is_alive(dungeon *d);
 #endif
@@ -6,19 +6,19 @@
 #include "dungeon.h"
 #include "utils.h"
 
-object::object(object_description &o, pair_t p, object *next) :
+object::object(dungeon_t *d, object_description &o, pair_t p, object *next) :
   name(o.get_name()),
   description(o.get_description()),
   type(o.get_type()),
   color(o.get_color()),
   damage(o.get_damage()),
-  hit(o.get_hit().roll()),
-  dodge(o.get_dodge().roll()),
-  defence(o.get_defence().roll()),
-  weight(o.get_weight().roll()),
-  speed(o.get_speed().roll()),
-  attribute(o.get_attribute().roll()),
-  value(o.get_value().roll()),
+  hit(o.get_hit().roll(&d->rng[rng_generation])),
+  dodge(o.get_dodge().roll(&d->rng[rng_generation])),
+  defence(o.get_defence().roll(&d->rng[rng_generation])),
+  weight(o.get_weight().roll(&d->rng[rng_generation])),
+  speed(o.get_speed().roll(&d->rng[rng_generation])),
+  attribute(o.get_attribute().roll(&d->rng[rng_generation])),
+  value(o.get_value().roll(&d->rng[rng_generation])),
   seen(false),
   next(next),
   od(o)
@@ -29,6 +29,30 @@ object::object(object_description &o, pair_t p, object *next) :
   od.generate();
 }
 
+/* For objects coming back from a spilled level.  Nothing is rolled; *
+ * the level store fills in what was rolled the first time.  Like    *
+ * spilled monsters, they were never destroyed, so no generate().    */
+object::object(object_description &o, object *next) :
+  name(o.get_name()),
+  description(o.get_description()),
+  type(o.get_type()),
+  color(o.get_color()),
+  damage(o.get_damage()),
+  hit(0),
+  dodge(0),
+  defence(0),
+  weight(0),
+  speed(0),
+  attribute(0),
+  value(0),
+  seen(false),
+  next(next),
+  od(o)
+{
+  position[dim_x] = 0;
+  position[dim_y] = 0;
+}
+
 object::~object()
 {
   od.destroy();
@@ -53,10 +77,10 @@ object* gen_random_weapon(dungeon_t *d, std::vector<object*> obj_list)
   std::vector<object_description> &v = d->object_descriptions;
   int i;
   do {
-    i = rand_range(0, v.size() - 1);
+    i = rng_under(&d->rng[rng_generation], v.size());
     
   } while (v[i].get_type() != objtype_WEAPON || !(is_new(v[i], obj_list)));
-  o = new object(v[i], p, NULL);
+  o = new object(d, v[i], p, NULL);
   return o;
 }
 
@@ -67,9 +91,9 @@ object* gen_random_potion(dungeon_t *d, std::vector<object*> obj_list)
   std::vector<object_description> &v = d->object_descriptions;
   int i;
   do {
-    i = rand_range(0, v.size() - 1);
+    i = rng_under(&d->rng[rng_generation], v.size());
   } while (v[i].get_type() != objtype_POTION || !(is_new(v[i], obj_list)));
-  o = new object(v[i], p, NULL);
+  o = new object(d, v[i], p, NULL);
   return o;
 }
 
@@ -80,9 +104,9 @@ object* gen_random_acces(dungeon_t *d, std::vector<object*> obj_list)
   std::vector<object_description> &v = d->object_descriptions;
   int i;
   do {
-    i = rand_range(0, v.size() - 1);
+    i = rng_under(&d->rng[rng_generation], v.size());
   } while ((v[i].get_type() != objtype_RING && v[i].get_type() != objtype_ARMOR && v[i].get_type() != objtype_LIGHT) || !(is_new(v[i], obj_list)));
-  o = new object(v[i], p, NULL);
+  o = new object(d, v[i], p, NULL);
   return o;
 }
 
@@ -93,22 +117,24 @@ void gen_object(dungeon_t *d)
   pair_t p;
   std::vector<object_description> &v = d->object_descriptions;
   int i;
+  rng_t *rng = &d->rng[rng_generation];
 
   do {
-    i = rand_range(0, v.size() - 1);
-  } while (!v[i].can_be_generated() || !v[i].pass_rarity_roll() || v[i].get_type() == objtype_POTION);
+    i = rng_under(rng, v.size());
+  } while (!v[i].can_be_generated() || !v[i].pass_rarity_roll(rng) ||
+           v[i].get_type() == objtype_POTION);
   
-  room = rand_range(0, d->num_rooms - 1);
+  room = rng_under(rng, d->num_rooms);
   do {
-    p[dim_y] = rand_range(d->rooms[room].position[dim_y],
+    p[dim_y] = rand_range(rng, d->rooms[room].position[dim_y],
                           (d->rooms[room].position[dim_y] +
                            d->rooms[room].size[dim_y] - 1));
-    p[dim_x] = rand_range(d->rooms[room].position[dim_x],
+    p[dim_x] = rand_range(rng, d->rooms[room].position[dim_x],
                           (d->rooms[room].position[dim_x] +
                            d->rooms[room].size[dim_x] - 1));
   } while (mappair(p) > ter_stairs);
 
-  o = new object(v[i], p, d->objmap[p[dim_y]][p[dim_x]]);
+  o = new object(d, v[i], p, d->objmap[p[dim_y]][p[dim_x]]);
   o->set_next(NULL);
   d->objmap[p[dim_y]][p[dim_x]] = o;
   
@@ -119,7 +145,7 @@ void gen_objects(dungeon_t *d)
 {
   uint32_t i;
 
-  memset(d->objmap, 0, sizeof (d->objmap));
+  d->objmap.clear();
 
   for (i = 0; i < d->max_objects; i++) {
     gen_object(d);
@@ -148,17 +174,17 @@ int32_t object::get_speed()
   return speed;
 }
 
-int32_t object::roll_dice()
+int32_t object::roll_dice(rng_t *r)
 {
-  return damage.roll();
+  return damage.roll(r);
 }
 
 void destroy_objects(dungeon_t *d)
 {
   uint32_t y, x;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
       if (d->objmap[y][x]) {
         delete d->objmap[y][x];
         d->objmap[y][x] = 0;
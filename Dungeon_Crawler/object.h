@@ -18,8 +18,11 @@ class object {
   bool seen;
   object *next;
   object_description &od;
+  object(object_description &o, object *next);
+  friend struct level_store;
+  friend struct game_save;
  public:
-  object(object_description &o, pair_t p, object *next);
+  object(dungeon_t *d, object_description &o, pair_t p, object *next);
   ~object();
   inline int32_t get_damage_base() const
   {
@@ -37,7 +40,7 @@ class object {
   uint32_t get_color();
   const char *get_name();
   int32_t get_speed();
-  int32_t roll_dice();
+  int32_t roll_dice(rng_t *r);
   int32_t get_type();
   int32_t get_value() { return value; }
   bool have_seen() { return seen; }
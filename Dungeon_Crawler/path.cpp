@@ -1,268 +1,230 @@
 #include "path.h"
 #include "dungeon.h"
 #include "pc.h"
+#include "npc.h"
+#include "bucket.h"
 
-/* Ugly hack: There is no way to pass a pointer to the dungeon into the *
- * heap's comparitor funtion without modifying the heap.  Copying the   *
- * pc_distance array is a possible solution, but that doubles the       *
- * bandwidth requirements for dijkstra, which would also be bad.        *
- * Instead, make a global pointer to the dungeon in this file,          *
- * initialize it in dijkstra, and use it in the comparitor to get to    *
- * pc_distance.  Otherwise, pretend it doesn't exist, because it really *
- * is ugly.                                                             */
-static dungeon *the_dungeon;
+/* The maps are walked as flat arrays, indexed by y * width + x.        *
+ * Immutable walls surround the map and no path enters them, so none of *
+ * the neighbor offsets ever takes us off of it.                        */
+#define cell_index(pair) ((pair)[dim_y] * d->width + (pair)[dim_x])
 
-typedef struct path {
-  heap_node_t *hn;
-  uint8_t pos[2];
-} path_t;
+/* Ignores the case of hardness == 255, because if *
+ * that gets here, there's already been an error.  */
+#define tunnel_movement_cost(c)                         \
+  ((d->hardness.data()[c] / HARDNESS_PER_TURN) + 1)
 
-static int32_t dist_cmp(const void *key, const void *with) {
-  return ((int32_t) the_dungeon->pc_distance[((path_t *) key)->pos[dim_y]]
-                                            [((path_t *) key)->pos[dim_x]] -
-          (int32_t) the_dungeon->pc_distance[((path_t *) with)->pos[dim_y]]
-                                            [((path_t *) with)->pos[dim_x]]);
-}
+struct path_context {
+  int32_t neighbor[8];
+  uint32_t *distance_queue;
+  bucket_queue_t tunnel_queue;
+};
+
+static path_context_t *path_context(dungeon *d)
+{
+  path_context_t *p;
+  uint32_t cells;
+
+  if (!(p = d->paths)) {
+    p = d->paths = (path_context_t *) malloc(sizeof (*d->paths));
+    cells = d->width * d->height;
+    p->neighbor[0] = -d->width - 1;
+    p->neighbor[1] = -d->width;
+    p->neighbor[2] = -d->width + 1;
+    p->neighbor[3] = -1;
+    p->neighbor[4] = 1;
+    p->neighbor[5] = d->width - 1;
+    p->neighbor[6] = d->width;
+    p->neighbor[7] = d->width + 1;
+    p->distance_queue = (uint32_t *) malloc(cells * sizeof (uint32_t));
+    bucket_queue_init(&p->tunnel_queue, cells, 255 / HARDNESS_PER_TURN + 1);
+  }
 
-static int32_t tunnel_cmp(const void *key, const void *with) {
-  return ((int32_t) the_dungeon->pc_tunnel[((path_t *) key)->pos[dim_y]]
-                                          [((path_t *) key)->pos[dim_x]] -
-          (int32_t) the_dungeon->pc_tunnel[((path_t *) with)->pos[dim_y]]
-                                          [((path_t *) with)->pos[dim_x]]);
+  return p;
 }
 
-void dijkstra(dungeon *d)
+void path_context_delete(dungeon *d)
 {
-  heap_t h;
-  uint32_t x, y;
-  static path_t p[DUNGEON_Y][DUNGEON_X], *c;
-  static uint32_t initialized = 0;
+  if (d->paths) {
+    bucket_queue_delete(&d->paths->tunnel_queue);
+    free(d->paths->distance_queue);
+    free(d->paths);
+    d->paths = NULL;
+  }
+}
 
-  if (!initialized) {
-    initialized = 1;
-    the_dungeon = d;
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
+/* Every step on the distance map costs 1, so Dijkstra's priority queue   *
+ * degenerates into a FIFO.  Starting from a single cell, the queue stays *
+ * sorted by distance, the first time we improve a cell is the best we    *
+ * can do for it, and nothing is queued twice.  pc_distance saturates at  *
+ * PATH_UNREACHED, so cells any farther away are left unreached.          */
+static void distance_propagate(dungeon *d, uint32_t start)
+{
+  const int32_t *neighbor;
+  path_context_t *p;
+  uint32_t *queue;
+  path_distance_t *distance;
+  terrain_type_t *map;
+  uint32_t head, tail, c, n, i, next;
+
+  p = path_context(d);
+  queue = p->distance_queue;
+  neighbor = p->neighbor;
+  distance = d->pc_distance.data();
+  map = d->map.data();
+
+  queue[0] = start;
+  for (head = 0, tail = 1; head != tail; head++) {
+    c = queue[head];
+    /* FIFO order means everything still queued is at least this far. */
+    if ((next = distance[c] + 1) >= PATH_UNREACHED) {
+      break;
+    }
+    for (i = 0; i < 8; i++) {
+      n = c + neighbor[i];
+      if (map[n] >= ter_floor && distance[n] > next) {
+        distance[n] = next;
+        queue[tail++] = n;
       }
     }
   }
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      d->pc_distance[y][x] = 255;
+/* Tunneling costs 1 to 4 per step, so a bucket queue with a handful of *
+ * buckets replaces the heap.  Cells are queued the first time they're  *
+ * reached rather than all up front, which gives the same result: a     *
+ * cell is only ever relaxed to values below PATH_UNREACHED, so         *
+ * anything farther stays unreached, as it did with the heap.           */
+static void tunnel_propagate(dungeon *d, uint32_t start)
+{
+  const int32_t *neighbor;
+  bucket_queue_t *queue;
+  path_context_t *p;
+  path_distance_t *tunnel;
+  terrain_type_t *map;
+  uint32_t c, n, i, next;
+
+  p = path_context(d);
+  queue = &p->tunnel_queue;
+  neighbor = p->neighbor;
+  tunnel = d->pc_tunnel.data();
+  map = d->map.data();
+
+  bucket_queue_reset(queue);
+  bucket_queue_insert(queue, start, tunnel[start]);
+
+  while ((c = bucket_queue_remove_min(queue)) != BUCKET_QUEUE_NONE) {
+    if ((next = tunnel[c] + tunnel_movement_cost(c)) >= PATH_UNREACHED) {
+      continue;
+    }
+    for (i = 0; i < 8; i++) {
+      n = c + neighbor[i];
+      if (map[n] != ter_wall_immutable && tunnel[n] > next) {
+        if (bucket_queue_contains(queue, n)) {
+          bucket_queue_decrease_key(queue, n, next);
+        } else {
+          bucket_queue_insert(queue, n, next);
+        }
+        tunnel[n] = next;
+      }
     }
   }
-  d->pc_distance[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
+}
 
-  heap_init(&h, dist_cmp, NULL);
+void dijkstra(dungeon *d)
+{
+  d->pc_distance_dirty = 0;
+  memset(d->pc_distance.data(), 0xff, d->pc_distance.bytes());
+  d->pc_distance[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) >= ter_floor) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
-      }
-    }
+  if (mappair(d->PC->position) < ter_floor) {
+    return;
   }
 
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1)) {
-      d->pc_distance[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        d->pc_distance[c->pos[dim_y]][c->pos[dim_x]] + 1;
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
-    }
+  distance_propagate(d, cell_index(d->PC->position));
+}
+
+void dijkstra_tunnel(dungeon *d)
+{
+  d->pc_tunnel_dirty = 0;
+  memset(d->pc_tunnel.data(), 0xff, d->pc_tunnel.bytes());
+  d->pc_tunnel[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
+
+  if (mappair(d->PC->position) == ter_wall_immutable) {
+    return;
   }
-  heap_delete(&h);
+
+  tunnel_propagate(d, cell_index(d->PC->position));
 }
 
-/* Ignores the case of hardness == 255, because if *
- * that gets here, there's already been an error.  */
-#define tunnel_movement_cost(x, y)                      \
-  ((d->hardness[y][x] / 85) + 1)
+/* The distance maps are only computed when somebody reads them.  Moving *
+ * the PC invalidates both; a reader calls the ensure functions first.   */
+void dijkstra_invalidate(dungeon *d)
+{
+  d->pc_distance_dirty = 1;
+  d->pc_tunnel_dirty = 1;
+}
 
-void dijkstra_tunnel(dungeon *d)
+void dijkstra_ensure(dungeon *d)
 {
-  heap_t h;
-  uint32_t x, y;
-  uint32_t size;
-  static path_t p[DUNGEON_Y][DUNGEON_X], *c;
-  static uint32_t initialized = 0;
+  if (d->pc_distance_dirty) {
+    dijkstra(d);
+  }
+}
 
-  if (!initialized) {
-    initialized = 1;
-    the_dungeon = d;
-    for (y = 0; y < DUNGEON_Y; y++) {
-      for (x = 0; x < DUNGEON_X; x++) {
-        p[y][x].pos[dim_y] = y;
-        p[y][x].pos[dim_x] = x;
-      }
-    }
+void dijkstra_tunnel_ensure(dungeon *d)
+{
+  if (d->pc_tunnel_dirty) {
+    dijkstra_tunnel(d);
   }
+}
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      d->pc_tunnel[y][x] = 255;
-    }
+/* Lowering one cell's hardness, or turning it into floor, can only make  *
+ * paths shorter, and only paths through that cell.  So rather than       *
+ * starting over, we find the cell's new distance from its neighbors and  *
+ * push improvements outward from it.  The result is identical to         *
+ * calling dijkstra() and dijkstra_tunnel().  A map that is already dirty *
+ * stays dirty, and one that no living monster follows is marked dirty    *
+ * instead of being repaired.                                             */
+void dijkstra_repair(dungeon *d, pair_t p)
+{
+  path_distance_t *distance, *tunnel;
+  const int32_t *neighbor;
+  terrain_type_t *map;
+  uint32_t c, n, i;
+
+  distance = d->pc_distance.data();
+  tunnel = d->pc_tunnel.data();
+  map = d->map.data();
+  neighbor = path_context(d)->neighbor;
+  c = cell_index(p);
+
+  if (map[c] == ter_wall_immutable) {
+    return;
   }
-  d->pc_tunnel[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
 
-  heap_init(&h, tunnel_cmp, NULL);
+  if (!d->pc_distance_dirty && !npc_census_uses_distance(d)) {
+    d->pc_distance_dirty = 1;
+  }
+  if (!d->pc_tunnel_dirty && !npc_census_uses_tunnel(d)) {
+    d->pc_tunnel_dirty = 1;
+  }
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      if (mapxy(x, y) != ter_wall_immutable) {
-        p[y][x].hn = heap_insert(&h, &p[y][x]);
+  if (!d->pc_distance_dirty && map[c] >= ter_floor) {
+    for (i = 0; i < 8; i++) {
+      n = c + neighbor[i];
+      if (map[n] >= ter_floor && distance[n] + 1 < distance[c]) {
+        distance[c] = distance[n] + 1;
       }
     }
+    if (distance[c] < PATH_UNREACHED) {
+      distance_propagate(d, c);
+    }
   }
 
-  size = h.size;
-  while ((c = (path_t *) heap_remove_min(&h))) {
-    if (--size != h.size) {
-      exit(1);
-    }
-    c->hn = NULL;
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] - 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] - 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x]    ] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x]    ] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] + 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] - 1][c->pos[dim_x] + 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] - 1][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] - 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] - 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] + 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y]    ][c->pos[dim_x] + 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y]    ][c->pos[dim_x] + 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] - 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] - 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] - 1].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x]    ] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x]    ] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x]    ].hn);
-    }
-    if ((p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn) &&
-        (d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] + 1] >
-         d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]))) {
-      d->pc_tunnel[c->pos[dim_y] + 1][c->pos[dim_x] + 1] =
-        (d->pc_tunnel[c->pos[dim_y]][c->pos[dim_x]] +
-         tunnel_movement_cost(c->pos[dim_x], c->pos[dim_y]));
-      heap_decrease_key_no_replace(&h,
-                                   p[c->pos[dim_y] + 1][c->pos[dim_x] + 1].hn);
-    }
+  /* A cell's own tunneling distance doesn't depend on its hardness; only *
+   * the cost of moving on from it does.                                  */
+  if (!d->pc_tunnel_dirty && tunnel[c] < PATH_UNREACHED) {
+    tunnel_propagate(d, c);
   }
-  heap_delete(&h);
 }
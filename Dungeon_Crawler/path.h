@@ -1,11 +1,33 @@
 #ifndef PATH_H
 # define PATH_H
 
+# include <stdint.h>
+
+# include "dims.h"
+
 # define HARDNESS_PER_TURN 85
 
+/* Distance maps hold 16 bits per cell.  A cell more than            *
+ * PATH_UNREACHED - 1 away reads as unreached, just as one more than *
+ * 254 away did when they held 8.                                    */
+typedef uint16_t path_distance_t;
+# define PATH_UNREACHED    UINT16_MAX
+
 typedef struct dungeon dungeon_t;
 
+/* The queues the pathfinding routines work in.  Each dungeon owns its   *
+ * own, created the first time it is pathed and freed by                 *
+ * path_context_delete(), so that separate dungeons can be pathed at the *
+ * same time on separate threads.                                        */
+typedef struct path_context path_context_t;
+
+void path_context_delete(dungeon_t *d);
+
 void dijkstra(dungeon_t *d);
 void dijkstra_tunnel(dungeon_t *d);
+void dijkstra_repair(dungeon_t *d, pair_t p);
+void dijkstra_invalidate(dungeon_t *d);
+void dijkstra_ensure(dungeon_t *d);
+void dijkstra_tunnel_ensure(dungeon_t *d);
 
 #endif
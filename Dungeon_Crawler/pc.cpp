@@ -38,6 +38,8 @@ pc::pc()
   }
 
   hp = 1000;
+
+  have_seen_corner = corner_count = 0;
 }
 
 pc::~pc()
@@ -66,20 +68,25 @@ uint32_t pc_is_alive(dungeon_t *d)
 
 void place_pc(dungeon_t *d)
 {
-  d->PC->position[dim_y] = rand_range(d->rooms->position[dim_y],
+  rng_t *rng;
+
+  rng = &d->rng[rng_generation];
+  d->PC->position[dim_y] = rand_range(rng, d->rooms->position[dim_y],
                                      (d->rooms->position[dim_y] +
                                       d->rooms->size[dim_y] - 1));
-  d->PC->position[dim_x] = rand_range(d->rooms->position[dim_x],
+  d->PC->position[dim_x] = rand_range(rng, d->rooms->position[dim_x],
                                      (d->rooms->position[dim_x] +
                                       d->rooms->size[dim_x] - 1));
 
   pc_init_known_terrain(d->PC);
   pc_observe_terrain(d->PC, d);
 
-  io_display(d);
+  if (!d->headless) {
+    io_display(d);
+  }
 }
 
-void config_pc(dungeon_t *d)
+void init_pc(dungeon_t *d)
 {
   static dice pc_dice(0, 1, 4);
 
@@ -87,7 +94,8 @@ void config_pc(dungeon_t *d)
 
   d->PC->symbol = '@';
 
-  place_pc(d);
+  d->PC->known_terrain.resize(d->width, d->height);
+  d->PC->visible.resize(d->width, d->height);
 
   d->PC->speed = PC_SPEED;
   d->PC->alive = 1;
@@ -96,11 +104,18 @@ void config_pc(dungeon_t *d)
   d->PC->color.push_back(COLOR_WHITE);
   d->PC->damage = &pc_dice;
   d->PC->name = "Isabella Garcia-Shapiro";
+  d->PC->turn = NULL;
+}
+
+void config_pc(dungeon_t *d)
+{
+  init_pc(d);
+
+  place_pc(d);
 
   d->character_map[character_get_y(d->PC)][character_get_x(d->PC)] = d->PC;
 
-  dijkstra(d);
-  dijkstra_tunnel(d);
+  dijkstra_invalidate(d);
 }
 
 uint32_t pc::get_count_of(object *o)
@@ -117,16 +132,13 @@ uint32_t pc::get_count_of(object *o)
 
 uint32_t pc_next_pos(dungeon_t *d, pair_t dir)
 {
-  static uint32_t have_seen_corner = 0;
-  static uint32_t count = 0;
-
   dir[dim_y] = dir[dim_x] = 0;
 
   if (in_corner(d, d->PC)) {
-    if (!count) {
-      count = 1;
+    if (!d->PC->corner_count) {
+      d->PC->corner_count = 1;
     }
-    have_seen_corner = 1;
+    d->PC->have_seen_corner = 1;
   }
 
   /* First, eat anybody standing next to us. */
@@ -150,25 +162,27 @@ uint32_t pc_next_pos(dungeon_t *d, pair_t dir)
   } else if (charxy(d->PC->position[dim_x] + 1, d->PC->position[dim_y] + 1)) {
     dir[dim_y] = 1;
     dir[dim_x] = 1;
-  } else if (!have_seen_corner || count < 250) {
+  } else if (!d->PC->have_seen_corner || d->PC->corner_count < 250) {
     /* Head to a corner and let most of the NPCs kill each other off */
-    if (count) {
-      count++;
+    if (d->PC->corner_count) {
+      d->PC->corner_count++;
     }
-    if (!against_wall(d, d->PC) && ((rand() & 0x111) == 0x111)) {
-      dir[dim_x] = (rand() % 3) - 1;
-      dir[dim_y] = (rand() % 3) - 1;
+    if (!against_wall(d, d->PC) &&
+        ((rng_next(&d->rng[rng_ai]) & 0x111) == 0x111)) {
+      dir[dim_x] = rand_range(&d->rng[rng_ai], -1, 1);
+      dir[dim_y] = rand_range(&d->rng[rng_ai], -1, 1);
     } else {
       dir_nearest_wall(d, d->PC, dir);
     }
   }else {
     /* And after we've been there, let's head toward the center of the map. */
-    if (!against_wall(d, d->PC) && ((rand() & 0x111) == 0x111)) {
-      dir[dim_x] = (rand() % 3) - 1;
-      dir[dim_y] = (rand() % 3) - 1;
+    if (!against_wall(d, d->PC) &&
+        ((rng_next(&d->rng[rng_ai]) & 0x111) == 0x111)) {
+      dir[dim_x] = rand_range(&d->rng[rng_ai], -1, 1);
+      dir[dim_y] = rand_range(&d->rng[rng_ai], -1, 1);
     } else {
-      dir[dim_x] = ((d->PC->position[dim_x] > DUNGEON_X / 2) ? -1 : 1);
-      dir[dim_y] = ((d->PC->position[dim_y] > DUNGEON_Y / 2) ? -1 : 1);
+      dir[dim_x] = ((d->PC->position[dim_x] > d->width / 2) ? -1 : 1);
+      dir[dim_y] = ((d->PC->position[dim_y] > d->height / 2) ? -1 : 1);
     }
   }
 
@@ -236,18 +250,13 @@ void pc_learn_terrain(pc *p, pair_t pos, terrain_type_t ter)
 
 void pc_reset_visibility(pc *p)
 {
-  uint32_t y, x;
-
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
-      p->visible[y][x] = 0;
-    }
-  }
+  p->visible.clear();
 }
 
 terrain_type_t pc_learned_terrain(pc *p, int16_t y, int16_t x)
 {
-  if (y < 0 || y >= DUNGEON_Y || x < 0 || x >= DUNGEON_X) {
+  if (y < 0 || y >= (int32_t) p->known_terrain.height() ||
+      x < 0 || x >= (int32_t) p->known_terrain.width()) {
     io_queue_message("Invalid value to %s: %d, %d", __FUNCTION__, y, x);
   }
 
@@ -258,12 +267,12 @@ void pc_init_known_terrain(pc *p)
 {
   uint32_t y, x;
 
-  for (y = 0; y < DUNGEON_Y; y++) {
-    for (x = 0; x < DUNGEON_X; x++) {
+  for (y = 0; y < p->known_terrain.height(); y++) {
+    for (x = 0; x < p->known_terrain.width(); x++) {
       p->known_terrain[y][x] = ter_unknown;
-      p->visible[y][x] = 0;
     }
   }
+  p->visible.clear();
 }
 
 void pc_observe_terrain(pc *p, dungeon_t *d)
@@ -276,16 +285,16 @@ void pc_observe_terrain(pc *p, dungeon_t *d)
     y_min = 0;
   }
   y_max = p->position[dim_y] + PC_VISUAL_RANGE;
-  if (y_max > DUNGEON_Y - 1) {
-    y_max = DUNGEON_Y - 1;
+  if (y_max > d->height - 1) {
+    y_max = d->height - 1;
   }
   x_min = p->position[dim_x] - PC_VISUAL_RANGE;
   if (x_min < 0) {
     x_min = 0;
   }
   x_max = p->position[dim_x] + PC_VISUAL_RANGE;
-  if (x_max > DUNGEON_X - 1) {
-    x_max = DUNGEON_X - 1;
+  if (x_max > d->width - 1) {
+    x_max = d->width - 1;
   }
 
   for (where[dim_y] = y_min; where[dim_y] <= y_max; where[dim_y]++) {
@@ -325,8 +334,11 @@ void pc::recalculate_speed()
     }
   }
 
+  /* Turns come every 1000 / speed; past MAX_SPEED, that would be 0. */
   if (speed <= 0) {
     speed = 1;
+  } else if (speed > MAX_SPEED) {
+    speed = MAX_SPEED;
   }
 }
 
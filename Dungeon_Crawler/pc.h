@@ -46,12 +46,19 @@ class pc : public character {
   uint32_t get_gold_count();
   uint32_t pick_up(dungeon_t *d);
   uint32_t get_count_of(object *o);
-  terrain_type_t known_terrain[DUNGEON_Y][DUNGEON_X];
-  uint8_t visible[DUNGEON_Y][DUNGEON_X];
+  /* Sized to the dungeon by config_pc(). */
+  grid<terrain_type_t> known_terrain;
+  grid<uint8_t> visible;
+  /* pc_next_pos() heads for a corner, waits there, then heads for the *
+   * center of the map.  This tracks where it is in that plan.         */
+  uint32_t have_seen_corner;
+  uint32_t corner_count;
 };
 
 void pc_delete(pc *pc);
 uint32_t pc_is_alive(dungeon *d);
+/* A new PC, not yet anywhere.  config_pc() puts it in the dungeon. */
+void init_pc(dungeon *d);
 void config_pc(dungeon *d);
 uint32_t pc_next_pos(dungeon *d, pair_t dir);
 void place_pc(dungeon *d);
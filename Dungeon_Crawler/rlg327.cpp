@@ -3,14 +3,13 @@
 #include <sys/time.h>
 #include <unistd.h>
 
-/* Very slow seed: 686846853 */
-
 #include "dungeon.h"
 #include "pc.h"
 #include "npc.h"
 #include "move.h"
 #include "io.h"
 #include "object.h"
+#include "save.h"
 
 const char *victory =
   "\n                                       o\n"
@@ -70,7 +69,9 @@ void usage(char *name)
           "Usage: %s [-r|--rand <seed>] [-l|--load [<file>]]\n"
           "          [-s|--save [<file>]] [-i|--image <pgm file>]\n"
           "          [-p|--pc <y> <x>] [-n|--nummon <count>]\n"
-          "          [-o|--objcount <oject count>]\n",
+          "          [-o|--objcount <oject count>] [--size <width>x<height>]\n"
+          "          [-c|--checkpoint <file> [<turns>]]\n"
+          "          [-h|--headless [-t|--turns <count>] [-u|--until-death]]\n",
           name);
 
   exit(-1);
@@ -85,20 +86,29 @@ int main(int argc, char *argv[])
   uint32_t do_load, do_save, do_seed, do_image, do_save_seed,
            do_save_image, do_place_pc;
   uint32_t long_arg;
+  uint32_t width, height;
+  uint32_t max_turns, turns;
+  uint32_t resumed, checkpoint_turns;
+  struct timeval start, end;
+  double elapsed;
   char *save_file;
   char *load_file;
   char *pgm_file;
+  char *checkpoint_file;
 
-  memset(&d, 0, sizeof (d));
+  d = dungeon_t();
 
   /* Default behavior: Seed with the time, generate a new dungeon, *
    * and don't write to disk.                                      */
   do_load = do_save = do_image = do_save_seed =
     do_save_image = do_place_pc = 0;
   do_seed = 1;
-  save_file = load_file = NULL;
+  save_file = load_file = checkpoint_file = NULL;
+  max_turns = checkpoint_turns = resumed = 0;
   d.max_monsters = MAX_MONSTERS;
   d.max_objects = MAX_OBJECTS;
+  d.width = DUNGEON_X;
+  d.height = DUNGEON_Y;
 
   /* The project spec requires '--load' and '--save'.  It's common  *
    * to have short and long forms of most switches (assuming you    *
@@ -152,6 +162,20 @@ int main(int argc, char *argv[])
           }
           break;
         case 's':
+          if (long_arg && !strcmp(argv[i], "-size")) {
+            if (argc < ++i + 1 /* No more arguments */ ||
+                sscanf(argv[i], "%ux%u", &width, &height) != 2 ||
+                width < MIN_DUNGEON_X || width > MAX_DUNGEON_X ||
+                height < MIN_DUNGEON_Y || height > MAX_DUNGEON_Y) {
+              fprintf(stderr, "Dungeon size must be between %ux%u and %ux%u.\n",
+                      MIN_DUNGEON_X, MIN_DUNGEON_Y,
+                      MAX_DUNGEON_X, MAX_DUNGEON_Y);
+              usage(argv[0]);
+            }
+            d.width = width;
+            d.height = height;
+            break;
+          }
           if ((!long_arg && argv[i][2]) ||
               (long_arg && strcmp(argv[i], "-save"))) {
             usage(argv[0]);
@@ -193,9 +217,9 @@ int main(int argc, char *argv[])
             usage(argv[0]);
           }
           if ((d.PC->position[dim_y] = atoi(argv[++i])) < 1 ||
-              d.PC->position[dim_y] > DUNGEON_Y - 2         ||
+              d.PC->position[dim_y] > d.height - 2          ||
               (d.PC->position[dim_x] = atoi(argv[++i])) < 1 ||
-              d.PC->position[dim_x] > DUNGEON_X - 2)         {
+              d.PC->position[dim_x] > d.width - 2)          {
             fprintf(stderr, "Invalid PC position.\n");
             usage(argv[0]);
           }
@@ -209,6 +233,44 @@ int main(int argc, char *argv[])
             usage(argv[0]);
           }
           break;
+        case 'h':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-headless"))) {
+            usage(argv[0]);
+          }
+          d.headless = 1;
+          break;
+        case 't':
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-turns")) ||
+              argc < ++i + 1 /* No more arguments */ ||
+              !sscanf(argv[i], "%u", &max_turns)) {
+            usage(argv[0]);
+          }
+          break;
+        case 'c':
+          /* Saves the whole game to the file when the game ends, and *
+           * every <turns> turns, if given.  --load resumes from it.  */
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-checkpoint")) ||
+              argc < ++i + 1 /* No more arguments */) {
+            usage(argv[0]);
+          }
+          checkpoint_file = argv[i];
+          if ((argc > i + 1) && argv[i + 1][0] != '-' &&
+              (!sscanf(argv[++i], "%u", &checkpoint_turns) ||
+               !checkpoint_turns)) {
+            usage(argv[0]);
+          }
+          break;
+        case 'u':
+          /* The default for headless runs; this just makes it explicit. */
+          if ((!long_arg && argv[i][2]) ||
+              (long_arg && strcmp(argv[i], "-until-death"))) {
+            usage(argv[0]);
+          }
+          max_turns = 0;
+          break;
         default:
           usage(argv[0]);
         }
@@ -225,33 +287,58 @@ int main(int argc, char *argv[])
     seed = (tv.tv_usec ^ (tv.tv_sec << 20)) & 0xffffffff;
   }
 
-  srand(seed);
-
   parse_descriptions(&d);
-  io_init_terminal();
+  if (d.headless) {
+    io_init_headless();
+  } else {
+    io_init_terminal();
+  }
+  seed_dungeon(&d, seed);
   init_dungeon(&d);
 
   if (do_load) {
-    read_dungeon(&d, load_file);
+    resumed = read_dungeon(&d, load_file) == GAME_SAVE_VERSION;
   } else if (do_image) {
     read_pgm(&d, pgm_file);
   } else {
     gen_dungeon(&d);
   }
 
-  config_pc(&d);
-  gen_monsters(&d);
-  gen_objects(&d);
-  pc_observe_terrain(d.PC, &d);
+  if (!resumed) {
+    config_pc(&d);
+    gen_monsters(&d);
+    gen_objects(&d);
+    pc_observe_terrain(d.PC, &d);
+  }
+  d.prefetch_levels = 1;
+  prefetch_level(&d);
 
-  io_display(&d);
-  io_queue_message("Seed is %u.", seed);
-  while (pc_is_alive(&d) && boss_is_alive(&d) && !d.quit) {
+  if (!d.headless) {
+    io_display(&d);
+    io_queue_message("Seed is %u.", seed);
+  }
+  /* Headless runs stop after max_turns PC turns, or never, if it's zero. */
+  gettimeofday(&start, NULL);
+  for (turns = 0;
+       (pc_is_alive(&d) && boss_is_alive(&d) && !d.quit &&
+        (!d.headless || !max_turns || turns < max_turns));
+       turns++) {
     do_moves(&d);
+    if (checkpoint_turns && !((turns + 1) % checkpoint_turns) &&
+        pc_is_alive(&d)) {
+      write_game(&d, checkpoint_file);
+    }
+  }
+  gettimeofday(&end, NULL);
+  if (!d.headless) {
+    io_display(&d);
+
+    io_reset_terminal();
   }
-  io_display(&d);
 
-  io_reset_terminal();
+  if (checkpoint_file && pc_is_alive(&d) && boss_is_alive(&d)) {
+    write_game(&d, checkpoint_file);
+  }
 
   if (do_save) {
     if (do_save_seed) {
@@ -277,11 +364,25 @@ int main(int argc, char *argv[])
     }
   }
 
-  printf("%s", pc_is_alive(&d) ? victory : tombstone);
-  printf("You defended your life in the face of %u deadly beasts.\n"
-         "You avenged the cruel and untimely murders of %u "
-         "peaceful dungeon residents.\n",
-         d.PC->kills[kill_direct], d.PC->kills[kill_avenged]);
+  if (d.headless) {
+    elapsed = ((end.tv_sec - start.tv_sec) +
+               (end.tv_usec - start.tv_usec) / 1000000.0);
+    printf("Seed: %lu\n"
+           "Turns: %u in %.3f seconds (%.0f turns/sec)\n"
+           "Game time: %u\n"
+           "Kills: %u direct, %u avenged\n"
+           "Outcome: %s\n",
+           seed, turns, elapsed, elapsed > 0 ? turns / elapsed : 0.0,
+           d.time, d.PC->kills[kill_direct], d.PC->kills[kill_avenged],
+           (!pc_is_alive(&d) ? "PC died" :
+            (!boss_is_alive(&d) ? "boss killed" : "turn limit reached")));
+  } else {
+    printf("%s", pc_is_alive(&d) ? victory : tombstone);
+    printf("You defended your life in the face of %u deadly beasts.\n"
+           "You avenged the cruel and untimely murders of %u "
+           "peaceful dungeon residents.\n",
+           d.PC->kills[kill_direct], d.PC->kills[kill_avenged]);
+  }
 
   if (pc_is_alive(&d)) {
     /* If the PC is dead, it's in the move heap and will get automatically *
@@ -290,6 +391,8 @@ int main(int argc, char *argv[])
     character_delete(d.PC);
   }
 
+  prefetch_level_delete(&d);
+  level_store_delete(&d);
   delete_dungeon(&d);
   destroy_descriptions(&d);
 
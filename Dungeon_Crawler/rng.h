@@ -0,0 +1,55 @@
+#ifndef RNG_H
+# define RNG_H
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+# include <stdint.h>
+
+/* A PCG32 random number generator (O'Neill, pcg-random.org).  Each       *
+ * generator carries its own state, so nothing is shared between threads  *
+ * or between the different users of randomness in a game.  Generators    *
+ * seeded alike but on different streams produce unrelated sequences.     *
+ * These are inline because the AI calls them on nearly every move.       */
+
+typedef struct rng {
+  uint64_t state;
+  uint64_t inc;
+} rng_t;
+
+static inline uint32_t rng_next(rng_t *r)
+{
+  uint64_t old;
+  uint32_t xorshifted, rot;
+
+  old = r->state;
+  r->state = old * 6364136223846793005ULL + r->inc;
+  xorshifted = ((old >> 18) ^ old) >> 27;
+  rot = old >> 59;
+
+  return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+static inline void rng_seed(rng_t *r, uint64_t seed, uint64_t stream)
+{
+  r->state = 0;
+  r->inc = (stream << 1) | 1;
+  rng_next(r);
+  r->state += seed;
+  rng_next(r);
+}
+
+/* Returns an integer in [0, bound).  Scaling by multiplication rather *
+ * than taking a remainder avoids a divide; the bias is at most        *
+ * bound / 2^32, far too small to matter for dice and dungeons.        */
+static inline uint32_t rng_under(rng_t *r, uint32_t bound)
+{
+  return ((uint64_t) rng_next(r) * bound) >> 32;
+}
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif
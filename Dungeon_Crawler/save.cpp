@@ -0,0 +1,617 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+
+#include "save.h"
+#include "dungeon.h"
+#include "pc.h"
+#include "npc.h"
+#include "object.h"
+#include "event.h"
+#include "level.h"
+#include "path.h"
+
+/* After the header, which is version 0's except that the number of     *
+ * sections takes the place of the file size, a version 1 file is a     *
+ * series of sections, one of each type below, in order.  Each is a     *
+ * save_section_t and then its payload: count map cells or count        *
+ * records of fixed layout, in the byte order of the machine that wrote *
+ * them, so that a section loads with one read and no parsing.  Readers *
+ * skip any sections past the ones they know.  Like spilled levels,     *
+ * monsters and objects refer to their descriptions by index, so a game *
+ * only loads with the description files it was saved with.             */
+typedef enum save_section_type {
+  save_dungeon,
+  save_rooms,
+  save_map,
+  save_hardness,
+  save_pc,
+  save_known_terrain,
+  save_visible,
+  save_monsters,
+  save_objects,
+  save_monster_descriptions,
+  save_object_descriptions,
+  /* In the format of spill files; see level.h. */
+  save_levels,
+  num_save_sections
+} save_section_type_t;
+
+typedef struct save_section {
+  uint32_t type;
+  uint32_t count;
+  uint64_t bytes;
+} save_section_t;
+
+typedef struct save_dungeon_record {
+  uint16_t width;
+  uint16_t height;
+  int32_t depth;
+  uint32_t time;
+  uint32_t is_new;
+  uint32_t character_sequence_number;
+  uint32_t event_sequence_number;
+  uint16_t max_monsters;
+  uint16_t max_objects;
+  uint16_t num_objects;
+  uint16_t unused;
+  uint32_t monster_descriptions;
+  uint32_t object_descriptions;
+  rng_t rng[num_rng_streams];
+} save_dungeon_record_t;
+
+typedef struct save_pc_record {
+  int16_t position[num_dims];
+  int32_t speed;
+  uint32_t hp;
+  uint32_t sequence_number;
+  uint32_t kills[num_kill_types];
+  uint32_t have_seen_corner;
+  uint32_t corner_count;
+} save_pc_record_t;
+
+/* Monsters keep the time and sequence number of their next turn. */
+typedef struct save_npc_record {
+  uint32_t description;
+  uint32_t time;
+  uint32_t sequence;
+  int16_t position[num_dims];
+  int16_t pc_last_known_position[num_dims];
+  int32_t speed;
+  uint32_t hp;
+  uint32_t sequence_number;
+  uint32_t kills[num_kill_types];
+  uint32_t characteristics;
+  uint32_t have_seen_pc;
+} save_npc_record_t;
+
+typedef enum save_place {
+  save_place_floor,
+  save_place_inventory,
+  save_place_equipment
+} save_place_t;
+
+/* Objects on the floor are written pile by pile, top first, and are *
+ * placed by cell; the PC's, by slot.                                */
+typedef struct save_object_record {
+  uint32_t description;
+  uint32_t place;
+  uint32_t slot;
+  int16_t cell[num_dims];
+  int16_t position[num_dims];
+  int32_t hit, dodge, defence, weight, speed, attribute, value;
+  uint32_t seen;
+} save_object_record_t;
+
+/* How many of each description are out there, which decides whether *
+ * uniques and artifacts can be made again.                          */
+typedef struct save_count_record {
+  uint32_t live;
+  uint32_t gone;
+} save_count_record_t;
+
+struct game_save {
+  static void write(dungeon_t *d, FILE *f);
+  static void read(dungeon_t *d, FILE *f, uint32_t sections);
+  static void write_object(dungeon_t *d, object *o, save_place_t place,
+                           uint32_t slot, int16_t y, int16_t x,
+                           std::vector<save_object_record_t> &v);
+  static object *read_object(dungeon_t *d, const save_object_record_t &r,
+                             object *next);
+};
+
+static void save_write(FILE *f, const void *p, size_t size)
+{
+  /* Empty sections may have no payload pointer at all. */
+  if (size && fwrite(p, 1, size, f) != size) {
+    perror("Writing game");
+    exit(-1);
+  }
+}
+
+static void save_read(FILE *f, void *p, size_t size)
+{
+  if (size && fread(p, 1, size, f) != size) {
+    fprintf(stderr, "Saved game is truncated.\n");
+    exit(-1);
+  }
+}
+
+static void __attribute__ ((noreturn)) save_corrupt(void)
+{
+  fprintf(stderr, "Saved game is corrupt.\n");
+  exit(-1);
+}
+
+static void save_section(FILE *f, save_section_type_t type,
+                         uint32_t count, size_t size, const void *p)
+{
+  save_section_t s;
+
+  s.type = type;
+  s.count = count;
+  s.bytes = (uint64_t) count * size;
+  save_write(f, &s, sizeof (s));
+  save_write(f, p, s.bytes);
+}
+
+template <typename T>
+static void save_grid(FILE *f, save_section_type_t type, const grid<T> &g)
+{
+  save_section(f, type, g.size(), sizeof (T), g.data());
+}
+
+/* Reads the header of the next section, which must be of the given   *
+ * type and, unless size is zero, hold whole records of that size and *
+ * nothing else.  Returns how many records it holds.                  */
+static uint32_t load_section(FILE *f, off_t end, save_section_type_t type,
+                             size_t size, save_section_t *s)
+{
+  save_read(f, s, sizeof (*s));
+  if (s->type != type || s->bytes > (uint64_t) (end - ftell(f)) ||
+      (size && s->bytes != (uint64_t) s->count * size)) {
+    save_corrupt();
+  }
+
+  return s->count;
+}
+
+template <typename T>
+static void load_grid(FILE *f, off_t end, save_section_type_t type,
+                      grid<T> &g)
+{
+  save_section_t s;
+
+  if (load_section(f, end, type, sizeof (T), &s) != g.size()) {
+    save_corrupt();
+  }
+  save_read(f, g.data(), g.bytes());
+}
+
+template <typename T>
+static void load_records(FILE *f, off_t end, save_section_type_t type,
+                         std::vector<T> &v)
+{
+  save_section_t s;
+
+  v.resize(load_section(f, end, type, sizeof (T), &s));
+  save_read(f, v.data(), v.size() * sizeof (T));
+}
+
+void game_save::write_object(dungeon_t *d, object *o, save_place_t place,
+                             uint32_t slot, int16_t y, int16_t x,
+                             std::vector<save_object_record_t> &v)
+{
+  save_object_record_t r;
+
+  memset(&r, 0, sizeof (r));
+  r.description = &o->od - &d->object_descriptions[0];
+  r.place = place;
+  r.slot = slot;
+  r.cell[dim_y] = y;
+  r.cell[dim_x] = x;
+  r.position[dim_y] = o->position[dim_y];
+  r.position[dim_x] = o->position[dim_x];
+  r.hit = o->hit;
+  r.dodge = o->dodge;
+  r.defence = o->defence;
+  r.weight = o->weight;
+  r.speed = o->speed;
+  r.attribute = o->attribute;
+  r.value = o->value;
+  r.seen = o->seen;
+  v.push_back(r);
+}
+
+object *game_save::read_object(dungeon_t *d, const save_object_record_t &r,
+                               object *next)
+{
+  object *o;
+
+  if (r.description >= d->object_descriptions.size()) {
+    save_corrupt();
+  }
+  o = new object(d->object_descriptions[r.description], next);
+  o->position[dim_y] = r.position[dim_y];
+  o->position[dim_x] = r.position[dim_x];
+  o->hit = r.hit;
+  o->dodge = r.dodge;
+  o->defence = r.defence;
+  o->weight = r.weight;
+  o->speed = r.speed;
+  o->attribute = r.attribute;
+  o->value = r.value;
+  o->seen = r.seen;
+
+  return o;
+}
+
+void game_save::write(dungeon_t *d, FILE *f)
+{
+  std::vector<save_object_record_t> objects;
+  std::vector<save_count_record_t> counts;
+  std::vector<save_npc_record_t> monsters;
+  save_dungeon_record_t dr;
+  save_npc_record_t nr;
+  save_pc_record_t pr;
+  save_section_t s;
+  uint32_t y, x, i;
+  long start, end;
+  character *c;
+  object *o;
+  npc *m;
+
+  memset(&dr, 0, sizeof (dr));
+  dr.width = d->width;
+  dr.height = d->height;
+  dr.depth = d->depth;
+  dr.time = d->time;
+  dr.is_new = d->is_new;
+  dr.character_sequence_number = d->character_sequence_number;
+  dr.event_sequence_number = d->event_sequence_number;
+  dr.max_monsters = d->max_monsters;
+  dr.max_objects = d->max_objects;
+  dr.num_objects = d->num_objects;
+  dr.monster_descriptions = d->monster_descriptions.size();
+  dr.object_descriptions = d->object_descriptions.size();
+  memcpy(dr.rng, d->rng, sizeof (dr.rng));
+  prefetch_level_stream(d, &dr.rng[rng_level]);
+  save_section(f, save_dungeon, 1, sizeof (dr), &dr);
+  save_section(f, save_rooms, d->num_rooms, sizeof (*d->rooms), d->rooms);
+  save_grid(f, save_map, d->map);
+  save_grid(f, save_hardness, d->hardness);
+
+  memset(&pr, 0, sizeof (pr));
+  pr.position[dim_y] = d->PC->position[dim_y];
+  pr.position[dim_x] = d->PC->position[dim_x];
+  pr.speed = d->PC->speed;
+  pr.hp = d->PC->hp;
+  pr.sequence_number = d->PC->sequence_number;
+  memcpy(pr.kills, d->PC->kills, sizeof (pr.kills));
+  pr.have_seen_corner = d->PC->have_seen_corner;
+  pr.corner_count = d->PC->corner_count;
+  save_section(f, save_pc, 1, sizeof (pr), &pr);
+  save_grid(f, save_known_terrain, d->PC->known_terrain);
+  save_grid(f, save_visible, d->PC->visible);
+
+  /* Between turns, every living monster's turn is in the queue. */
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
+      if (!(c = d->character_map[y][x]) || c == d->PC) {
+        continue;
+      }
+      m = (npc *) c;
+      memset(&nr, 0, sizeof (nr));
+      nr.description = &m->md - &d->monster_descriptions[0];
+      nr.time = m->turn->time;
+      nr.sequence = m->turn->sequence;
+      nr.position[dim_y] = m->position[dim_y];
+      nr.position[dim_x] = m->position[dim_x];
+      nr.pc_last_known_position[dim_y] = m->pc_last_known_position[dim_y];
+      nr.pc_last_known_position[dim_x] = m->pc_last_known_position[dim_x];
+      nr.speed = m->speed;
+      nr.hp = m->hp;
+      nr.sequence_number = m->sequence_number;
+      memcpy(nr.kills, m->kills, sizeof (nr.kills));
+      nr.characteristics = m->characteristics;
+      nr.have_seen_pc = m->have_seen_pc;
+      monsters.push_back(nr);
+    }
+  }
+  save_section(f, save_monsters, monsters.size(), sizeof (nr),
+               monsters.data());
+
+  for (y = 0; y < d->height; y++) {
+    for (x = 0; x < d->width; x++) {
+      for (o = d->objmap[y][x]; o; o = o->next) {
+        write_object(d, o, save_place_floor, 0, y, x, objects);
+      }
+    }
+  }
+  for (i = 0; i < MAX_INVENTORY; i++) {
+    if (d->PC->in[i]) {
+      write_object(d, d->PC->in[i], save_place_inventory, i, 0, 0, objects);
+    }
+  }
+  for (i = 0; i < num_eq_slots; i++) {
+    if (d->PC->eq[i]) {
+      write_object(d, d->PC->eq[i], save_place_equipment, i, 0, 0, objects);
+    }
+  }
+  save_section(f, save_objects, objects.size(), sizeof (objects[0]),
+               objects.data());
+
+  counts.resize(d->monster_descriptions.size());
+  for (i = 0; i < counts.size(); i++) {
+    counts[i].live = d->monster_descriptions[i].num_alive;
+    counts[i].gone = d->monster_descriptions[i].num_killed;
+  }
+  save_section(f, save_monster_descriptions, counts.size(),
+               sizeof (counts[0]), counts.data());
+  counts.resize(d->object_descriptions.size());
+  for (i = 0; i < counts.size(); i++) {
+    counts[i].live = d->object_descriptions[i].num_generated;
+    counts[i].gone = d->object_descriptions[i].num_found;
+  }
+  save_section(f, save_object_descriptions, counts.size(),
+               sizeof (counts[0]), counts.data());
+
+  /* The levels' length is only known once they're written. */
+  memset(&s, 0, sizeof (s));
+  s.type = save_levels;
+  start = ftell(f);
+  save_write(f, &s, sizeof (s));
+  s.count = level_store_write(d, f);
+  end = ftell(f);
+  s.bytes = end - start - sizeof (s);
+  if (fseek(f, start, SEEK_SET)) {
+    perror("Writing game");
+    exit(-1);
+  }
+  save_write(f, &s, sizeof (s));
+  if (fseek(f, end, SEEK_SET)) {
+    perror("Writing game");
+    exit(-1);
+  }
+}
+
+void game_save::read(dungeon_t *d, FILE *f, uint32_t sections)
+{
+  std::vector<save_object_record_t> objects;
+  std::vector<save_count_record_t> counts;
+  std::vector<save_npc_record_t> monsters;
+  save_dungeon_record_t dr;
+  save_pc_record_t pr;
+  save_section_t s;
+  struct stat buf;
+  uint32_t i, n;
+  object **slot;
+  long start;
+  event_t *e;
+  off_t end;
+  npc *m;
+
+  if (fstat(fileno(f), &buf)) {
+    perror("Reading game");
+    exit(-1);
+  }
+  end = buf.st_size;
+  if (sections < num_save_sections) {
+    save_corrupt();
+  }
+
+  if (load_section(f, end, save_dungeon, sizeof (dr), &s) != 1) {
+    save_corrupt();
+  }
+  save_read(f, &dr, sizeof (dr));
+  if (dr.width < MIN_DUNGEON_X || dr.width > MAX_DUNGEON_X ||
+      dr.height < MIN_DUNGEON_Y || dr.height > MAX_DUNGEON_Y) {
+    save_corrupt();
+  }
+  if (dr.monster_descriptions != d->monster_descriptions.size() ||
+      dr.object_descriptions != d->object_descriptions.size()) {
+    fprintf(stderr, "Saved game was made with other description files.\n");
+    exit(-1);
+  }
+  /* The game's size overrides --size. */
+  if (dr.width != d->width || dr.height != d->height) {
+    d->width = dr.width;
+    d->height = dr.height;
+    init_dungeon(d);
+  }
+  d->depth = dr.depth;
+  d->time = dr.time;
+  d->is_new = dr.is_new;
+  d->character_sequence_number = dr.character_sequence_number;
+  d->event_sequence_number = dr.event_sequence_number;
+  d->max_monsters = dr.max_monsters;
+  d->max_objects = dr.max_objects;
+  d->num_objects = dr.num_objects;
+  memcpy(d->rng, dr.rng, sizeof (d->rng));
+
+  if (!(n = load_section(f, end, save_rooms, sizeof (*d->rooms), &s))) {
+    save_corrupt();
+  }
+  free(d->rooms);
+  d->rooms = (room_t *) malloc(n * sizeof (*d->rooms));
+  d->num_rooms = n;
+  save_read(f, d->rooms, n * sizeof (*d->rooms));
+  for (i = 0; i < n; i++) {
+    if (!room_in_dungeon(d, &d->rooms[i])) {
+      save_corrupt();
+    }
+  }
+  load_grid(f, end, save_map, d->map);
+  if (!terrain_in_range(d->map, 1)) {
+    save_corrupt();
+  }
+  load_grid(f, end, save_hardness, d->hardness);
+
+  if (load_section(f, end, save_pc, sizeof (pr), &s) != 1) {
+    save_corrupt();
+  }
+  save_read(f, &pr, sizeof (pr));
+  if (pr.position[dim_y] < 1 || pr.position[dim_y] > d->height - 2 ||
+      pr.position[dim_x] < 1 || pr.position[dim_x] > d->width - 2  ||
+      pr.speed < 1 || pr.speed > MAX_SPEED) {
+    save_corrupt();
+  }
+  init_pc(d);
+  d->PC->position[dim_y] = pr.position[dim_y];
+  d->PC->position[dim_x] = pr.position[dim_x];
+  d->PC->speed = pr.speed;
+  d->PC->hp = pr.hp;
+  d->PC->sequence_number = pr.sequence_number;
+  memcpy(d->PC->kills, pr.kills, sizeof (d->PC->kills));
+  d->PC->have_seen_corner = pr.have_seen_corner;
+  d->PC->corner_count = pr.corner_count;
+  charpair(d->PC->position) = d->PC;
+  load_grid(f, end, save_known_terrain, d->PC->known_terrain);
+  if (!terrain_in_range(d->PC->known_terrain, 0)) {
+    save_corrupt();
+  }
+  load_grid(f, end, save_visible, d->PC->visible);
+
+  load_records(f, end, save_monsters, monsters);
+  for (i = 0; i < monsters.size(); i++) {
+    if (monsters[i].description >= d->monster_descriptions.size() ||
+        monsters[i].position[dim_y] < 1                            ||
+        monsters[i].position[dim_y] > d->height - 2                ||
+        monsters[i].position[dim_x] < 1                            ||
+        monsters[i].position[dim_x] > d->width - 2                 ||
+        charpair(monsters[i].position)                             ||
+        monsters[i].speed < 1                                      ||
+        monsters[i].speed > MAX_SPEED                              ||
+        monsters[i].time - d->time >= EVENT_QUEUE_DAYS)            {
+      save_corrupt();
+    }
+    m = new npc(d->monster_descriptions[monsters[i].description]);
+    m->position[dim_y] = monsters[i].position[dim_y];
+    m->position[dim_x] = monsters[i].position[dim_x];
+    m->pc_last_known_position[dim_y] =
+      monsters[i].pc_last_known_position[dim_y];
+    m->pc_last_known_position[dim_x] =
+      monsters[i].pc_last_known_position[dim_x];
+    m->speed = monsters[i].speed;
+    m->hp = monsters[i].hp;
+    m->sequence_number = monsters[i].sequence_number;
+    memcpy(m->kills, monsters[i].kills, sizeof (m->kills));
+    m->characteristics = monsters[i].characteristics;
+    m->have_seen_pc = monsters[i].have_seen_pc;
+    charpair(m->position) = m;
+    d->census[m->characteristics & NPC_MOVE_BITS]++;
+
+    e = d->events.alloc();
+    e->type = event_character_turn;
+    e->time = monsters[i].time;
+    e->sequence = monsters[i].sequence;
+    e->c = m;
+    m->turn = e;
+    d->events.push(e);
+  }
+  d->num_monsters = monsters.size();
+
+  /* Piles are built bottom up, so they're read in reverse. */
+  load_records(f, end, save_objects, objects);
+  for (i = objects.size(); i--; ) {
+    switch (objects[i].place) {
+    case save_place_floor:
+      if (objects[i].cell[dim_y] < 0 || objects[i].cell[dim_y] >= d->height ||
+          objects[i].cell[dim_x] < 0 || objects[i].cell[dim_x] >= d->width) {
+        save_corrupt();
+      }
+      slot = &objpair(objects[i].cell);
+      break;
+    case save_place_inventory:
+      if (objects[i].slot >= MAX_INVENTORY || d->PC->in[objects[i].slot]) {
+        save_corrupt();
+      }
+      slot = &d->PC->in[objects[i].slot];
+      break;
+    case save_place_equipment:
+      if (objects[i].slot >= num_eq_slots || d->PC->eq[objects[i].slot]) {
+        save_corrupt();
+      }
+      slot = &d->PC->eq[objects[i].slot];
+      break;
+    default:
+      save_corrupt();
+    }
+    *slot = read_object(d, objects[i], *slot);
+  }
+
+  /* Restored monsters and objects weren't counted in, so the saved *
+   * counts are the counts.                                         */
+  load_records(f, end, save_monster_descriptions, counts);
+  if (counts.size() != d->monster_descriptions.size()) {
+    save_corrupt();
+  }
+  for (i = 0; i < counts.size(); i++) {
+    d->monster_descriptions[i].num_alive = counts[i].live;
+    d->monster_descriptions[i].num_killed = counts[i].gone;
+  }
+  load_records(f, end, save_object_descriptions, counts);
+  if (counts.size() != d->object_descriptions.size()) {
+    save_corrupt();
+  }
+  for (i = 0; i < counts.size(); i++) {
+    d->object_descriptions[i].num_generated = counts[i].live;
+    d->object_descriptions[i].num_found = counts[i].gone;
+  }
+
+  n = load_section(f, end, save_levels, 0, &s);
+  start = ftell(f);
+  if (level_store_read(d, f, n) ||
+      (uint64_t) (ftell(f) - start) != s.bytes) {
+    save_corrupt();
+  }
+
+  for (i = num_save_sections; i < sections; i++) {
+    save_read(f, &s, sizeof (s));
+    if (s.bytes > (uint64_t) (end - ftell(f)) ||
+        fseek(f, s.bytes, SEEK_CUR)) {
+      save_corrupt();
+    }
+  }
+
+  dijkstra_invalidate(d);
+}
+
+int write_game(dungeon_t *d, const char *file)
+{
+  std::string part;
+  uint32_t be32;
+  FILE *f;
+
+  part = std::string(file) + ".part";
+  if (!(f = fopen(part.c_str(), "w"))) {
+    perror(part.c_str());
+    return 1;
+  }
+
+  save_write(f, DUNGEON_SAVE_SEMANTIC, sizeof (DUNGEON_SAVE_SEMANTIC) - 1);
+  be32 = htobe32(GAME_SAVE_VERSION);
+  save_write(f, &be32, sizeof (be32));
+  be32 = htobe32(num_save_sections);
+  save_write(f, &be32, sizeof (be32));
+  game_save::write(d, f);
+
+  if (fclose(f) || rename(part.c_str(), file)) {
+    perror(file);
+    unlink(part.c_str());
+    return 1;
+  }
+
+  return 0;
+}
+
+void read_game(dungeon_t *d, FILE *f, uint32_t sections)
+{
+  game_save::read(d, f, sections);
+}
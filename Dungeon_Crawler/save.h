@@ -0,0 +1,20 @@
+#ifndef SAVE_H
+# define SAVE_H
+
+# include <stdio.h>
+# include <stdint.h>
+
+typedef struct dungeon dungeon_t;
+
+/* Version 0 save files hold only the terrain.  Version 1 files hold a *
+ * whole game, between turns, so that it can be checkpointed and then  *
+ * resumed with --load.                                                */
+# define GAME_SAVE_VERSION     1U
+
+/* Returns nonzero if the file can't be written.  The game goes to a *
+ * new file that replaces the old one only once it's complete.       */
+int write_game(dungeon_t *d, const char *file);
+/* For read_dungeon(), with f just past the version 1 header. */
+void read_game(dungeon_t *d, FILE *f, uint32_t sections);
+
+#endif
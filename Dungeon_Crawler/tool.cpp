@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+
+#include "dungeon.h"
+#include "save.h"
+
+/* Works through many dungeon files, or many seeds, at once.  Nothing   *
+ * here starts a terminal or parses descriptions, and a bad file is     *
+ * reported and passed over rather than ending the run.  Each worker    *
+ * reuses one dungeon for everything it's given.  Results are printed   *
+ * in the order the files were named, whatever order they finish in.    */
+
+/* Items are handed out a block at a time, and each block's results *
+ * written before the next starts, so output never waits on the end *
+ * of a long run and never piles up in memory.                      */
+#define TOOL_BLOCK      4096
+#define TOOL_OUTPUT_BUF (1 << 20)
+
+typedef enum tool_op {
+  tool_validate,
+  tool_stats,
+  tool_convert,
+  tool_generate
+} tool_op_t;
+
+typedef struct tool {
+  tool_op_t op;
+  const char *output_dir;
+  uint32_t width, height;
+  /* Files for generate are made from seeds instead. */
+  std::vector<std::string> files;
+  std::vector<uint32_t> seeds;
+  uint32_t first, last;
+  std::atomic<uint32_t> next;
+  std::vector<std::string> results;
+  std::atomic<uint32_t> failed;
+} tool_t;
+
+static uint64_t tool_elapsed(struct timespec *start, struct timespec *end)
+{
+  return ((end->tv_sec - start->tv_sec) * 1000000000ULL +
+          end->tv_nsec - start->tv_nsec);
+}
+
+static int tool_is_pgm(const std::string &file)
+{
+  return (file.size() > 4 &&
+          !strcmp(file.c_str() + file.size() - 4, ".pgm"));
+}
+
+/* As rlg327 --save names them: an image's name with its extension *
+ * swapped, or the seed.  Either goes in the output directory, if  *
+ * one was given.                                                  */
+static std::string tool_output(tool_t *t, const std::string &name)
+{
+  std::string base;
+  size_t slash;
+
+  base = name;
+  if (tool_is_pgm(base)) {
+    base.replace(base.size() - 3, 3, "rlg327");
+  } else if (t->op == tool_generate) {
+    base += ".rlg327";
+  }
+  if (!t->output_dir) {
+    return base;
+  }
+  if ((slash = base.rfind('/')) != std::string::npos) {
+    base.erase(0, slash + 1);
+  }
+
+  return std::string(t->output_dir) + "/" + base;
+}
+
+static void tool_summarize(dungeon_t *d, std::string &s)
+{
+  uint32_t room, hall, rock, stairs;
+  uint64_t hardness;
+  uint8_t *h;
+  size_t i;
+  char buf[160];
+
+  room = hall = rock = stairs = 0;
+  hardness = 0;
+  h = d->hardness.data();
+  for (i = 0; i < d->map.size(); i++) {
+    switch (d->map.data()[i]) {
+    case ter_floor_room:
+    case ter_marketplace:
+      room++;
+      break;
+    case ter_floor_hall:
+      hall++;
+      break;
+    case ter_stairs_up:
+    case ter_stairs_down:
+      stairs++;
+      break;
+    case ter_wall:
+      rock++;
+      hardness += h[i];
+      break;
+    default:
+      break;
+    }
+  }
+
+  snprintf(buf, sizeof (buf),
+           "%ux%u, %u rooms, %u room cells, %u hall cells, %u stairs, "
+           "%u rock cells of mean hardness %.1f",
+           d->width, d->height, d->num_rooms, room, hall, stairs,
+           rock, rock ? (double) hardness / rock : 0.0);
+  s += buf;
+}
+
+/* Fills in the item's line of output, and returns nonzero if it failed. */
+static int tool_process(tool_t *t, dungeon_t *d, uint32_t item,
+                        std::string &s)
+{
+  const char *error;
+  std::string name, output;
+  int version;
+
+  free(d->rooms);
+  d->rooms = NULL;
+  d->num_rooms = 0;
+
+  if (t->op == tool_generate) {
+    /* Exactly the first level of "rlg327 --rand <seed>". */
+    name = std::to_string(t->seeds[item]);
+    seed_dungeon(d, t->seeds[item]);
+    init_dungeon(d);
+    gen_dungeon(d);
+    version = DUNGEON_SAVE_VERSION;
+  } else {
+    name = t->files[item];
+    if (tool_is_pgm(name)) {
+      version = load_pgm(d, name.c_str(), &error) ? -1 : DUNGEON_SAVE_VERSION;
+    } else {
+      version = load_dungeon(d, name.c_str(), &error);
+    }
+    if (version < 0) {
+      s = name + ": " + error + "\n";
+      return 1;
+    }
+  }
+
+  /* Games need their descriptions to be checked; see rlg327 --load. *
+   * Only the header has been, so validate says so, too, rather than *
+   * let the file pass as good.                                      */
+  if (version == GAME_SAVE_VERSION) {
+    s = name + ": saved game, version 1; only its header was read, so it " +
+        (t->op == tool_validate ? "was not validated\n" :
+         t->op == tool_stats ? "has no stats\n" : "was not converted\n");
+    return 0;
+  }
+
+  if (t->op == tool_convert || t->op == tool_generate) {
+    output = tool_output(t, name);
+    if (store_dungeon(d, output.c_str(), &error)) {
+      s = output + ": " + error + "\n";
+      return 1;
+    }
+    s = name + " -> " + output + ": ";
+  } else if (t->op == tool_stats) {
+    s = name + ": ";
+  } else {
+    return 0;
+  }
+  tool_summarize(d, s);
+  s += "\n";
+
+  return 0;
+}
+
+static void tool_worker(tool_t *t, dungeon_t *d)
+{
+  uint32_t item;
+
+  while ((item = t->next++) < t->last) {
+    if (tool_process(t, d, item, t->results[item - t->first])) {
+      t->failed++;
+    }
+  }
+}
+
+static void usage(char *name)
+{
+  fprintf(stderr,
+          "Usage: %s validate|stats [<options>] [--size <width>x<height>] "
+          "<file>...\n"
+          "       %s convert [<options>] <file>...\n"
+          "       %s generate [<options>] <seed>[-<seed>]...\n"
+          "Options: [-t|--threads <count>] [-o|--output <directory>]\n"
+          "Files ending in .pgm are images; anything else is a save file.\n"
+          "--size gives the size of the dungeons that images hold.  Convert\n"
+          "and generate write version 0 files, which are always 80x21.\n"
+          "A file named - means to read more names, one per line, from\n"
+          "standard input.\n",
+          name, name, name);
+
+  exit(-1);
+}
+
+static void tool_read_names(tool_t *t)
+{
+  char line[4096];
+  size_t len;
+
+  while (fgets(line, sizeof (line), stdin)) {
+    len = strlen(line);
+    while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      line[--len] = '\0';
+    }
+    if (len) {
+      t->files.push_back(line);
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<std::thread> workers;
+  std::vector<dungeon_t *> dungeons;
+  struct timespec start, end;
+  uint32_t threads, items, i, j, lo, hi;
+  static char output[TOOL_OUTPUT_BUF];
+  double wall;
+  tool_t t;
+
+  if (argc < 2) {
+    usage(argv[0]);
+  }
+  if (!strcmp(argv[1], "validate")) {
+    t.op = tool_validate;
+  } else if (!strcmp(argv[1], "stats")) {
+    t.op = tool_stats;
+  } else if (!strcmp(argv[1], "convert")) {
+    t.op = tool_convert;
+  } else if (!strcmp(argv[1], "generate")) {
+    t.op = tool_generate;
+  } else {
+    usage(argv[0]);
+  }
+  t.output_dir = NULL;
+  t.width = DUNGEON_X;
+  t.height = DUNGEON_Y;
+  t.failed = 0;
+  threads = std::thread::hardware_concurrency();
+
+  for (i = 2; i < (uint32_t) argc; i++) {
+    if ((!strcmp(argv[i], "-t") || !strcmp(argv[i], "--threads")) &&
+        i + 1 < (uint32_t) argc &&
+        sscanf(argv[++i], "%u", &threads) == 1) {
+    } else if ((!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) &&
+               i + 1 < (uint32_t) argc) {
+      t.output_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--size") && i + 1 < (uint32_t) argc &&
+               sscanf(argv[++i], "%ux%u", &t.width, &t.height) == 2 &&
+               t.width >= MIN_DUNGEON_X && t.width <= MAX_DUNGEON_X &&
+               t.height >= MIN_DUNGEON_Y && t.height <= MAX_DUNGEON_Y) {
+    } else if (t.op == tool_generate) {
+      switch (sscanf(argv[i], "%u-%u", &lo, &hi)) {
+      case 1:
+        hi = lo;
+        /* Fall through */
+      case 2:
+        if (hi >= lo) {
+          for (j = lo; j < hi; j++) {
+            t.seeds.push_back(j);
+          }
+          t.seeds.push_back(hi);
+          break;
+        }
+        /* Fall through */
+      default:
+        usage(argv[0]);
+      }
+    } else if (argv[i][0] == '-' && argv[i][1]) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "-")) {
+      tool_read_names(&t);
+    } else {
+      t.files.push_back(argv[i]);
+    }
+  }
+  /* Version 0 files only hold default-sized dungeons, so no other *
+   * size could ever be written.                                   */
+  if ((t.op == tool_convert || t.op == tool_generate) &&
+      (t.width != DUNGEON_X || t.height != DUNGEON_Y)) {
+    fprintf(stderr, "%s writes version 0 files, which are always %ux%u.\n",
+            argv[1], DUNGEON_X, DUNGEON_Y);
+    exit(-1);
+  }
+  items = t.op == tool_generate ? t.seeds.size() : t.files.size();
+  if (!threads) {
+    threads = 1;
+  }
+  if (threads > items) {
+    threads = items ? items : 1;
+  }
+
+  setvbuf(stdout, output, _IOFBF, sizeof (output));
+
+  for (i = 0; i < threads; i++) {
+    dungeons.push_back(new dungeon());
+    dungeons[i]->width = t.width;
+    dungeons[i]->height = t.height;
+    seed_dungeon(dungeons[i], 0);
+    init_dungeon(dungeons[i]);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (t.first = 0; t.first < items; t.first = t.last) {
+    t.last = t.first + TOOL_BLOCK < items ? t.first + TOOL_BLOCK : items;
+    t.next = t.first;
+    t.results.assign(t.last - t.first, std::string());
+    for (i = 0; i < threads; i++) {
+      workers.push_back(std::thread(tool_worker, &t, dungeons[i]));
+    }
+    for (i = 0; i < threads; i++) {
+      workers[i].join();
+    }
+    workers.clear();
+    for (i = 0; i < t.last - t.first; i++) {
+      fwrite(t.results[i].data(), 1, t.results[i].size(), stdout);
+    }
+  }
+  fflush(stdout);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  wall = tool_elapsed(&start, &end) / 1000000000.0;
+  fprintf(stderr, "%u %s in %.3f seconds (%.0f per second) on %u threads, "
+          "%u failed\n",
+          items, t.op == tool_generate ? "seeds" : "files", wall,
+          wall > 0 ? items / wall : 0.0, threads, (uint32_t) t.failed);
+
+  for (i = 0; i < threads; i++) {
+    delete_dungeon(dungeons[i]);
+    delete dungeons[i];
+  }
+
+  return t.failed ? 1 : 0;
+}
@@ -1,13 +1,16 @@
 #ifndef UTILS_H
 # define UTILS_H
 
-/* Returns true if random float in [0,1] is less than *
- * numerator/denominator.  Uses only integer math.    */
-# define rand_under(numerator, denominator) \
-  (rand() < ((RAND_MAX / denominator) * numerator))
+# include "rng.h"
 
-/* Returns random integer in [min, max]. */
-# define rand_range(min, max) ((rand() % (((max) + 1) - (min))) + (min))
+/* Returns true with probability numerator/denominator, *
+ * drawing from generator r.  Uses only integer math.   */
+# define rand_under(r, numerator, denominator) \
+  (rng_under((r), (denominator)) < (uint32_t) (numerator))
+
+/* Returns random integer in [min, max], drawing from generator r. */
+# define rand_range(r, min, max) \
+  ((int32_t) rng_under((r), ((max) + 1) - (min)) + (min))
 
 int makedirectory(char *dir);
 
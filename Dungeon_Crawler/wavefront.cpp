@@ -0,0 +1,233 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define WAVEFRONT_X86
+#endif
+
+#include "wavefront.h"
+#include "dungeon.h"
+#include "pc.h"
+
+/* The map is copied into a padded grid so that every row is a whole    *
+ * number of AVX2 vectors and the loads at x - 1 and x + 1 never leave  *
+ * the grid.  Padding and non-floor cells are walls: their distance is  *
+ * pinned at PATH_UNREACHED, which also means they never pass a         *
+ * distance on.  The grid is reallocated when the dungeon size changes. */
+#define WAVEFRONT_OFFSET 16
+#define WAVEFRONT_ALIGN  32
+
+#define wavefront_dist(w, y, x) ((w)->dist[(y) * (w)->stride + (x)])
+#define wavefront_wall(w, y, x) ((w)->wall[(y) * (w)->stride + (x)])
+
+static void wavefront_size(wavefront_t *w, dungeon *d)
+{
+  size_t bytes;
+
+  if (w->dist && w->width == d->width && w->height == d->height) {
+    return;
+  }
+
+  free(w->dist);
+  free(w->wall);
+  w->width = d->width;
+  w->height = d->height;
+  w->stride = WAVEFRONT_OFFSET + ((d->width + 15) & ~15);
+  bytes = (size_t) w->stride * (d->height + 1) * sizeof (*w->dist);
+  if (!(w->dist = (path_distance_t *) aligned_alloc(WAVEFRONT_ALIGN,
+                                                    bytes)) ||
+      !(w->wall = (path_distance_t *) aligned_alloc(WAVEFRONT_ALIGN,
+                                                    bytes))) {
+    perror("aligned_alloc");
+    exit(-1);
+  }
+}
+
+/* Each kernel relaxes one row against its eight neighbors, in place, *
+ * and returns nonzero if anything in the row changed.  Adding 1 with *
+ * saturation keeps PATH_UNREACHED meaning "unreached", exactly as in *
+ * dijkstra().                                                        */
+typedef uint32_t (*wavefront_row_t)(wavefront_t *w, uint32_t y);
+
+static uint32_t wavefront_row_scalar(wavefront_t *w, uint32_t y)
+{
+  path_distance_t *up, *row, *down, *wall;
+  uint32_t x, m, changed;
+
+  up = &wavefront_dist(w, y - 1, 0);
+  row = &wavefront_dist(w, y, 0);
+  down = &wavefront_dist(w, y + 1, 0);
+  wall = &wavefront_wall(w, y, 0);
+
+  for (changed = 0, x = WAVEFRONT_OFFSET;
+       x < WAVEFRONT_OFFSET + w->width;
+       x++) {
+    if (wall[x]) {
+      continue;
+    }
+    m = up[x - 1];
+    if (up[x] < m)       m = up[x];
+    if (up[x + 1] < m)   m = up[x + 1];
+    if (row[x - 1] < m)  m = row[x - 1];
+    if (row[x + 1] < m)  m = row[x + 1];
+    if (down[x - 1] < m) m = down[x - 1];
+    if (down[x] < m)     m = down[x];
+    if (down[x + 1] < m) m = down[x + 1];
+    if (m < PATH_UNREACHED - 1 && m + 1 < row[x]) {
+      row[x] = m + 1;
+      changed = 1;
+    }
+  }
+
+  return changed;
+}
+
+#ifdef WAVEFRONT_X86
+
+__attribute__ ((target ("avx2")))
+static uint32_t wavefront_row_avx2(wavefront_t *w, uint32_t y)
+{
+  __m256i m, v, n, one, changed;
+  uint32_t x;
+
+  one = _mm256_set1_epi16(1);
+  changed = _mm256_setzero_si256();
+
+  for (x = WAVEFRONT_OFFSET; x < w->stride; x += 16) {
+    m = _mm256_min_epu16(
+          _mm256_min_epu16(
+            _mm256_min_epu16(
+              _mm256_loadu_si256((__m256i *) &wavefront_dist(w, y - 1, x - 1)),
+              _mm256_load_si256((__m256i *) &wavefront_dist(w, y - 1, x))),
+            _mm256_min_epu16(
+              _mm256_loadu_si256((__m256i *) &wavefront_dist(w, y - 1, x + 1)),
+              _mm256_loadu_si256((__m256i *) &wavefront_dist(w, y, x - 1)))),
+          _mm256_min_epu16(
+            _mm256_min_epu16(
+              _mm256_loadu_si256((__m256i *) &wavefront_dist(w, y, x + 1)),
+              _mm256_loadu_si256((__m256i *) &wavefront_dist(w, y + 1, x - 1))),
+            _mm256_min_epu16(
+              _mm256_load_si256((__m256i *) &wavefront_dist(w, y + 1, x)),
+              _mm256_loadu_si256((__m256i *)
+                                 &wavefront_dist(w, y + 1, x + 1)))));
+    v = _mm256_load_si256((__m256i *) &wavefront_dist(w, y, x));
+    n = _mm256_or_si256(_mm256_min_epu16(v, _mm256_adds_epu16(m, one)),
+                        _mm256_load_si256((__m256i *)
+                                          &wavefront_wall(w, y, x)));
+    changed = _mm256_or_si256(changed, _mm256_xor_si256(n, v));
+    _mm256_store_si256((__m256i *) &wavefront_dist(w, y, x), n);
+  }
+
+  return !_mm256_testz_si256(changed, changed);
+}
+
+#endif
+
+static const struct {
+  const char *name;
+  wavefront_row_t row;
+} kernels[] = {
+#ifdef WAVEFRONT_X86
+  { "avx2",   wavefront_row_avx2   },
+#endif
+  { "scalar", wavefront_row_scalar },
+  { 0,        0                    }
+};
+
+static uint32_t kernel_supported(uint32_t k)
+{
+#ifdef WAVEFRONT_X86
+  if (kernels[k].row == wavefront_row_avx2) {
+    return __builtin_cpu_supports("avx2");
+  }
+#endif
+  return 1;
+}
+
+void wavefront_init(wavefront_t *w)
+{
+  w->dist = w->wall = NULL;
+  w->width = w->height = w->stride = 0;
+  wavefront_select(w, "auto");
+}
+
+void wavefront_delete(wavefront_t *w)
+{
+  free(w->dist);
+  free(w->wall);
+  w->dist = w->wall = NULL;
+}
+
+int wavefront_select(wavefront_t *w, const char *name)
+{
+  uint32_t k;
+
+  for (k = 0; kernels[k].name; k++) {
+    if ((!strcmp(name, "auto") || !strcmp(name, kernels[k].name)) &&
+        kernel_supported(k)) {
+      w->kernel = k;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+const char *wavefront_kernel(const wavefront_t *w)
+{
+  return kernels[w->kernel].name;
+}
+
+/* Sweeping down and then back up the map carries distances vertically *
+ * as far as they can go in one pass, and each row is relaxed until it *
+ * settles, which does the same horizontally.  Turns in the corridors  *
+ * cost another pair of sweeps each.  We're done when a pair of sweeps *
+ * changes nothing.                                                    */
+void wavefront_distance(wavefront_t *w, dungeon *d)
+{
+  wavefront_row_t row;
+  uint32_t x, y, changed;
+
+  row = kernels[w->kernel].row;
+
+  wavefront_size(w, d);
+  memset(w->dist, 0xff,
+         (size_t) w->stride * (d->height + 1) * sizeof (*w->dist));
+  memset(w->wall, 0xff,
+         (size_t) w->stride * (d->height + 1) * sizeof (*w->wall));
+  for (y = 1; y < d->height - 1u; y++) {
+    for (x = 1; x < d->width - 1u; x++) {
+      if (mapxy(x, y) >= ter_floor) {
+        wavefront_wall(w, y, WAVEFRONT_OFFSET + x) = 0;
+      }
+    }
+  }
+  if (mappair(d->PC->position) >= ter_floor) {
+    wavefront_dist(w, d->PC->position[dim_y],
+                   WAVEFRONT_OFFSET + d->PC->position[dim_x]) = 0;
+  }
+
+  do {
+    changed = 0;
+    for (y = 1; y < d->height - 1u; y++) {
+      while (row(w, y)) {
+        changed = 1;
+      }
+    }
+    for (y = d->height - 2u; y > 0; y--) {
+      while (row(w, y)) {
+        changed = 1;
+      }
+    }
+  } while (changed);
+
+  for (y = 0; y < d->height; y++) {
+    memcpy(d->pc_distance[y], &wavefront_dist(w, y, WAVEFRONT_OFFSET),
+           d->width * sizeof (path_distance_t));
+  }
+  d->pc_distance[d->PC->position[dim_y]][d->PC->position[dim_x]] = 0;
+  d->pc_distance_dirty = 0;
+}
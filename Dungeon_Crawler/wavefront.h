@@ -0,0 +1,32 @@
+#ifndef WAVEFRONT_H
+# define WAVEFRONT_H
+
+# include <stdint.h>
+
+# include "path.h"
+
+typedef struct dungeon dungeon_t;
+
+/* An alternative to dijkstra() that computes pc_distance by relaxing    *
+ * whole rows of the map at once, using AVX2 where the CPU has it.  The  *
+ * output is identical to dijkstra()'s.  Its padded copy of the map and  *
+ * its choice of kernel live in a wavefront_t owned by the caller, so    *
+ * separate dungeons can be pathed on separate threads.                  *
+ * wavefront_init() picks the best kernel this machine supports;         *
+ * wavefront_select() forces one ("scalar", "avx2" or "auto"), and       *
+ * returns nonzero if that kernel is unknown or unsupported here.        */
+typedef struct wavefront {
+  path_distance_t *dist;
+  path_distance_t *wall;
+  uint32_t width, height;
+  uint32_t stride;
+  uint32_t kernel;
+} wavefront_t;
+
+void wavefront_init(wavefront_t *w);
+void wavefront_delete(wavefront_t *w);
+void wavefront_distance(wavefront_t *w, dungeon_t *d);
+int wavefront_select(wavefront_t *w, const char *kernel);
+const char *wavefront_kernel(const wavefront_t *w);
+
+#endif